@@ -1,10 +1,11 @@
 ﻿#include "keypad_mcp23s17.h"
 #include "mcp23s17.h"
-#include <util/delay.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
 
-volatile uint8_t KeySwCol = 0xFF;
-volatile uint8_t gkswScanCode = 0xFF;
-volatile bool    gkswFlag = false;
+volatile uint8_t  KeySwCol = 0xFF;
+volatile uint16_t kswDropped = 0;
+volatile bool     kswGhost = false;
 
 #define ROW1_MASK   0xE0   // 1110 0000
 #define ROW2_MASK   0xD0   // 1101 0000
@@ -18,24 +19,254 @@ typedef enum {
     kswPRESSED, kswRELEASING
 } KeySW_State_t;
 
+// ---------------- 이벤트 FIFO ----------------
+static keyEvent_t       kswFifo[KEYPAD_EVENT_FIFO_SIZE];
+static volatile uint8_t kswHead = 0;    // Keypad_Task()만 변경
+static volatile uint8_t kswTail = 0;    // Keypad_GetEvent()만 변경
+
+static volatile uint16_t kswTime = 0;   // [ms], Keypad_TickISR() 마다 증가
+static volatile bool     kswTickPending = false;
+static volatile bool     kswXferBusy = false;   // GPIOB Write/Read 진행 중
+static volatile bool     kswColsReady = false;  // MATRIX 스캔 결과 도착
+static volatile uint16_t kswCols = 0xFFFF;      // MATRIX 스캔 결과 (Row별 Column 4bit)
+static uint8_t           kswSingleDiv = 0;
+
+static uint16_t kswHoldMs   = KEYPAD_HOLD_MS_DEFAULT;
+static uint16_t kswRepeatMs = KEYPAD_REPEAT_MS_DEFAULT;
+
+static volatile uint8_t kswMode = KEYPAD_SCAN_SINGLE;
+
+// MATRIX 모드 상태
+static volatile uint16_t kswState = 0;  // 디바운싱된 bitmap (1 = 눌림)
+static uint16_t kswCnt0 = 0xFFFF;       // Vertical Counter bit0
+static uint16_t kswCnt1 = 0xFFFF;       // Vertical Counter bit1
+static uint16_t kswCnt2 = 0xFFFF;       // Vertical Counter bit2
+
+static uint8_t  kswKey = 0xFF;          // 현재 눌려 있는 키
+static uint16_t kswHeldMs = 0;          // PRESS(HOLD) 이후 경과 시간
+static bool     kswRepeating = false;   // HOLD 발생 후 REPEAT 구간
+
+static void kswPost(uint8_t key, keyEventType_t type)
+{
+    uint8_t next = (kswHead + 1) & KEYPAD_EVENT_FIFO_MASK;
+    uint8_t sreg;
+
+    if (next == kswTail)
+    {
+        kswDropped++;
+        return;
+    }
+
+    kswFifo[kswHead].key       = key;
+    kswFifo[kswHead].type      = (uint8_t)type;
+    // kswTime(16bit)은 Tick ISR이 바꾼다. ISR 안에서 불려도 인터럽트를 켜지 않도록 SREG를 복원한다.
+    sreg = SREG;
+    cli();
+    kswFifo[kswHead].timestamp = kswTime;
+    SREG = sreg;
+    kswHead = next;     // 데이터를 모두 쓴 뒤에 Head를 넘긴다
+}
+
+bool Keypad_GetEvent(keyEvent_t *evt)
+{
+    uint8_t tail = kswTail;
+
+    if (tail == kswHead)
+        return false;
+
+    *evt = kswFifo[tail];
+    kswTail = (tail + 1) & KEYPAD_EVENT_FIFO_MASK;
+    return true;
+}
+
+uint8_t Keypad_EventCount(void)
+{
+    return (kswHead - kswTail) & KEYPAD_EVENT_FIFO_MASK;
+}
+
+void Keypad_SetTypematic(uint16_t holdMs, uint16_t repeatMs)
+{
+    uint8_t sreg = SREG;
+
+    cli();
+    kswHoldMs   = holdMs;
+    kswRepeatMs = repeatMs;
+    SREG = sreg;
+}
+
+static void kswKeyPressed(uint8_t key)
+{
+    kswKey = key;
+    kswHeldMs = 0;
+    kswRepeating = false;
+    kswPost(key, KEY_EVT_PRESS);
+}
+
+// 눌림이 유지되는 동안 호출 → HOLD / REPEAT 이벤트 생성
+static void kswTypematic(uint8_t elapsedMs)
+{
+    if (kswHoldMs == 0)
+        return;
+
+    kswHeldMs += elapsedMs;
+
+    if (!kswRepeating)
+    {
+        if (kswHeldMs >= kswHoldMs)
+        {
+            kswPost(kswKey, KEY_EVT_HOLD);
+            kswRepeating = true;
+            kswHeldMs = 0;
+        }
+    }
+    else if (kswRepeatMs && (kswHeldMs >= kswRepeatMs))
+    {
+        kswPost(kswKey, KEY_EVT_REPEAT);
+        kswHeldMs = 0;
+    }
+}
+
+void Keypad_SetScanMode(keypadScanMode_t mode)
+{
+    kswMode = (uint8_t)mode;
+}
+
+uint16_t Keypad_GetBitmap(void)
+{
+    uint16_t bitmap;
+    uint8_t sreg = SREG;
+
+    cli();
+    bitmap = kswState;
+    SREG = sreg;
+
+    return bitmap;
+}
+
 // ---------------- ROW 선택 + COL 읽기 ----------------
+// SPI ISR에서 호출된다.
+static void kswXferDone(uint8_t val)
+{
+    KeySwCol = val & 0x0F;
+    kswXferBusy = false;
+}
+
+/*
+ * GPIOB Write(Row 선택) → GPIOB Read(Col) 두 프레임을 시작만 하고 바로 리턴한다.
+ * 결과(KeySwCol)는 약 50us 뒤 SPI ISR에서 갱신되며, FSM은 다음 tick에서 이를 사용한다.
+ * Read 프레임의 Opcode/Register 16bit 전송 시간이 Row 출력 안정 시간(기존 _delay_us(5))을 대신한다.
+ */
 static void getKeySW(uint8_t rowMask)
 {
     uint8_t out = (rowMask & 0xF0) | 0x0F;  // row 설정 + col = 1111
 
-    MCP23S17_WriteReg(IOX_GPIOB, out);
-    _delay_us(5);
+    kswXferBusy = true;
+    if (!MCP23S17_WriteReadRegAsync(IOX_GPIOB, out, IOX_GPIOB, kswXferDone))
+        kswXferBusy = false;
+}
 
-    uint8_t val = MCP23S17_ReadReg(IOX_GPIOB);
-    KeySwCol = val & 0x0F;
+// col에서 눌린(0) 컬럼을 찾아 PRESS 이벤트 발생
+static bool kswFindKey(uint8_t col, uint8_t base)
+{
+    uint8_t i;
+
+    for (i=0; i<4; i++)
+    {
+        if (!(col & (1<<i)))
+        {
+            kswKeyPressed(base + i);
+            return true;
+        }
+    }
+    return false;
 }
 
 
+// ---------------- MATRIX 스캔 -----------------
+static const uint8_t rowOuts[4] = { ROW1_MASK | 0x0F, ROW2_MASK | 0x0F, ROW3_MASK | 0x0F, ROW4_MASK | 0x0F };
+
+// SPI ISR에서 호출된다.
+static void kswMatrixDone(uint16_t cols)
+{
+    kswCols = cols;
+    kswColsReady = true;
+    kswXferBusy = false;
+}
+
+
+// 두 Row가 2개 이상의 Column을 공유하면 Ghost
+static bool kswGhostCheck(uint16_t raw)
+{
+    uint8_t a, b, common;
+
+    for (a=0; a<3; a++)
+    {
+        for (b=a+1; b<4; b++)
+        {
+            common = (raw >> (a * 4)) & (raw >> (b * 4)) & 0x0F;
+            if (common & (common - 1))
+                return true;
+        }
+    }
+    return false;
+}
+
+// 4개 Row를 모두 읽은 bitmap(bit = row*4 + col, 1 = 눌림)을 처리
+static void ScanKeyMatrix(uint16_t raw)
+{
+    uint16_t delta, changed;
+    uint8_t i;
+
+    if (kswGhostCheck(raw))
+    {
+        if (!kswGhost)
+            kswPost(0xFF, KEY_EVT_GHOST);
+        kswGhost = true;
+        raw &= kswState;        // 새 눌림은 무시, 해제만 허용
+    }
+    else
+    {
+        kswGhost = false;
+    }
+
+    /*
+     * Vertical Counter
+     * 상태가 다른 bit만 카운트하고, 8회 연속 다르면 kswState를 반전한다.
+     * 중간에 한 번이라도 같아지면 해당 bit의 카운터는 초기화된다.
+     */
+    delta   = raw ^ kswState;
+    kswCnt0 = ~(kswCnt0 & delta);
+    kswCnt1 = kswCnt0 ^ (kswCnt1 & delta);
+    kswCnt2 = (kswCnt0 & kswCnt1) ^ (kswCnt2 & delta);
+    changed = delta & kswCnt0 & kswCnt1 & kswCnt2;
+    kswState ^= changed;
+
+    for (i=0; changed; i++, changed >>= 1)
+    {
+        if (!(changed & 1))
+            continue;
+
+        if (kswState & (1u << i))
+        {
+            kswKeyPressed(i);
+        }
+        else
+        {
+            kswPost(i, KEY_EVT_RELEASE);
+            if (kswKey == i)
+                kswKey = 0xFF;
+        }
+    }
+
+    if (kswKey != 0xFF)
+        kswTypematic(KEYPAD_MATRIX_PERIOD_MS);
+}
+
 // ---------------- FSM -----------------
-void ScanKeySwISR(void)
+static void ScanKeySingle(void)
 {
     static KeySW_State_t State = kswILDE0;
-    uint8_t col, i;
+    uint8_t col;
 
     switch (State)
     {
@@ -69,19 +300,10 @@ void ScanKeySwISR(void)
                 State = kswScanRow1;
                 getKeySW(ROW2_MASK);
             }
-            else
+            else if (kswFindKey(col, 0))
             {
-                for (i=0; i<4; i++)
-                {
-                    if (!(col & (1<<i)))
-                    {
-                        gkswScanCode = i;
-                        gkswFlag = true;
-                        State = kswPRESSED;
-                        getKeySW(0xF0);
-                        break;
-                    }
-                }
+                State = kswPRESSED;
+                getKeySW(0xF0);
             }
             break;
 
@@ -92,19 +314,10 @@ void ScanKeySwISR(void)
                 State = kswScanRow2;
                 getKeySW(ROW3_MASK);
             }
-            else
+            else if (kswFindKey(col, 4))
             {
-                for (i=0;i<4;i++)
-                {
-                    if (!(col & (1<<i)))
-                    {
-                        gkswScanCode = i + 4;
-                        gkswFlag = true;
-                        State = kswPRESSED;
-                        getKeySW(0xF0);
-                        break;
-                    }
-                }
+                State = kswPRESSED;
+                getKeySW(0xF0);
             }
             break;
 
@@ -115,57 +328,78 @@ void ScanKeySwISR(void)
                 State = kswScanRow3;
                 getKeySW(ROW4_MASK);
             }
-            else
+            else if (kswFindKey(col, 8))
             {
-                for (i=0;i<4;i++)
-                {
-                    if (!(col & (1<<i)))
-                    {
-                        gkswScanCode = i + 8;
-                        gkswFlag = true;
-                        State = kswPRESSED;
-                        getKeySW(0xF0);
-                        break;
-                    }
-                }
+                State = kswPRESSED;
+                getKeySW(0xF0);
             }
             break;
 
         case kswScanRow3:
             col = KeySwCol;
-            if (col != 0x0F)
+            if ((col != 0x0F) && kswFindKey(col, 12))
             {
-                for (i=0;i<4;i++)
-                {
-                    if (!(col & (1<<i)))
-                    {
-                        gkswScanCode = i + 12;
-                        gkswFlag = true;
-                        break;
-                    }
-                }
+                State = kswPRESSED;
             }
             else
             {
-                gkswScanCode = 0xFF;
-                gkswFlag = true;
+                // 스캔 도중 키가 떨어짐 → 이벤트 없이 대기 상태로
+                State = kswILDE1;
             }
-            State = kswPRESSED;
             getKeySW(0xF0);
             break;
 
         case kswPRESSED:
             if ((KeySwCol & 0x0F) == 0x0F)
                 State = kswRELEASING;
+            else
+                kswTypematic(KEYPAD_SCAN_PERIOD_MS);
             getKeySW(0xF0);
             break;
 
         case kswRELEASING:
             if ((KeySwCol & 0x0F) != 0x0F)
+            {
                 State = kswPRESSED;
+            }
             else
+            {
+                kswPost(kswKey, KEY_EVT_RELEASE);
+                kswKey = 0xFF;
                 State = kswILDE1;
+            }
             getKeySW(0xF0);
             break;
     }
 }
+
+void Keypad_TickISR(void)
+{
+    kswTime += KEYPAD_TICK_MS;
+    kswTickPending = true;
+}
+
+void Keypad_Task(void)
+{
+    if (kswColsReady)
+    {
+        kswColsReady = false;
+        ScanKeyMatrix(~kswCols);
+    }
+
+    if (kswXferBusy || !kswTickPending)
+        return;
+    kswTickPending = false;
+
+    if (kswMode == KEYPAD_SCAN_MATRIX)
+    {
+        kswXferBusy = true;
+        if (!MCP23S17_ScanRowsAsync(rowOuts, kswMatrixDone))
+            kswXferBusy = false;
+    }
+    else if (++kswSingleDiv >= (KEYPAD_SCAN_PERIOD_MS / KEYPAD_TICK_MS))
+    {
+        kswSingleDiv = 0;
+        ScanKeySingle();
+    }
+}
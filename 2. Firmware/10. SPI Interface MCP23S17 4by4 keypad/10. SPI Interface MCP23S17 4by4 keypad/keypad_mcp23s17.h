@@ -4,9 +4,90 @@
 #include <stdbool.h>
 #include <stdint.h>
 
-extern volatile uint8_t KeySwCol;      // 현재 컬럼 상태 (하위 4비트)
-extern volatile uint8_t gkswScanCode;  // 0~15 키 번호, 또는 0xFF
-extern volatile bool    gkswFlag;      // 새 키 이벤트 발생 플래그
+/*
+ * #KeyEventFIFO #Typematic
+ *
+ * 키 입력은 하나의 플래그가 아니라 이벤트 FIFO로 전달된다.
+ * Keypad_Task()(Producer)만 Head를 움직이고, Keypad_GetEvent()(Consumer)만 Tail을 움직이므로
+ * 인덱스가 1byte인 AVR에서는 cli()/sei() 없이도 안전하다. (Lock-free SPSC)
+ *
+ * FIFO가 가득 차면 새 이벤트는 버리고 kswDropped를 증가시킨다.
+ * 실제 저장 가능한 이벤트 수는 KEYPAD_EVENT_FIFO_SIZE - 1 개이다.
+ *
+ * 이벤트 종류
+ *   KEY_EVT_PRESS   : 디바운싱이 끝난 눌림
+ *   KEY_EVT_HOLD    : holdMs 이상 계속 눌림 (1회)
+ *   KEY_EVT_REPEAT  : HOLD 이후 repeatMs 마다 반복 (Typematic)
+ *   KEY_EVT_RELEASE : 디바운싱이 끝난 해제
+ */
+#define KEYPAD_TICK_MS              1       // Keypad_TickISR() 호출 주기 (1kHz)
+#define KEYPAD_SCAN_PERIOD_MS       5       // SINGLE 모드 FSM 주기 (200Hz)
+#define KEYPAD_MATRIX_PERIOD_MS     1       // MATRIX 모드 스캔 주기 (1kHz)
+#define KEYPAD_EVENT_FIFO_SIZE      16      // 2^n  <= 256
+#define KEYPAD_EVENT_FIFO_MASK      (KEYPAD_EVENT_FIFO_SIZE - 1)
+
+#define KEYPAD_HOLD_MS_DEFAULT      800
+#define KEYPAD_REPEAT_MS_DEFAULT    150
+
+typedef enum {
+    KEY_EVT_PRESS,
+    KEY_EVT_RELEASE,
+    KEY_EVT_HOLD,
+    KEY_EVT_REPEAT,
+    KEY_EVT_GHOST           // MATRIX 모드: Ghost 패턴 감지 (key = 0xFF)
+} keyEventType_t;
+
+/*
+ * #FullMatrixScan #NKeyRollover #AntiGhost
+ *
+ * KEYPAD_SCAN_SINGLE : 기존 FSM. 첫 번째로 찾은 키 하나만 보고한다.
+ * KEYPAD_SCAN_MATRIX : 매 스캔마다 4개 Row를 한 번의 SPI 전송으로 모두 읽어(MCP23S17_ScanRowsAsync)
+ *                      16bit bitmap(bit n = 키 n)을 만들고, 키마다 독립적으로
+ *                      Vertical Counter(3bit, 8회 연속 일치 = 8ms)로 디바운싱한다.
+ *                      변화한 bit마다 PRESS/RELEASE 이벤트가 발생하며(N-Key Rollover),
+ *                      HOLD/REPEAT는 마지막으로 눌린 키에 대해서만 발생한다.
+ *
+ * 다이오드가 없는 매트릭스에서는 두 Row가 2개 이상의 Column을 공유하면(직사각형 패턴)
+ * 네 번째 키가 눌린 것처럼 보인다(Ghost). 이 경우 kswGhost를 세우고,
+ * Ghost가 풀릴 때까지 새로 눌린 키는 받아들이지 않는다. (해제는 정상 처리)
+ *
+ * 모드 변경은 초기화 직후(sei() 전)에 하는 것을 권장한다.
+ */
+typedef enum {
+    KEYPAD_SCAN_SINGLE,
+    KEYPAD_SCAN_MATRIX
+} keypadScanMode_t;
+
+typedef struct {
+    uint8_t  key;           // 0~15 키 번호
+    uint8_t  type;          // keyEventType_t
+    uint16_t timestamp;     // 이벤트 발생 시각 [ms] (약 65초마다 wrap)
+} keyEvent_t;
+
+extern volatile uint8_t  KeySwCol;      // 현재 컬럼 상태 (하위 4비트)
+extern volatile uint16_t kswDropped;    // FIFO Full로 버려진 이벤트 수
+extern volatile bool     kswGhost;      // 현재 Ghost 패턴 감지 중 (MATRIX 모드)
+
+/*
+ * #NonBlockingScan
+ * 타이머 ISR은 Keypad_TickISR()로 "스캔할 때가 됐다"는 플래그만 세운다.
+ * 실제 SPI 전송(MCP23S17 GPIOB Write/Read)은 main loop의 Keypad_Task()가
+ * 인터럽트 기반으로 시작만 하고, 결과는 SPI ISR에서 받아 다음 Keypad_Task()에서 처리한다.
+ * 따라서 타이머 ISR 안에서 SPI 대기나 delay가 전혀 발생하지 않는다.
+ */
+void Keypad_TickISR(void);  // 타이머 ISR에서 호출 (KEYPAD_TICK_MS 주기)
+void Keypad_Task(void);     // main loop에서 계속 호출
+
+bool    Keypad_GetEvent(keyEvent_t *evt);   // 이벤트가 없으면 false
+uint8_t Keypad_EventCount(void);
+
+/*
+ * holdMs   : 눌림 후 KEY_EVT_HOLD 까지의 시간 (0 = HOLD/REPEAT 사용 안함)
+ * repeatMs : HOLD 이후 KEY_EVT_REPEAT 간격  (0 = REPEAT 사용 안함)
+ */
+void Keypad_SetTypematic(uint16_t holdMs, uint16_t repeatMs);
+
+void     Keypad_SetScanMode(keypadScanMode_t mode);
+uint16_t Keypad_GetBitmap(void);    // 디바운싱된 키 상태 snapshot (MATRIX 모드)
 
-void ScanKeySwISR(void);   // 타이머 ISR에서 호출
 #endif /* KEYPAD_MCP23S17_H_ */
@@ -14,6 +14,13 @@
 void CLK_Init(void);
 void TCB0_Init(void);
 
+/*
+ * TCB0 ISR 종료 시점의 TCB0.CNT 최대값 [CLK_PER cycle, 0.2us]
+ * = Compare Match 이후 ISR 진입 지연 + ISR 실행 시간
+ * (ISR이 1ms(5000 cycle)를 넘기면 CNT가 한 바퀴 돌기 때문에 측정할 수 없다)
+ */
+volatile uint16_t tickIsrMax = 0;
+
 char KeyMap[16] =
 {
     '1','2','3','A',
@@ -27,29 +34,67 @@ int main(void)
     CLK_Init();
     USART0_Init(115200);
     SPI_Init();
+
+    sei();  // 인터럽트 Enable (MCP23S17 레지스터 접근은 SPI 인터럽트 완료를 기다린다)
+
     MCP23S17_Init();
+    Keypad_SetScanMode(KEYPAD_SCAN_MATRIX);    // 동시 입력(Chord) 검출
     TCB0_Init();
 
-    sei();  // 인터럽트 Enable
-
     printf("=== KEYPAD TEST START ===\r\n");
 
+    uint16_t lastDropped = 0;
+    uint16_t lastIsrMax = 0;
+
     while (1)
     {
-        if (gkswFlag)
+        keyEvent_t evt;
+
+        Keypad_Task();
+
+        while (Keypad_GetEvent(&evt))
         {
-            gkswFlag = false;
+            char key = (evt.key < 16) ? KeyMap[evt.key] : '?';
 
-            if (gkswScanCode < 16)
+            switch (evt.type)
             {
-                char key = KeyMap[gkswScanCode];
-                printf("KEY PRESSED : %c  (Code=%d)\r\n", key, gkswScanCode);
-            }
-            else
-            {
-                printf("KEY RELEASED\r\n");
+                case KEY_EVT_PRESS:
+                    printf("[%5u] KEY PRESSED  : %c  (Code=%d)\r\n", evt.timestamp, key, evt.key);
+                    break;
+                case KEY_EVT_HOLD:
+                    printf("[%5u] KEY HOLD     : %c\r\n", evt.timestamp, key);
+                    break;
+                case KEY_EVT_REPEAT:
+                    printf("[%5u] KEY REPEAT   : %c\r\n", evt.timestamp, key);
+                    break;
+                case KEY_EVT_RELEASE:
+                    printf("[%5u] KEY RELEASED : %c\r\n", evt.timestamp, key);
+                    break;
+                case KEY_EVT_GHOST:
+                    printf("[%5u] KEY GHOST    : bitmap=0x%04X\r\n", evt.timestamp, Keypad_GetBitmap());
+                    break;
             }
         }
+
+        cli();
+        uint16_t dropped = kswDropped;
+        sei();
+
+        if (dropped != lastDropped)
+        {
+            printf("KEY EVENT DROPPED : %u\r\n", dropped - lastDropped);
+            lastDropped = dropped;
+        }
+
+        cli();
+        uint16_t isrMax = tickIsrMax;
+        sei();
+
+        if (isrMax != lastIsrMax)
+        {
+            printf("TICK ISR MAX : %u cycles\r\n", isrMax);
+            lastIsrMax = isrMax;
+        }
     }
 }
 
@@ -64,7 +109,7 @@ void CLK_Init(void)
 /*
  * F_CPU = 5MHz
  * TCB0.CCMP = 5000 → 약 1kHz
- * cnt % 5 → 200Hz keypad 스캔
+ * 매 tick(1kHz)마다 keypad 스캔 요청 (플래그만 세우고 SPI 전송은 Keypad_Task()에서)
  */
 void TCB0_Init(void)
 {
@@ -75,12 +120,10 @@ void TCB0_Init(void)
 
 ISR(TCB0_INT_vect)
 {
-    static uint16_t cnt = 0;
-
-    if ((cnt++ % 5) == 0)
-    {
-        ScanKeySwISR();
-    }
+    Keypad_TickISR();
 
     TCB0.INTFLAGS = TCB_CAPT_bm;
+
+    uint16_t elapsed = TCB0.CNT;
+    if (elapsed > tickIsrMax) tickIsrMax = elapsed;
 }
\ No newline at end of file
@@ -3,10 +3,14 @@
 #include "spi.h"
 #include "mcp23s17.h"
 
-#include <util/delay.h>
-
 uint8_t spi_txrx_buf[3] = { 0 };
 
+static uint8_t         iox_async_buf[6];    // [0..2] Write 프레임, [3..5] Read 프레임
+static mcp23s17_done_t iox_async_done;
+
+static uint8_t              iox_scan_buf[24];   // Row당 [Write 3byte][Read 3byte]
+static mcp23s17_scan_done_t iox_scan_done;
+
 void MCP23S17_Init(void) 
 {
 	// 0b0011_0000
@@ -33,8 +37,9 @@ void MCP23S17_WriteReg(uint8_t reg, uint8_t data)
 	spi_txrx_buf[0] = IOX_ADR_WRITE;
 	spi_txrx_buf[1] = reg;
 	spi_txrx_buf[2] = data;
+	while (spi_info.handler == SPI_BUSY) ;
 	SPI_Block_ReadWriteStart(spi_txrx_buf, 3);
-	_delay_ms(1);
+	while (spi_info.handler == SPI_BUSY) ;
 }
 
 uint8_t MCP23S17_ReadReg(uint8_t reg)
@@ -42,12 +47,50 @@ uint8_t MCP23S17_ReadReg(uint8_t reg)
 	spi_txrx_buf[0] = IOX_ADR_READ;
 	spi_txrx_buf[1] = reg;
 	spi_txrx_buf[2] = 0xFF;
+	while (spi_info.handler == SPI_BUSY) ;
 	SPI_Block_ReadWriteStart(spi_txrx_buf, 3);
-	_delay_ms(1);
+	while (spi_info.handler == SPI_BUSY) ;
 	
 	return spi_txrx_buf[2];
 }
 
+/*
+ * Write 프레임이 끝나면 data_ptr은 이미 Read 프레임(buf[3])을 가리키고 있으므로
+ * 길이만 다시 채워 SS를 한 번 토글한 뒤 이어서 전송한다.
+ */
+static spi_operation_t MCP23S17_Async_CB(void *p)
+{
+	if (p == iox_async_buf)
+	{
+		spi_info.data_length = 3;
+		spi_info.callbackParameter = NULL;
+		return SPI_READ_WRITE;
+	}
+
+	SPI_SetDataXferCompleteCallBack(SPI_Stop_CB, NULL);
+	if (iox_async_done)
+		iox_async_done(iox_async_buf[5]);
+	return SPI_STOP;
+}
+
+bool MCP23S17_WriteReadRegAsync(uint8_t wreg, uint8_t data, uint8_t rreg, mcp23s17_done_t done)
+{
+	if (spi_info.handler == SPI_BUSY)
+		return false;
+
+	iox_async_buf[0] = IOX_ADR_WRITE;
+	iox_async_buf[1] = wreg;
+	iox_async_buf[2] = data;
+	iox_async_buf[3] = IOX_ADR_READ;
+	iox_async_buf[4] = rreg;
+	iox_async_buf[5] = 0xFF;
+	iox_async_done   = done;
+
+	SPI_SetDataXferCompleteCallBack(MCP23S17_Async_CB, iox_async_buf);
+	SPI_Block_ReadWriteStart(iox_async_buf, 3);
+	return true;
+}
+
 void MCP23S17_WriteGPIOA(uint8_t value)
 {
 	MCP23S17_WriteReg(IOX_GPIOA, value);
@@ -90,4 +133,41 @@ void MCP23S17_SetPinDirectionB(uint8_t pin, bool output)
 	dir |= (1 << pin);   // 1 = Input
 
 	MCP23S17_WriteReg(IOX_IODIRB, dir);
-}
\ No newline at end of file
+}
+
+static spi_operation_t MCP23S17_ScanRows_CB(void *p)
+{
+	uint16_t cols = 0;
+	uint8_t r;
+
+	for (r = 0; r < 4; r++)
+		cols |= (uint16_t)(iox_scan_buf[r * 6 + 5] & 0x0F) << (r * 4);
+
+	SPI_SetDataXferCompleteCallBack(SPI_Stop_CB, NULL);
+	if (iox_scan_done)
+		iox_scan_done(cols);
+	return SPI_STOP;
+}
+
+bool MCP23S17_ScanRowsAsync(const uint8_t rowOut[4], mcp23s17_scan_done_t done)
+{
+	uint8_t r, *f;
+
+	if (spi_info.handler == SPI_BUSY)
+		return false;
+
+	for (r = 0, f = iox_scan_buf; r < 4; r++, f += 6)
+	{
+		f[0] = IOX_ADR_WRITE;
+		f[1] = IOX_GPIOB;
+		f[2] = rowOut[r];
+		f[3] = IOX_ADR_READ;
+		f[4] = IOX_GPIOB;
+		f[5] = 0xFF;
+	}
+	iox_scan_done = done;
+
+	SPI_SetDataXferCompleteCallBack(MCP23S17_ScanRows_CB, NULL);
+	SPI_Block_ReadWriteFrames(iox_scan_buf, 3, 8);
+	return true;
+}
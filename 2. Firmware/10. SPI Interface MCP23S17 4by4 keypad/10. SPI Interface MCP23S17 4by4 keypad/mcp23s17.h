@@ -14,6 +14,29 @@
 
 extern uint8_t spi_txrx_buf[3];
 
+/*
+ * #NonBlocking
+ * 레지스터 Write 후 바로 Read 하는 두 프레임을 SPI 인터럽트만으로 이어서 수행한다.
+ * 호출 즉시 리턴하며, Read 결과는 SPI ISR 안에서 done(value)으로 전달된다.
+ * SPI가 사용 중이면 false를 리턴한다.
+ */
+typedef void (*mcp23s17_done_t)(uint8_t value);
+
+bool MCP23S17_WriteReadRegAsync(uint8_t wreg, uint8_t data, uint8_t rreg, mcp23s17_done_t done);
+
+/*
+ * #BatchedRowScan
+ * 4개 Row에 대해 (GPIOB Write rowOut[r] → GPIOB Read) 8개 프레임을
+ * 하나의 SPI 전송(SPI_Block_ReadWriteFrames)으로 연속 수행한다.
+ * 프레임 사이 콜백/지연이 없으므로 1.25MHz SCK 기준 약 0.2ms 안에 끝난다.
+ *
+ * 완료되면 SPI ISR에서 done(cols)가 호출된다.
+ * cols : bit[4r+3:4r] = Row r 선택 시의 GPIOB 하위 4bit (Column)
+ */
+typedef void (*mcp23s17_scan_done_t)(uint16_t cols);
+
+bool MCP23S17_ScanRowsAsync(const uint8_t rowOut[4], mcp23s17_scan_done_t done);
+
 void MCP23S17_Init(void);
 
 void MCP23S17_WriteReg(uint8_t reg, uint8_t data);
@@ -49,6 +49,7 @@ void SPI_Init(void)
     /* 구조체 초기화 */
     spi_info.data_ptr    = NULL;
     spi_info.data_length = 0;
+    spi_info.frame_count = 0;
     spi_info.handler     = SPI_FREE;
     SPI_SetDataXferCompleteCallBack(SPI_Stop_CB, NULL);   // 기본 콜백 설정
 
@@ -88,6 +89,7 @@ void SPI_Block_ReadWriteStart(uint8_t *buffer, uint8_t length)
 
     spi_info.data_ptr    = buffer;
     spi_info.data_length = length;
+    spi_info.frame_count = 1;
     spi_info.handler     = SPI_BUSY;
 
     // 첫 바이트 전송 시작
@@ -95,6 +97,24 @@ void SPI_Block_ReadWriteStart(uint8_t *buffer, uint8_t length)
     SPI0.DATA = *spi_info.data_ptr;
 }
 
+void SPI_Block_ReadWriteFrames(uint8_t *buffer, uint8_t frameLength, uint8_t frameCount)
+{
+    if ((buffer == NULL) || (frameLength == 0) || (frameCount == 0))
+        return;
+
+    if (spi_info.handler == SPI_BUSY)
+        return;
+
+    spi_info.data_ptr     = buffer;
+    spi_info.data_length  = frameLength;
+    spi_info.frame_length = frameLength;
+    spi_info.frame_count  = frameCount;
+    spi_info.handler      = SPI_BUSY;
+
+    SS_LOW;
+    SPI0.DATA = *spi_info.data_ptr;
+}
+
 /* -------------------- 인터럽트 서비스 루틴 -------------------- */
 
 ISR(SPI0_INT_vect)
@@ -120,6 +140,15 @@ ISR(SPI0_INT_vect)
         // 아직 남은 바이트가 있으면 다음 바이트 전송
         SPI0.DATA = *spi_info.data_ptr;
     }
+    else if (spi_info.frame_count > 1)
+    {
+        // 다음 프레임: SS만 토글하고 콜백 없이 계속 전송
+        spi_info.frame_count--;
+        spi_info.data_length = spi_info.frame_length;
+        SS_HIGH;
+        SS_LOW;
+        SPI0.DATA = *spi_info.data_ptr;
+    }
     else
     {
         // 모든 바이트 전송 완료
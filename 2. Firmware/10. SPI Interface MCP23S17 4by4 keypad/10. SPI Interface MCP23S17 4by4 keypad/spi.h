@@ -40,6 +40,9 @@ typedef struct
     uint8_t  *data_ptr;       // 현재 TX/RX 위치를 가리키는 포인터
     uint8_t   data_length;    // 남은 바이트 수
 
+    uint8_t   frame_length;   // 프레임 하나의 바이트 수 (SPI_Block_ReadWriteFrames)
+    uint8_t   frame_count;    // 현재 프레임을 포함해 남은 프레임 수
+
     volatile spi_handler_t handler;
 
     spi_callback_t callbackDataXferComplete;
@@ -65,6 +68,17 @@ void SPI_SetDataXferCompleteCallBack(spi_callback_t cb, void *p);
  */
 void SPI_Block_ReadWriteStart(uint8_t *buffer, uint8_t length);
 
+/*
+ * SPI_Block_ReadWriteFrames
+ * - buffer 안에 frameLength 바이트짜리 프레임 frameCount 개가 연속으로 들어 있다.
+ * - 프레임 사이에서는 ISR이 SS를 HIGH → LOW로 토글만 하고 바로 다음 프레임을 보낸다.
+ *   (콜백은 마지막 프레임이 끝난 뒤 한 번만 호출된다)
+ *
+ * 사용 예) MCP23S17 GPIOB Write/Read 를 4번 반복하는 24byte 스캔
+ * SPI_Block_ReadWriteFrames(buf, 3, 8);
+ */
+void SPI_Block_ReadWriteFrames(uint8_t *buffer, uint8_t frameLength, uint8_t frameCount);
+
 /* 기본 콜백들(원하면 외부에서 사용해도 됨) */
 spi_operation_t SPI_Stop_CB(void *p);
 spi_operation_t SPI_ReadStop_CB(void *p);
@@ -4,22 +4,57 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <util/delay.h>
+#include <util/crc16.h>
 #include "i2c.h"
 #include "d24fc512.h"
 
-void D24FC512_Write_Address_Uint8(uint16_t address, uint8_t data)
+/*
+ * #AckPolling
+ *
+ * Write Cycle 동안 EEPROM은 자기 주소에 NACK한다.
+ * 주소만 보내는 Write(START, SLA+W, STOP)를 ACK가 올 때까지 반복하면
+ * 실제 Write Cycle이 끝나는 즉시 다음 동작을 할 수 있다. (최악 5ms를 항상 기다리지 않는다)
+ */
+static volatile i2c_address_t d24fc512_last_chip = D24FC512_SLAVE_ADDRESS;	// 마지막으로 Write한 칩
+
+static void D24FC512_Poll_Prepare(i2c_xfer_t *xfer, i2c_address_t chip)
+{
+	I2C_Xfer_Segments(xfer, chip, NULL, 0);
+	xfer->priority = D24FC512_I2C_PRIORITY;
+	xfer->flags = I2C_XFER_NORETRY | I2C_XFER_NOSTATS;	// Busy NACK는 에러가 아니다.
+}
+
+bool D24FC512_WaitReady(void)
+{
+	i2c_xfer_t xfer;
+	uint16_t polls;
+	
+	for (polls = 0; polls < D24FC512_BUSY_POLL_MAX; polls++)
+	{
+		D24FC512_Poll_Prepare(&xfer, d24fc512_last_chip);
+		if (I2C_Transfer(&xfer) == I2C_NOERROR)
+			return true;
+	}
+	return false;
+}
+
+void D24FC512_Write_Address_Uint8(uint32_t address, uint8_t data)
 {
-	I2C_Write_Address_Uint8(D24FC512_SLAVE_ADDRESS,address,data);
+	d24fc512_last_chip = D24FC512_CHIP_ADDRESS(address);
+	I2C_Write_Address_Uint8(d24fc512_last_chip,D24FC512_WORD_ADDRESS(address),data);
+	D24FC512_WaitReady();
 }
 
-void D24FC512_Write_Address_Uint16(uint16_t address, uint16_t data)
+void D24FC512_Write_Address_Uint16(uint32_t address, uint16_t data)
 {
-	I2C_Write_Address_Uint16(D24FC512_SLAVE_ADDRESS,address,data);
+	// Page/칩 경계에 걸칠 수 있으므로 AnyBlock으로 나누어 쓴다.
+	EEPROM_WriteAnyBlock(address, (uint8_t *)&data, 2);
 }
 
-void D24FC512_Write_Address_Page(uint16_t address, uint8_t *buffer, uint8_t length)
+bool D24FC512_Write_Address_Page(uint32_t address, uint8_t *buffer, uint8_t length)
 {
-    uint16_t pageStart, pageNext;
+    uint32_t pageStart, pageNext;
+    i2c_xfer_t xfer;
 
     /*
      * pageStart :
@@ -28,10 +63,10 @@ void D24FC512_Write_Address_Page(uint16_t address, uint8_t *buffer, uint8_t leng
      *
      *  address & ~(PAGE_NO - 1)
      *  = address & ~(128 - 1)
-     *  = address & 0xFF80
+     *  = address & 0xFFFFFF80
      *  즉, 아래 7bit를 모두 0으로 만들어 Page 시작 주소 계산
      */
-    pageStart = address & ~(PAGE_NO - 1);
+    pageStart = address & ~(uint32_t)(PAGE_NO - 1);
 
     /*
      * pageNext :
@@ -49,20 +84,22 @@ void D24FC512_Write_Address_Page(uint16_t address, uint8_t *buffer, uint8_t leng
      * 가능하면 그대로 전체 길이를 저장하고,
      * 불가능하면 Page 경계까지의 범위만 저장한다.
      */
-    if ((address + length) <= pageNext) {
-        I2C_Write_Address_Block((i2c_address_t)D24FC512_SLAVE_ADDRESS, address, buffer, (uint16_t)length);
-    }
-    else {
+    if ((address + length) > pageNext) {
         /* Page 경계를 넘기 때문에 pageNext - address 만큼만 저장 */
-        I2C_Write_Address_Block((i2c_address_t)D24FC512_SLAVE_ADDRESS, address, buffer, pageNext - address);
+        length = (uint8_t)(pageNext - address);
     }
+    d24fc512_last_chip = D24FC512_CHIP_ADDRESS(address);
+    I2C_Xfer_Prepare(&xfer, d24fc512_last_chip, D24FC512_WORD_ADDRESS(address), 2, buffer, (uint16_t)length, I2C_XFER_WRITE);
+    if (I2C_Transfer(&xfer) != I2C_NOERROR)
+        return false;
 
     /*
-     * EEPROM은 내부 Write Cycle이 있으며 5~10ms가 필요하다.
+     * EEPROM은 내부 Write Cycle이 있으며 최대 5ms가 필요하다.
      * 이 시간 동안 Busy 상태이기 때문에 다음 Write를 바로 하면 실패한다.
-     * 따라서 반드시 delay를 걸어 Write Cycle이 완료되도록 한다.
+     * 고정 delay 대신 ACK Polling으로 Write Cycle이 끝나는 시점을 바로 확인한다.
+     * (끝까지 ACK가 없으면 기록되었는지 알 수 없으므로 실패로 본다)
      */
-    _delay_ms(5);
+    return D24FC512_WaitReady();
 }
 
 /*
@@ -98,18 +135,19 @@ void D24FC512_Write_Address_Page(uint16_t address, uint8_t *buffer, uint8_t leng
  *
  * callback) PageWrite와 BlockWrite 차이를 다시 복습하자.
  */
-void EEPROM_WriteAnyBlock(uint16_t address, uint8_t *buffer, uint16_t length)
+bool EEPROM_WriteAnyBlock(uint32_t address, uint8_t *buffer, uint16_t length)
 {
-    uint16_t pageStart, pageNext, first_siz, block_no;
+    uint32_t pageStart, pageNext;
+    uint16_t first_siz, block_no;
 
     /*
      * pageStart = 현재 주소의 Page 시작 주소
      * pageNext  = 다음 Page의 시작 주소
      * first_siz = 현재 Page에서 남아있는 빈 공간
      */
-    pageStart = address & ~(PAGE_NO - 1);
+    pageStart = address & ~(uint32_t)(PAGE_NO - 1);
     pageNext = pageStart + PAGE_NO;
-    first_siz = pageNext - address;
+    first_siz = (uint16_t)(pageNext - address);
 
     /*
      * length > first_siz
@@ -119,7 +157,8 @@ void EEPROM_WriteAnyBlock(uint16_t address, uint8_t *buffer, uint16_t length)
     if (length > first_siz)
     {
         /* 첫 Page에 넣을 수 있는 만큼만 기록 */
-        D24FC512_Write_Address_Page(address, buffer, (uint8_t)first_siz);
+        if (!D24FC512_Write_Address_Page(address, buffer, (uint8_t)first_siz))
+            return false;
 
         /* Page 넘어갈 준비 */
         length -= first_siz;
@@ -135,7 +174,8 @@ void EEPROM_WriteAnyBlock(uint16_t address, uint8_t *buffer, uint16_t length)
         /* 중간의 완전한 Page 블록들을 반복 저장 */
         if (block_no) {
             for (uint16_t i = 0; i < block_no; i++) {
-                D24FC512_Write_Address_Page(address, buffer, (uint8_t)PAGE_NO);
+                if (!D24FC512_Write_Address_Page(address, buffer, (uint8_t)PAGE_NO))
+                    return false;
 
                 length -= PAGE_NO;
                 buffer += PAGE_NO;
@@ -147,25 +187,320 @@ void EEPROM_WriteAnyBlock(uint16_t address, uint8_t *buffer, uint16_t length)
          * 마지막 Page에 남은 length가 있다면 저장
          */
         if (length) {
-            D24FC512_Write_Address_Page(address, buffer, (uint8_t)length);
+            return D24FC512_Write_Address_Page(address, buffer, (uint8_t)length);
         }
+        return true;
     }
     else {
         /* length가 첫 Page 안에서 끝나는 경우 */
-        D24FC512_Write_Address_Page(address, buffer, (uint8_t)length);
+        return D24FC512_Write_Address_Page(address, buffer, (uint8_t)length);
+    }
+}
+
+bool EEPROM_UpdateAnyBlock(uint32_t address, const uint8_t *buffer, uint16_t length, uint16_t *writes)
+{
+    uint8_t  current[PAGE_NO];
+    uint16_t n, first, last, count = 0;
+    bool ok = true;
+
+    while (length)
+    {
+        /* 이번 Page에 해당하는 구간 */
+        n = PAGE_NO - (uint16_t)(address & (PAGE_NO - 1));
+        if (n > length)
+            n = length;
+
+        if (D24FC512_Read_Address_Block(address, current, n))
+        {
+            /* 처음과 마지막으로 다른 byte를 찾는다. */
+            for (first = 0; first < n && current[first] == buffer[first]; first++);
+            last = n - 1;
+            if (first < n)
+                for (; current[last] == buffer[last]; last--);
+        }
+        else
+        {
+            /* 비교할 내용을 믿을 수 없으므로 이번 구간 전체를 쓴다. */
+            first = 0;
+            last = n - 1;
+        }
+
+        if (first < n)
+        {
+            if (!D24FC512_Write_Address_Page(address + first, (uint8_t *)&buffer[first], (uint8_t)(last - first + 1)))
+            {
+                ok = false;
+                break;
+            }
+            count++;
+        }
+
+        address += n;
+        buffer += n;
+        length -= n;
     }
+
+    if (writes)
+        *writes = count;
+    return ok;
+}
+
+//////////////////////////////////////////////////////////////////////////
+uint8_t D24FC512_Read_Address_Uint8(uint32_t address)
+{
+	return I2C_Read_Address_Uint8(D24FC512_CHIP_ADDRESS(address), D24FC512_WORD_ADDRESS(address));
+}
+uint16_t D24FC512_Read_Address_Uint16(uint32_t address)
+{
+	uint16_t data = 0;
+	
+	D24FC512_Read_Address_Block(address, (uint8_t *)&data, 2);
+	return data;
+}
+bool D24FC512_Read_Address_Block(uint32_t address, uint8_t *buffer, uint16_t length)
+{
+	i2c_xfer_t xfer;
+	uint32_t chipLeft;
+	uint16_t n;
+	
+	// Sequential Read는 칩 끝에서 같은 칩의 0x0000으로 돌아가므로 칩 경계에서 나눈다.
+	while (length)
+	{
+		chipLeft = D24FC512_CHIP_SIZE - D24FC512_WORD_ADDRESS(address);
+		n = (length > chipLeft) ? (uint16_t)chipLeft : length;
+		
+		I2C_Xfer_Prepare(&xfer, D24FC512_CHIP_ADDRESS(address), D24FC512_WORD_ADDRESS(address), 2, buffer, n, I2C_XFER_READ);
+		if (I2C_Transfer(&xfer) != I2C_NOERROR)
+			return false;
+		address += n;
+		buffer += n;
+		length -= n;
+	}
+	return true;
 }
 
 //////////////////////////////////////////////////////////////////////////
-uint8_t D24FC512_Read_Address_Uint8(uint16_t address)
+static void D24FC512_Op_Submit(d24fc512_op_t *op);
+static void D24FC512_Op_CB(i2c_xfer_t *xfer);
+
+static void D24FC512_Op_Done(d24fc512_op_t *op, i2c_error_t status)
 {
-	return I2C_Read_Address_Uint8(D24FC512_SLAVE_ADDRESS, address);
+	op->status = status;
+	if (op->callback)
+		op->callback(op);
 }
-uint16_t D24FC512_Read_Address_Uint16(uint16_t address)
+
+static void D24FC512_Op_Poll(d24fc512_op_t *op, i2c_address_t chip)
 {
-	return I2C_Read_Address_Uint16(D24FC512_SLAVE_ADDRESS, address);
+	op->phase = D24FC512_PHASE_POLL;
+	D24FC512_Poll_Prepare(&op->xfer, chip);
+	op->xfer.callback = D24FC512_Op_CB;
+	op->xfer.context = op;
+	I2C_Submit(&op->xfer);
 }
-void D24FC512_Read_Address_Block(uint16_t address, uint8_t *buffer, uint16_t length)
+
+/*
+ * TWI ISR 문맥에서 호출된다.
+ *   DATA : 성공 → Write면 ACK Polling, Read면 다음 chunk
+ *          실패 → 아직 Write Cycle 중일 수 있으므로 ACK Polling 후 같은 chunk 재시도
+ *   POLL : ACK → 다음(또는 같은) chunk / 완료
+ *          NACK → 다시 Poll (D24FC512_BUSY_POLL_MAX까지)
+ */
+static void D24FC512_Op_CB(i2c_xfer_t *xfer)
 {
-	I2C_Read_Address_Block(D24FC512_SLAVE_ADDRESS, address, buffer, length);
-}
\ No newline at end of file
+	d24fc512_op_t *op = (d24fc512_op_t *)xfer->context;
+	
+	if (op->phase == D24FC512_PHASE_POLL)
+	{
+		if (xfer->status != I2C_NOERROR)
+		{
+			if (++op->polls < D24FC512_BUSY_POLL_MAX)
+				I2C_Submit(xfer);
+			else
+				D24FC512_Op_Done(op, I2C_ERROR);
+			return;
+		}
+		
+		op->polls = 0;
+		if (op->length)
+			D24FC512_Op_Submit(op);
+		else
+			D24FC512_Op_Done(op, I2C_NOERROR);
+		return;
+	}
+	
+	if (xfer->status != I2C_NOERROR)
+	{
+		if (++op->retries < D24FC512_DATA_RETRY)
+			D24FC512_Op_Poll(op, xfer->address);
+		else
+			D24FC512_Op_Done(op, I2C_ERROR);
+		return;
+	}
+	
+	op->retries = 0;
+	op->address += op->chunk;
+	op->buffer += op->chunk;
+	op->length -= op->chunk;
+	
+	if (op->direction == I2C_XFER_WRITE)
+		D24FC512_Op_Poll(op, xfer->address);	// 방금 쓴 칩 (address는 이미 다음 칩일 수 있다)
+	else if (op->length)
+		D24FC512_Op_Submit(op);
+	else
+		D24FC512_Op_Done(op, I2C_NOERROR);
+}
+
+static void D24FC512_Op_Submit(d24fc512_op_t *op)
+{
+	uint16_t pageLeft = PAGE_NO - (op->address & (PAGE_NO - 1));
+	
+	op->phase = D24FC512_PHASE_DATA;
+	op->chunk = op->length;
+	if (op->chunk > pageLeft)
+		op->chunk = pageLeft;
+	if (op->chunk > D24FC512_XFER_MAX)
+		op->chunk = D24FC512_XFER_MAX;
+	
+	// Page는 칩 경계를 넘지 않으므로 chunk 하나는 항상 한 칩 안에 있다.
+	if (op->direction == I2C_XFER_WRITE)
+		d24fc512_last_chip = D24FC512_CHIP_ADDRESS(op->address);
+	I2C_Xfer_Prepare(&op->xfer, D24FC512_CHIP_ADDRESS(op->address), D24FC512_WORD_ADDRESS(op->address), 2,
+	                 op->buffer, op->chunk, (i2c_xfer_dir_t)op->direction);
+	op->xfer.priority = D24FC512_I2C_PRIORITY;
+	op->xfer.flags = I2C_XFER_NORETRY;		// 재시도는 ACK Polling 후 직접 한다.
+	op->xfer.callback = D24FC512_Op_CB;
+	op->xfer.context = op;
+	I2C_Submit(&op->xfer);
+}
+
+static void D24FC512_Op_Init(d24fc512_op_t *op, uint32_t address, uint8_t *buffer, uint16_t length,
+                             i2c_xfer_dir_t direction, d24fc512_op_callback_t cb)
+{
+	op->address = address;
+	op->buffer = buffer;
+	op->length = length;
+	op->direction = (uint8_t)direction;
+	op->polls = 0;
+	op->retries = 0;
+	op->callback = cb;
+	op->status = I2C_BUSY;
+}
+
+bool D24FC512_Read_Address_Block_Async(d24fc512_op_t *op, uint32_t address, uint8_t *buffer, uint16_t length,
+                                       d24fc512_op_callback_t cb)
+{
+	if (length == 0)
+		return false;
+	
+	D24FC512_Op_Init(op, address, buffer, length, I2C_XFER_READ, cb);
+	D24FC512_Op_Submit(op);
+	return true;
+}
+
+bool D24FC512_Write_Address_Block_Async(d24fc512_op_t *op, uint32_t address, uint8_t *buffer, uint16_t length,
+                                        d24fc512_op_callback_t cb)
+{
+	if (length == 0)
+		return false;
+	
+	D24FC512_Op_Init(op, address, buffer, length, I2C_XFER_WRITE, cb);
+	D24FC512_Op_Submit(op);
+	return true;
+}
+
+bool D24FC512_WaitReady_Async(d24fc512_op_t *op, d24fc512_op_callback_t cb)
+{
+	D24FC512_Op_Init(op, 0, NULL, 0, I2C_XFER_WRITE, cb);
+	D24FC512_Op_Poll(op, d24fc512_last_chip);
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+static void D24FC512_Stream_Kick(d24fc512_stream_t *s);
+
+// TWI ISR 문맥에서 호출된다.
+static void D24FC512_Stream_CB(i2c_xfer_t *xfer)
+{
+	d24fc512_stream_t *s = (d24fc512_stream_t *)xfer->context;
+	
+	s->busy = false;
+	if (xfer->status != I2C_NOERROR)
+	{
+		s->error = true;
+		return;
+	}
+	
+	s->ready[s->fill] = xfer->seg[1].length;
+	s->fill ^= 1;
+	D24FC512_Stream_Kick(s);		// 다른 버퍼가 비어 있으면 바로 이어서 채운다.
+}
+
+// 인터럽트가 꺼진 상태에서 호출한다.
+static void D24FC512_Stream_Kick(d24fc512_stream_t *s)
+{
+	uint32_t n;
+	
+	if (s->busy || s->error || s->next >= s->end || s->ready[s->fill])
+		return;
+	
+	n = s->end - s->next;
+	if (n > D24FC512_STREAM_BUF_SIZE)
+		n = D24FC512_STREAM_BUF_SIZE;
+	if (n > D24FC512_CHIP_SIZE - D24FC512_WORD_ADDRESS(s->next))
+		n = D24FC512_CHIP_SIZE - D24FC512_WORD_ADDRESS(s->next);	// 칩 경계에서 끊는다.
+	
+	I2C_Xfer_Prepare(&s->xfer, D24FC512_CHIP_ADDRESS(s->next), D24FC512_WORD_ADDRESS(s->next), 2,
+	                 s->buf[s->fill], (uint16_t)n, I2C_XFER_READ);
+	s->xfer.priority = D24FC512_I2C_PRIORITY;
+	s->xfer.callback = D24FC512_Stream_CB;
+	s->xfer.context = s;
+	
+	s->next += n;
+	s->busy = true;
+	I2C_Submit(&s->xfer);
+}
+
+void D24FC512_Stream_Open(d24fc512_stream_t *s, uint32_t address, uint32_t length)
+{
+	s->next = address;
+	s->end = address + length;
+	if (s->end > D24FC512_CAPACITY)
+		s->end = D24FC512_CAPACITY;
+	s->ready[0] = s->ready[1] = 0;
+	s->fill = s->take = 0;
+	s->busy = false;
+	s->error = false;
+	
+	cli();
+	D24FC512_Stream_Kick(s);
+	sei();
+}
+
+uint16_t D24FC512_Stream_Get(d24fc512_stream_t *s, const uint8_t **data)
+{
+	*data = s->buf[s->take];
+	return s->ready[s->take];
+}
+
+void D24FC512_Stream_Release(d24fc512_stream_t *s)
+{
+	cli();
+	s->ready[s->take] = 0;
+	s->take ^= 1;
+	D24FC512_Stream_Kick(s);
+	sei();
+}
+
+bool D24FC512_Stream_Done(d24fc512_stream_t *s)
+{
+	return s->error || (s->next >= s->end && !s->busy && !s->ready[0] && !s->ready[1]);
+}
+
+//////////////////////////////////////////////////////////////////////////
+uint16_t D24FC512_Crc16(uint16_t crc, const uint8_t *data, uint16_t length)
+{
+	while (length--)
+		crc = _crc_xmodem_update(crc, *data++);
+	return crc;
+}
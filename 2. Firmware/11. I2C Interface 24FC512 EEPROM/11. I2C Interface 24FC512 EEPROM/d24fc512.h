@@ -22,13 +22,47 @@
 #define D24FC512_SLAVE_ADDRESS   0x50
 /*
  * EEPROM의 I2C 기본 Slave Address.
- * 상위 주소 비트(A16~A8)는 Device Address LSB 3비트에 매핑된다.
+ * 24FC512는 Word Address가 2byte(A15~A0)라 64KB 전체를 Word Address만으로 접근한다.
+ * Device Address LSB 3비트는 메모리 주소가 아니라 칩의 A2/A1/A0 핀 상태이며,
+ * 같은 버스에 칩을 최대 8개(0x50 ~ 0x57)까지 연결할 때 서로를 구분하는 데 쓴다.
+ */
+
+#define D24FC512_CHIP_COUNT      1
+#define D24FC512_CHIP_SIZE       0x10000UL
+#define D24FC512_CAPACITY        ((uint32_t)D24FC512_CHIP_COUNT * D24FC512_CHIP_SIZE)
+/*
+ * #MultiChip #LinearAddress
+ *
+ * A2~A0 핀을 0, 1, 2 ... 로 묶은 칩 D24FC512_CHIP_COUNT개를 하나의 32bit 주소 공간으로 본다.
+ * (1 ~ 8개, 최대 512KB)
  *
- * 예시)
- * 실제 접근 주소가 0x1234 라면,
- * Device Address = 0x50 | ((address >> 8) & 0x07)
- * Word Address   = address & 0xFF
+ *   주소 0x00000 ~ 0x0FFFF → 0x50
+ *   주소 0x10000 ~ 0x1FFFF → 0x51 (이 보드에서는 PCF8563과 겹친다, 아래 주의 참고)
+ *   ...
+ *   Device Address = 0x50 | (address >> 16)
+ *   Word Address   = address & 0xFFFF
+ *
+ * Page(128byte)는 칩 경계를 넘지 않으므로 Page 분할은 그대로 칩 분할이 된다.
+ * Sequential Read는 칩 끝(0xFFFF)에서 같은 칩의 0x0000으로 돌아가므로
+ * Block Read / Stream / Async Read는 칩 경계에서 트랜잭션을 나눈다.
+ * 그래서 아래 함수들은 칩 개수와 관계없이 똑같이 사용한다.
+ *
+ * 주의) 이 보드의 I2C 버스에는 PCF8563 RTC가 0x51에 있다. (Slave Address를 바꿀 수 없는 칩)
+ *       두 번째 칩(A0 = 1)이 같은 주소가 되므로 이 보드에서는 칩을 하나만 쓸 수 있다.
+ *       RTC를 뺀 보드에서 칩을 늘리려면 D24FC512_RESERVED_ADDRESS를 0으로 바꾼다.
+ *       (아래 검사가 주소가 겹치는 설정을 컴파일 단계에서 막는다)
  */
+#define D24FC512_CHIP_ADDRESS(a) ((i2c_address_t)(D24FC512_SLAVE_ADDRESS | (uint8_t)((a) >> 16)))
+#define D24FC512_WORD_ADDRESS(a) ((uint16_t)(a))
+
+#define D24FC512_RESERVED_ADDRESS 0x51   // 같은 버스의 다른 Slave (PCF8563), 없으면 0
+
+#if D24FC512_CHIP_COUNT < 1 || D24FC512_CHIP_COUNT > 8
+#error "D24FC512_CHIP_COUNT는 1 ~ 8이어야 한다."
+#endif
+#if D24FC512_RESERVED_ADDRESS >= D24FC512_SLAVE_ADDRESS && D24FC512_RESERVED_ADDRESS < D24FC512_SLAVE_ADDRESS + D24FC512_CHIP_COUNT
+#error "24FC512 칩 주소가 D24FC512_RESERVED_ADDRESS(PCF8563 0x51)와 겹친다. D24FC512_CHIP_COUNT를 줄인다."
+#endif
 
 #define PAGE_NO                  128
 /*
@@ -62,13 +96,13 @@
  * Page 관계 없이 어느 위치에나 저장 가능하지만,
  * Write Cycle(5~10ms)이 발생하므로 연속 기록 시 속도가 느릴 수 있다.
  */
-void D24FC512_Write_Address_Uint8(uint16_t address, uint8_t data);
+void D24FC512_Write_Address_Uint8(uint32_t address, uint8_t data);
 
 /*
  * #ByteRead
  * 지정된 EEPROM 주소에서 1byte를 읽어온다.
  */
-uint8_t D24FC512_Read_Address_Uint8(uint16_t address);
+uint8_t D24FC512_Read_Address_Uint8(uint32_t address);
 
 
 /* ======================================================================
@@ -79,17 +113,17 @@ uint8_t D24FC512_Read_Address_Uint8(uint16_t address);
  * #Uint16Write
  *
  * 16bit 값을 2byte로 나누어 address, address+1 에 연속으로 기록한다.
- * 내부적으로 Byte Write를 2회 수행하거나, Page 내부라면 Page Write로 구현될 수 있다.
+ * 내부적으로 EEPROM_WriteAnyBlock()을 사용하므로 Page/칩 경계에 걸쳐도 된다.
  * 구조체 저장의 기본 단위로도 사용된다.
  */
-void D24FC512_Write_Address_Uint16(uint16_t address, uint16_t data);
+void D24FC512_Write_Address_Uint16(uint32_t address, uint16_t data);
 
 /*
  * #Uint16Read
  *
  * 16bit 값(2byte)을 연속해서 읽어 하나의 uint16_t 값으로 반환한다.
  */
-uint16_t D24FC512_Read_Address_Uint16(uint16_t address);
+uint16_t D24FC512_Read_Address_Uint16(uint32_t address);
 
 
 /* ======================================================================
@@ -113,8 +147,11 @@ uint16_t D24FC512_Read_Address_Uint16(uint16_t address);
  * Page 경계를 넘지 않는 작은 버퍼 저장 시에만 사용한다.
  *
  * callback) EEPROM_WriteAnyBlock()으로 Page 경계 문제를 해결할 수 있다.
+ *
+ * 리턴값 : 전송이 실패했거나 Write Cycle 뒤에도 ACK가 없으면 false.
+ *          (기록 여부를 믿을 수 없다. Record Log처럼 결과가 중요한 곳에서 확인한다)
  */
-void D24FC512_Write_Address_Page(uint16_t address, uint8_t *buffer, uint8_t length);
+bool D24FC512_Write_Address_Page(uint32_t address, uint8_t *buffer, uint8_t length);
 
 
 /*
@@ -131,8 +168,28 @@ void D24FC512_Write_Address_Page(uint16_t address, uint8_t *buffer, uint8_t leng
  *
  * 즉, 개발자가 Page 구조를 의식할 필요 없이 아무 데이터나 저장할 수 있게 해준다.
  * 실제 프로젝트에서는 대부분 이 함수를 사용한다.
+ *
+ * 리턴값 : Page Write 하나라도 실패하면 거기서 멈추고 false. (앞의 Page들은 이미 기록되었다)
+ */
+bool EEPROM_WriteAnyBlock(uint32_t address, uint8_t *buffer, uint16_t length);
+
+/*
+ * #UpdateBlock #CompareBeforeWrite
+ *
+ * EEPROM_WriteAnyBlock()과 같지만, Page마다 먼저 EEPROM 내용을 읽어 RAM에서 비교한다.
+ * (avr-libc eeprom_update_block()과 같은 개념)
+ *
+ *   - 내용이 같은 Page는 건너뛴다. (Write Cycle 없음)
+ *   - 일부만 다르면 처음 ~ 마지막으로 다른 byte 구간만 Page Write 한 번으로 쓴다.
+ *
+ * Read는 Page당 수백 us, Write Cycle은 최대 5ms이므로 대부분 같은 데이터를
+ * 주기적으로 다시 저장하는 경우(설정값 전체 저장 등) 시간과 Cell 수명을 모두 아낀다.
+ *
+ *   - 비교용 Read가 실패한 구간은 건너뛰지 않고 전체를 쓴다.
+ *   - Page Write가 실패하면 거기서 멈추고 false를 돌려준다.
+ * writes가 NULL이 아니면 실제로 수행한 Page Write 횟수를 넣는다. (0이면 이미 같은 내용)
  */
-void EEPROM_WriteAnyBlock(uint16_t address, uint8_t *buffer, uint16_t length);
+bool EEPROM_UpdateAnyBlock(uint32_t address, const uint8_t *buffer, uint16_t length, uint16_t *writes);
 
 
 /* ======================================================================
@@ -143,12 +200,151 @@ void EEPROM_WriteAnyBlock(uint16_t address, uint8_t *buffer, uint16_t length);
  * #BlockRead
  *
  * EEPROM의 특정 주소부터 length 바이트만큼 연속 읽기.
- * 읽기는 Page 경계와 관계없이 수행 가능하므로 사용이 간단하다.
+ * 읽기는 Page 경계와 관계없이 수행 가능하므로 사용이 간단하다. (칩 경계에서만 트랜잭션을 나눈다)
  *
  * 예)
  * 구조체 저장 시 sizeof(struct) 만큼 블록 전체를 읽어올 때 사용.
+ * Bus 에러로 읽지 못하면 false. (buffer 내용은 믿을 수 없다)
+ */
+bool D24FC512_Read_Address_Block(uint32_t address, uint8_t *buffer, uint16_t length);
+
+/* ======================================================================
+   5. Non-Blocking Block Read/Write
+   ====================================================================== */
+
+/*
+ * #NonBlocking #Priority #Chunk
+ *
+ * EEPROM은 I2C_PRIO_LOW로 큐에 들어가며, 한 번의 트랜잭션은 Page 경계와
+ * D24FC512_XFER_MAX 중 먼저 닿는 곳에서 끊는다. 한 chunk가 끝나면 ISR에서 다음 chunk를
+ * 다시 Submit하므로, 그 사이에 들어온 RTC/센서 Read(I2C_PRIO_HIGH)가 먼저 처리된다.
+ * 즉 다른 Client의 최대 대기 시간은 chunk 하나의 전송 시간이다. (100kHz, 128byte 약 12ms)
+ *
+ * Write chunk 뒤에는 주소만 보내는 ACK Polling을 같은 priority로 큐에 넣어 Write Cycle이 끝나기를
+ * 기다린다. 이 동안 CPU와 다른 Client는 자유롭다. 완료 callback이 불리면 데이터는 이미 기록된 상태이다.
+ * 실패한 chunk는 ACK Polling 후 D24FC512_DATA_RETRY번까지 다시 보낸다.
+ */
+#define D24FC512_I2C_PRIORITY    I2C_PRIO_LOW
+#define D24FC512_XFER_MAX        PAGE_NO
+#define D24FC512_BUSY_POLL_MAX   500     // ACK Polling 최대 횟수 (1회 약 0.1ms@100kHz, 400kHz에서도 5ms 이상)
+#define D24FC512_DATA_RETRY      3
+
+#define D24FC512_PHASE_DATA      0
+#define D24FC512_PHASE_POLL      1
+
+typedef struct d24fc512_op d24fc512_op_t;
+typedef void (*d24fc512_op_callback_t)(d24fc512_op_t *op);
+
+struct d24fc512_op
+{
+    i2c_xfer_t xfer;
+    
+    uint32_t address;                   // 다음 chunk의 EEPROM 주소
+    uint8_t *buffer;
+    uint16_t length;                    // 남은 길이
+    uint16_t chunk;                     // 진행 중인 chunk 길이
+    uint8_t direction;                  // i2c_xfer_dir_t
+    uint8_t phase;                      // D24FC512_PHASE_xxx
+    uint16_t polls;
+    uint8_t retries;
+    
+    volatile i2c_error_t status;        // I2C_BUSY → I2C_NOERROR / I2C_ERROR
+    d24fc512_op_callback_t callback;    // NULL 가능, ISR 문맥에서 호출
+    void *context;
+};
+
+/*
+ * 전송을 시작하고 바로 리턴한다. op와 buffer는 완료될 때까지 유지되어야 한다.
+ *
+ * 예)
+ * static d24fc512_op_t op;
+ * D24FC512_Read_Address_Block_Async(&op, 0x0100, buf, 512, NULL);
+ * ... super-loop 계속 ...
+ * if (op.status != I2C_BUSY) { 사용 }
+ */
+bool D24FC512_Read_Address_Block_Async(d24fc512_op_t *op, uint32_t address, uint8_t *buffer, uint16_t length,
+                                       d24fc512_op_callback_t cb);
+bool D24FC512_Write_Address_Block_Async(d24fc512_op_t *op, uint32_t address, uint8_t *buffer, uint16_t length,
+                                        d24fc512_op_callback_t cb);
+
+/*
+ * #AckPolling
+ *
+ * 마지막으로 Write한 칩에 대해 동작한다. (Write Cycle은 칩마다 따로 진행된다)
+ *
+ * D24FC512_WaitReady()       : Write Cycle이 끝날 때까지 ACK Polling (Blocking)
+ *                              D24FC512_BUSY_POLL_MAX번 안에 ACK가 없으면 false
+ * D24FC512_WaitReady_Async() : 같은 동작을 큐에서 진행하고, 끝나면 cb를 호출한다.
+ *
+ * Blocking Write 함수들은 모두 리턴 전에 D24FC512_WaitReady()를 호출하므로
+ * 바로 다음에 Read를 해도 NACK가 나지 않는다.
+ */
+bool D24FC512_WaitReady(void);
+bool D24FC512_WaitReady_Async(d24fc512_op_t *op, d24fc512_op_callback_t cb);
+
+
+/* ======================================================================
+   6. Double-Buffered Streaming Read
+   ====================================================================== */
+
+/*
+ * #Stream #DoubleBuffer #ReadAhead
+ *
+ * 큰 영역을 UART로 덤프하거나 CRC를 계산할 때, Blocking Read와 처리를 번갈아 하면
+ * I2C와 UART가 동시에 바쁜 순간이 없다.
+ * Stream은 버퍼 두 개를 두고 TWI 인터럽트가 한쪽을 채우는 동안 사용자가 다른 쪽을 처리한다.
+ * 그래서 전체 처리 속도는 두 버스 중 느린 쪽에 가까워진다.
+ *
+ * 버퍼 하나는 Sequential Read 트랜잭션 하나로 채운다. (Page 경계와 무관, 칩 경계에서만 짧게 끊는다)
+ * 버퍼를 크게 잡을수록 Word Address 재전송 비용(약 4byte)이 줄지만,
+ * 그만큼 다른 Client가 기다리는 시간도 늘어난다. (I2C_PRIO_LOW로 큐에 들어간다)
+ *
+ * 사용 예)
+ *   static d24fc512_stream_t s;
+ *   const uint8_t *p;
+ *   uint16_t n;
+ *
+ *   D24FC512_Stream_Open(&s, 0x0000, D24FC512_CAPACITY);
+ *   while (!D24FC512_Stream_Done(&s)) {
+ *       if ((n = D24FC512_Stream_Get(&s, &p)) != 0) {
+ *           ... p[0] ~ p[n-1] 처리 (이 동안 다음 버퍼가 채워진다) ...
+ *           D24FC512_Stream_Release(&s);
+ *       }
+ *   }
+ */
+#define D24FC512_STREAM_BUF_SIZE 128
+
+typedef struct
+{
+    i2c_xfer_t xfer;
+    uint8_t buf[2][D24FC512_STREAM_BUF_SIZE];
+    volatile uint16_t ready[2];         // 채워진 길이 (0 = 비어 있음)
+    
+    uint32_t next;                      // 다음에 요청할 EEPROM 주소
+    uint32_t end;
+    uint8_t fill;                       // 채우는 중(또는 다음에 채울) 버퍼
+    uint8_t take;                       // 사용자가 처리할 버퍼
+    volatile bool busy;                 // 트랜잭션 진행 중
+    volatile bool error;
+} d24fc512_stream_t;
+
+void D24FC512_Stream_Open(d24fc512_stream_t *s, uint32_t address, uint32_t length);
+uint16_t D24FC512_Stream_Get(d24fc512_stream_t *s, const uint8_t **data);   // 준비된 byte 수, 없으면 0
+void D24FC512_Stream_Release(d24fc512_stream_t *s);                         // Get으로 받은 버퍼 반납
+bool D24FC512_Stream_Done(d24fc512_stream_t *s);                            // 끝까지 읽었거나 에러
+
+
+/* ======================================================================
+   7. 무결성 검사
+   ====================================================================== */
+
+/*
+ * #CRC16
+ * CRC-16/CCITT (Poly 0x1021, MSB First). 처음에는 crc = 0xFFFF로 시작하고,
+ * 나누어 계산할 때는 앞의 결과를 다음 호출의 crc로 넘긴다.
+ * Record Log, 설정 Slot 등 EEPROM에 저장하는 데이터의 검증에 사용한다.
  */
-void D24FC512_Read_Address_Block(uint16_t address, uint8_t *buffer, uint16_t length);
+uint16_t D24FC512_Crc16(uint16_t crc, const uint8_t *data, uint16_t length);
 
 
 #endif /* D24FC512_H_ */
@@ -0,0 +1,520 @@
+﻿#define F_CPU 5000000UL
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include "i2c.h"
+#include "d24fc512.h"
+#include "d24fc512_log.h"
+#include "d24fc512_archive.h"
+
+// Archive와 Record Log가 같은 칩 0을 나누어 쓰므로 영역이 겹치지 않아야 한다.
+#if EEPROM_ARCHIVE_START < EEPROM_LOG_END
+#error "Sample Archive가 Record Log 영역과 겹친다."
+#endif
+
+typedef struct
+{
+	uint32_t seq;
+	uint32_t t_start;
+	uint16_t span;			// 마지막 Sample 시각 - t_start
+	uint8_t  count;
+	uint8_t  rsv;
+	int16_t  min[EEPROM_ARCHIVE_CHANNELS];
+	int16_t  max[EEPROM_ARCHIVE_CHANNELS];
+	uint16_t hcrc;
+	uint16_t dcrc;
+} archive_header_t;			// 모든 필드가 자기 크기에 정렬되어 있어 padding 없이 32byte
+
+typedef struct
+{
+	archive_header_t hdr;
+	uint8_t data[EEPROM_ARCHIVE_SAMPLES * EEPROM_ARCHIVE_SAMPLE_SIZE];
+} archive_block_t;
+
+#define ARCHIVE_HCRC_SIZE	(EEPROM_ARCHIVE_HEADER_SIZE - 4)	// hcrc, dcrc 제외
+
+/*
+ * Block을 읽은 결과. Bus 에러는 "없는 Block"과 구분해야 한다.
+ * (읽지 못한 Block을 없다고 보면 Mount가 head를 잘못 찾아 살아 있는 Block을 덮어쓴다)
+ */
+typedef enum
+{
+	ARC_BLOCK_VALID,
+	ARC_BLOCK_EMPTY,		// 지워졌거나, 다른 seq이거나, CRC가 맞지 않는다.
+	ARC_BLOCK_ERROR			// Bus 에러로 읽지 못했다.
+} arc_block_t;
+
+static bool     arc_mounted = false;		// Mount(또는 Format)가 Bus 에러 없이 끝났다.
+static archive_block_t arc_cur;				// 채우는 중인 Block (count = 0 이면 비어 있음)
+static bool     arc_dirty = false;			// arc_cur에 기록되지 않은 Sample이 있음
+static uint32_t arc_next_seq;				// arc_cur의 seq
+static uint32_t arc_head_seq = 0;			// EEPROM에 있는 마지막 Block의 seq (0 = 비어 있음)
+static bool     arc_last_valid = false;		// arc_last_time을 알고 있음
+static uint32_t arc_last_time;				// 마지막 Sample 시각 (이보다 이른 Sample은 버린다)
+
+static uint32_t EEPROM_Archive_Address(uint32_t seq)
+{
+	return EEPROM_ARCHIVE_START + (uint32_t)(seq % EEPROM_ARCHIVE_BLOCKS) * EEPROM_ARCHIVE_BLOCK_SIZE;
+}
+
+static uint16_t EEPROM_Archive_HeaderCrc(const archive_header_t *hdr)
+{
+	return D24FC512_Crc16(0xFFFF, (const uint8_t *)hdr, ARCHIVE_HCRC_SIZE);
+}
+
+static uint16_t EEPROM_Archive_DataCrc(const archive_block_t *blk)
+{
+	return D24FC512_Crc16(0xFFFF, blk->data, (uint16_t)blk->hdr.count * EEPROM_ARCHIVE_SAMPLE_SIZE);
+}
+
+// seq Block의 Header만 읽는다. 그 자리에 seq Block이 온전히 있으면 ARC_BLOCK_VALID
+static arc_block_t EEPROM_Archive_ReadHeader(uint32_t seq, archive_header_t *hdr)
+{
+	if (!D24FC512_Read_Address_Block(EEPROM_Archive_Address(seq), (uint8_t *)hdr, EEPROM_ARCHIVE_HEADER_SIZE))
+		return ARC_BLOCK_ERROR;
+
+	if (hdr->seq == seq
+	    && hdr->count != 0 && hdr->count <= EEPROM_ARCHIVE_SAMPLES
+	    && hdr->hcrc == EEPROM_Archive_HeaderCrc(hdr))
+		return ARC_BLOCK_VALID;
+	return ARC_BLOCK_EMPTY;
+}
+
+// 자리(slot)에 있는 Block Header. seq를 모를 때 (Mount)
+static arc_block_t EEPROM_Archive_ReadSlot(uint16_t slot, archive_header_t *hdr)
+{
+	if (!D24FC512_Read_Address_Block(EEPROM_ARCHIVE_START + (uint32_t)slot * EEPROM_ARCHIVE_BLOCK_SIZE,
+	                                 (uint8_t *)hdr, EEPROM_ARCHIVE_HEADER_SIZE))
+		return ARC_BLOCK_ERROR;
+
+	if (hdr->seq != 0 && hdr->seq != 0xFFFFFFFFUL
+	    && (uint16_t)(hdr->seq % EEPROM_ARCHIVE_BLOCKS) == slot
+	    && hdr->count != 0 && hdr->count <= EEPROM_ARCHIVE_SAMPLES
+	    && hdr->hcrc == EEPROM_Archive_HeaderCrc(hdr))
+		return ARC_BLOCK_VALID;
+	return ARC_BLOCK_EMPTY;
+}
+
+// Header가 유효한 Block의 Sample을 읽는다. dcrc가 맞으면 ARC_BLOCK_VALID
+static arc_block_t EEPROM_Archive_ReadData(archive_block_t *blk)
+{
+	if (!D24FC512_Read_Address_Block(EEPROM_Archive_Address(blk->hdr.seq) + EEPROM_ARCHIVE_HEADER_SIZE, blk->data,
+	                                 (uint16_t)blk->hdr.count * EEPROM_ARCHIVE_SAMPLE_SIZE))
+		return ARC_BLOCK_ERROR;
+	return (blk->hdr.dcrc == EEPROM_Archive_DataCrc(blk)) ? ARC_BLOCK_VALID : ARC_BLOCK_EMPTY;
+}
+
+bool EEPROM_Archive_Mount(void)
+{
+	archive_header_t hdr;
+	arc_block_t r;
+	uint32_t lap0;
+	uint16_t lo, hi, mid;
+
+	arc_mounted = false;
+	arc_cur.hdr.count = 0;
+	arc_dirty = false;
+	arc_last_valid = false;
+
+	// Log와 같은 방법 : P(k) = valid && lap(k) == lap0 를 만족하는 마지막 k
+	r = EEPROM_Archive_ReadSlot(0, &hdr);
+	if (r == ARC_BLOCK_ERROR)
+		return false;
+	if (r == ARC_BLOCK_EMPTY)
+	{
+		r = EEPROM_Archive_ReadSlot(EEPROM_ARCHIVE_BLOCKS - 1, &hdr);
+		if (r == ARC_BLOCK_ERROR)
+			return false;
+		arc_head_seq = (r == ARC_BLOCK_VALID) ? hdr.seq : 0;
+	}
+	else
+	{
+		lap0 = hdr.seq / EEPROM_ARCHIVE_BLOCKS;
+		arc_head_seq = hdr.seq;
+		lo = 0;
+		hi = EEPROM_ARCHIVE_BLOCKS - 1;
+		while (lo < hi)
+		{
+			mid = lo + (hi - lo + 1) / 2;
+			r = EEPROM_Archive_ReadSlot(mid, &hdr);
+			if (r == ARC_BLOCK_ERROR)
+				return false;
+			if (r == ARC_BLOCK_VALID && hdr.seq / EEPROM_ARCHIVE_BLOCKS == lap0)
+			{
+				lo = mid;
+				arc_head_seq = hdr.seq;
+			}
+			else
+			{
+				hi = mid - 1;
+			}
+		}
+	}
+
+	if (arc_head_seq == 0)
+	{
+		arc_next_seq = EEPROM_ARCHIVE_BLOCKS;		// 첫 Block은 자리 0 (lap 1)
+		arc_mounted = true;
+		return false;
+	}
+
+	// 마지막 Block이 덜 찼으면 이어서 채운다. (마지막 시각을 모르면 시간 순서를 지킬 수 없으므로 Bus 에러는 실패)
+	arc_next_seq = arc_head_seq + 1;
+	r = EEPROM_Archive_ReadHeader(arc_head_seq, &arc_cur.hdr);
+	if (r == ARC_BLOCK_VALID)
+	{
+		arc_last_time = arc_cur.hdr.t_start + arc_cur.hdr.span;
+		arc_last_valid = true;
+		if (arc_cur.hdr.count < EEPROM_ARCHIVE_SAMPLES)
+			r = EEPROM_Archive_ReadData(&arc_cur);
+		if (r == ARC_BLOCK_VALID && arc_cur.hdr.count < EEPROM_ARCHIVE_SAMPLES)
+			arc_next_seq = arc_head_seq;
+	}
+	if (r == ARC_BLOCK_ERROR)
+	{
+		arc_cur.hdr.count = 0;
+		arc_last_valid = false;
+		return false;
+	}
+	if (arc_next_seq != arc_head_seq)
+		arc_cur.hdr.count = 0;
+	arc_mounted = true;
+	return true;
+}
+
+bool EEPROM_Archive_Format(void)
+{
+	uint8_t erased[EEPROM_ARCHIVE_HEADER_SIZE];
+	uint16_t slot;
+
+	arc_mounted = false;
+	arc_cur.hdr.count = 0;
+	arc_dirty = false;
+	arc_last_valid = false;
+
+	// Header만 지우면 충분하다. 이미 지워진 Block은 Update가 건너뛴다.
+	// 중간에 실패하면 남은 Block이 어떤 상태인지 모르므로 다시 Format이나 Mount할 때까지 쓰지 않는다.
+	memset(erased, 0xFF, sizeof(erased));
+	for (slot = 0; slot < EEPROM_ARCHIVE_BLOCKS; slot++)
+	{
+		if (!EEPROM_UpdateAnyBlock(EEPROM_ARCHIVE_START + (uint32_t)slot * EEPROM_ARCHIVE_BLOCK_SIZE,
+		                           erased, sizeof(erased), NULL))
+			return false;
+	}
+
+	arc_head_seq = 0;
+	arc_next_seq = EEPROM_ARCHIVE_BLOCKS;
+	arc_mounted = true;
+	return true;
+}
+
+bool EEPROM_Archive_Flush(void)
+{
+	if (!arc_dirty)
+		return true;
+
+	arc_cur.hdr.hcrc = EEPROM_Archive_HeaderCrc(&arc_cur.hdr);
+	arc_cur.hdr.dcrc = EEPROM_Archive_DataCrc(&arc_cur);
+
+	// Block = Page 하나이므로 Page Write 한 번 (앞에서부터 채운 만큼만)
+	// 실패하면 dirty로 남겨 다음 Flush(또는 Block이 찰 때)가 같은 자리에 다시 쓴다.
+	if (!D24FC512_Write_Address_Page(EEPROM_Archive_Address(arc_cur.hdr.seq), (uint8_t *)&arc_cur,
+	                                 EEPROM_ARCHIVE_HEADER_SIZE + arc_cur.hdr.count * EEPROM_ARCHIVE_SAMPLE_SIZE))
+		return false;
+	arc_head_seq = arc_cur.hdr.seq;
+	arc_dirty = false;
+	return true;
+}
+
+// 채우던 Block을 기록하고 다음 Block으로 넘어간다. 기록하지 못하면 Block을 RAM에 그대로 둔다.
+static bool EEPROM_Archive_Close(void)
+{
+	if (!EEPROM_Archive_Flush())
+		return false;
+	arc_cur.hdr.count = 0;
+	arc_next_seq++;
+	return true;
+}
+
+bool EEPROM_Archive_Append(uint32_t time, const int16_t *value)
+{
+	archive_header_t *hdr = &arc_cur.hdr;
+	uint8_t *p;
+	uint32_t last;
+	uint8_t i;
+
+	// Block 안에서도, Block 사이에서도 시간이 거꾸로 가면 Seek의 이진 탐색이 틀어진다.
+	if (!arc_mounted || (arc_last_valid && time < arc_last_time))
+		return false;
+
+	// 가득 찬 Block(전에 기록하지 못한 것)이나 dt 1byte에 들어가지 않는 간격이면 새 Block
+	// 앞 Block을 기록하지 못하면 이 Sample을 넣을 곳이 없으므로 버린다.
+	if (hdr->count)
+	{
+		last = hdr->t_start + hdr->span;
+		if ((hdr->count == EEPROM_ARCHIVE_SAMPLES || time - last > 0xFF) && !EEPROM_Archive_Close())
+			return false;
+	}
+
+	if (hdr->count == 0)
+	{
+		hdr->seq = arc_next_seq;
+		hdr->t_start = time;
+		hdr->span = 0;
+		hdr->rsv = 0;
+		for (i = 0; i < EEPROM_ARCHIVE_CHANNELS; i++)
+			hdr->min[i] = hdr->max[i] = value[i];
+		last = time;
+	}
+
+	p = &arc_cur.data[hdr->count * EEPROM_ARCHIVE_SAMPLE_SIZE];
+	*p++ = (uint8_t)(time - last);
+	memcpy(p, value, 2 * EEPROM_ARCHIVE_CHANNELS);
+
+	for (i = 0; i < EEPROM_ARCHIVE_CHANNELS; i++)
+	{
+		if (value[i] < hdr->min[i]) hdr->min[i] = value[i];
+		if (value[i] > hdr->max[i]) hdr->max[i] = value[i];
+	}
+	hdr->span = (uint16_t)(time - hdr->t_start);
+	hdr->count++;
+	arc_dirty = true;
+	arc_last_time = time;
+	arc_last_valid = true;
+
+	// 가득 찼으면 바로 기록한다. 실패해도 Sample은 RAM Block에 남아 다음 Append나 Flush가 다시 쓴다.
+	if (hdr->count == EEPROM_ARCHIVE_SAMPLES)
+		EEPROM_Archive_Close();
+	return true;
+}
+
+bool EEPROM_Archive_LastTime(uint32_t *time)
+{
+	if (!arc_last_valid)
+		return false;
+	*time = arc_last_time;
+	return true;
+}
+
+static uint32_t EEPROM_Archive_OldestSeq(void)
+{
+	if (arc_head_seq < (uint32_t)EEPROM_ARCHIVE_BLOCKS * 2)
+		return EEPROM_ARCHIVE_BLOCKS;
+	return arc_head_seq - EEPROM_ARCHIVE_BLOCKS + 1;
+}
+
+/*
+ * 마지막 Sample 시각 >= t1 인 첫 Block의 seq를 *seq에 넣는다. (없으면 arc_head_seq + 1, 비어 있으면 0)
+ * 깨진 Block(hcrc 오류)은 없는 것으로 보고 다음 유효한 Block으로 판단한다.
+ * Bus 에러면 false.
+ */
+static bool EEPROM_Archive_Seek(uint32_t t1, uint32_t *seq)
+{
+	archive_header_t hdr;
+	arc_block_t r = ARC_BLOCK_EMPTY;
+	uint32_t lo, hi, mid, m;
+
+	*seq = 0;
+	if (arc_head_seq == 0)
+		return true;
+
+	lo = EEPROM_Archive_OldestSeq();
+	hi = arc_head_seq + 1;
+	while (lo < hi)
+	{
+		mid = lo + (hi - lo) / 2;
+		for (m = mid; m < hi && (r = EEPROM_Archive_ReadHeader(m, &hdr)) == ARC_BLOCK_EMPTY; m++);
+
+		if (r == ARC_BLOCK_ERROR)
+			return false;
+		if (m == hi)
+			hi = mid;
+		else if (hdr.t_start + hdr.span >= t1)
+			hi = m;
+		else
+			lo = m + 1;
+	}
+	*seq = lo;
+	return true;
+}
+
+/*
+ * 채우는 중인 Block(arc_cur)의 seq. 없으면 0
+ * 질의는 EEPROM의 Block을 이 seq 앞까지만 읽고 이 Block은 RAM에서 읽는다.
+ * (Flush한 적이 있으면 EEPROM에도 같은 seq가 있지만 RAM 쪽이 더 길다. 항상 시간상 마지막 Block이다)
+ */
+static uint32_t EEPROM_Archive_CurSeq(void)
+{
+	return arc_cur.hdr.count ? arc_cur.hdr.seq : 0;
+}
+
+// Block 하나의 Sample 중 [t1, t2]를 cb로 넘긴다.
+static uint16_t EEPROM_Archive_QueryBlock(const archive_block_t *blk, uint32_t t1, uint32_t t2, archive_sample_cb_t cb)
+{
+	const uint8_t *p;
+	int16_t value[EEPROM_ARCHIVE_CHANNELS];
+	uint32_t time;
+	uint16_t found = 0;
+	uint8_t i;
+
+	time = blk->hdr.t_start;
+	for (i = 0, p = blk->data; i < blk->hdr.count; i++, p += EEPROM_ARCHIVE_SAMPLE_SIZE)
+	{
+		time += p[0];
+		if (time < t1 || time > t2)
+			continue;
+		memcpy(value, &p[1], sizeof(value));
+		cb(time, value);
+		found++;
+	}
+	return found;
+}
+
+bool EEPROM_Archive_Query(uint32_t t1, uint32_t t2, archive_sample_cb_t cb, uint16_t *found)
+{
+	archive_block_t blk;
+	arc_block_t r;
+	uint32_t seq, cur = EEPROM_Archive_CurSeq();
+	uint16_t n = 0;
+	bool ok = arc_mounted && EEPROM_Archive_Seek(t1, &seq);
+
+	for (; ok && seq && seq <= arc_head_seq && seq != cur; seq++)
+	{
+		r = EEPROM_Archive_ReadHeader(seq, &blk.hdr);
+		if (r == ARC_BLOCK_VALID && blk.hdr.t_start > t2)
+			break;
+		if (r == ARC_BLOCK_VALID)
+			r = EEPROM_Archive_ReadData(&blk);
+		if (r == ARC_BLOCK_ERROR)
+			ok = false;
+		else if (r == ARC_BLOCK_VALID)
+			n += EEPROM_Archive_QueryBlock(&blk, t1, t2, cb);
+	}
+
+	// 끝까지 읽지 못했으면 RAM Block을 붙이지 않는다. (중간이 빠진 결과를 이어 보이지 않도록)
+	if (ok && cur && arc_cur.hdr.t_start <= t2)
+		n += EEPROM_Archive_QueryBlock(&arc_cur, t1, t2, cb);
+	if (found)
+		*found = n;
+	return ok;
+}
+
+typedef struct
+{
+	uint32_t index;			// Bucket 번호 ((time - t1) / period)
+	bool     used;
+	int16_t  min[EEPROM_ARCHIVE_CHANNELS];
+	int16_t  max[EEPROM_ARCHIVE_CHANNELS];
+} archive_bucket_t;
+
+// index Bucket에 min/max를 합친다. Bucket이 바뀌면 이전 Bucket을 내보낸다.
+static void EEPROM_Archive_Merge(archive_bucket_t *b, uint32_t index, const int16_t *min, const int16_t *max,
+                                 uint32_t t1, uint32_t period, archive_bucket_cb_t cb)
+{
+	uint8_t i;
+
+	if (b->used && b->index != index)
+	{
+		cb(t1 + b->index * period, b->min, b->max);
+		b->used = false;
+	}
+
+	if (!b->used)
+	{
+		b->index = index;
+		b->used = true;
+		memcpy(b->min, min, sizeof(b->min));
+		memcpy(b->max, max, sizeof(b->max));
+		return;
+	}
+
+	for (i = 0; i < EEPROM_ARCHIVE_CHANNELS; i++)
+	{
+		if (min[i] < b->min[i]) b->min[i] = min[i];
+		if (max[i] > b->max[i]) b->max[i] = max[i];
+	}
+}
+
+/*
+ * Header가 유효한 Block 하나를 Bucket에 합친다.
+ * loaded가 false(EEPROM Block)이면 Sample은 Header 요약으로 안 될 때만 읽는다. (Bus 에러면 false)
+ */
+static bool EEPROM_Archive_AggregateBlock(archive_block_t *blk, bool loaded, archive_bucket_t *b,
+                                          uint32_t t1, uint32_t t2, uint32_t period, archive_bucket_cb_t cb)
+{
+	const uint8_t *p;
+	int16_t value[EEPROM_ARCHIVE_CHANNELS];
+	arc_block_t r;
+	uint32_t time, t_end;
+	uint8_t i;
+
+	// Block 전체가 범위 안, 한 Bucket 안이면 Header의 요약만 쓴다.
+	t_end = blk->hdr.t_start + blk->hdr.span;
+	if (blk->hdr.t_start >= t1 && t_end <= t2
+	    && (blk->hdr.t_start - t1) / period == (t_end - t1) / period)
+	{
+		EEPROM_Archive_Merge(b, (blk->hdr.t_start - t1) / period, blk->hdr.min, blk->hdr.max, t1, period, cb);
+		return true;
+	}
+
+	if (!loaded)
+	{
+		r = EEPROM_Archive_ReadData(blk);
+		if (r != ARC_BLOCK_VALID)
+			return r != ARC_BLOCK_ERROR;
+	}
+
+	time = blk->hdr.t_start;
+	for (i = 0, p = blk->data; i < blk->hdr.count; i++, p += EEPROM_ARCHIVE_SAMPLE_SIZE)
+	{
+		time += p[0];
+		if (time < t1 || time > t2)
+			continue;
+		memcpy(value, &p[1], sizeof(value));
+		EEPROM_Archive_Merge(b, (time - t1) / period, value, value, t1, period, cb);
+	}
+	return true;
+}
+
+bool EEPROM_Archive_Aggregate(uint32_t t1, uint32_t t2, uint32_t period, archive_bucket_cb_t cb)
+{
+	archive_block_t blk;
+	archive_bucket_t bucket;
+	arc_block_t r;
+	uint32_t seq, cur = EEPROM_Archive_CurSeq();
+	bool done = false, ok;
+
+	if (period == 0 || t2 < t1)
+		return true;
+
+	bucket.used = false;
+	ok = arc_mounted && EEPROM_Archive_Seek(t1, &seq);
+
+	for (; ok && seq && seq <= arc_head_seq && seq != cur; seq++)
+	{
+		r = EEPROM_Archive_ReadHeader(seq, &blk.hdr);
+		if (r == ARC_BLOCK_ERROR)
+			ok = false;
+		else if (r == ARC_BLOCK_EMPTY)
+			continue;
+		else if (blk.hdr.t_start > t2)
+			done = true;
+		else
+			ok = EEPROM_Archive_AggregateBlock(&blk, false, &bucket, t1, t2, period, cb);
+		if (done)
+			break;
+	}
+
+	// min/max는 Append가 RAM Header에 갱신해 두므로 EEPROM Block과 같은 방법으로 합친다.
+	// 끝까지 읽지 못했으면 합치다 만 Bucket을 내보내지 않는다.
+	if (!ok)
+		return false;
+	if (!done && cur && arc_cur.hdr.t_start <= t2)
+		EEPROM_Archive_AggregateBlock(&arc_cur, true, &bucket, t1, t2, period, cb);
+
+	if (bucket.used)
+		cb(t1 + bucket.index * period, bucket.min, bucket.max);
+	return true;
+}
@@ -0,0 +1,103 @@
+﻿#ifndef D24FC512_ARCHIVE_H_
+#define D24FC512_ARCHIVE_H_
+
+/*
+ * #SampleArchive #TimeSeries #RangeQuery
+ *
+ * 센서 값(ADC, DS1621, DHT11 등)을 시간과 함께 EEPROM에 쌓아 두고,
+ * "T1 ~ T2 사이의 샘플", "최근 하루의 1시간별 최대값" 같은 질의에
+ * 필요한 Block만 읽어서 답한다.
+ *
+ * Block 구조 (128byte = 1 Page, Block 하나가 Page Write 한 번)
+ *   Header 32byte : seq(4) t_start(4) span(2) count(1) rsv(1) min[4](8) max[4](8) hcrc(2) dcrc(2)
+ *   Sample 9byte  : dt(1) value[4](8)
+ *
+ *   - 시간은 초 단위 uint32 (PCF8563 시각을 초로 바꾼 값 등, 호출하는 쪽에서 넘긴다)
+ *   - dt는 앞 Sample과의 차이(0 ~ 255초). 첫 Sample은 t_start 자체이다. (#DeltaEncoding)
+ *     마지막 Sample 시각은 t_start + span 이다.
+ *     간격이 255초를 넘으면 새 Block을 시작한다.
+ *   - 앞 Sample보다 이른 시각의 Sample은 버린다. (같은 시각은 받는다)
+ *     seq 순서 = 시간 순서여야 Block을 이진 탐색할 수 있기 때문이다.
+ *     RTC를 뒤로 맞췄다면 EEPROM_Archive_Format() 후 다시 쌓는다.
+ *   - min/max는 Block 안 Sample의 채널별 요약. 질의 구간이 Block 전체를 덮으면
+ *     Sample을 읽지 않고 Header만으로 답한다.
+ *   - hcrc는 Header(hcrc 앞까지), dcrc는 count개 Sample에 대한 CRC16이다.
+ *     Header만 읽고 Block을 건너뛸 때도 hcrc로 검증할 수 있다.
+ *
+ * #BlockIndex
+ * Block은 Log와 같은 방식으로 seq % EEPROM_ARCHIVE_BLOCKS 위치에 원형으로 쓰고,
+ * 시간 순서 = seq 순서이다. 고정 위치의 Header가 곧 Index가 되므로
+ * 시작 Block은 Header만 읽는 이진 탐색으로 찾는다. (256 Block → Header Read 약 8번)
+ *
+ * 채우는 중인 Block은 RAM에 있고, 가득 차거나 EEPROM_Archive_Flush()를 부르면 기록된다.
+ * Query/Aggregate는 이 Block을 RAM에서 바로 읽으므로 Flush하지 않는다. (질의가 Write Cycle을 쓰지 않는다)
+ *
+ * #Layout
+ * 칩 0을 고정 비율로 나누어 쓴다. (이 보드에서는 0x51에 PCF8563이 있어 칩을 하나만 쓸 수 있다, d24fc512.h 참고)
+ *   0x0000 ~ 0x00FF : 설정 A/B Slot
+ *   0x0100 ~ 0x7FFF : Record Log (EEPROM_LOG_END)
+ *   0x8000 ~ 끝     : Sample Archive (256 Block × 10 Sample, 1분 간격이면 약 42시간)
+ * 칩을 더 붙일 수 있는 보드라면 Archive가 늘어난 칩 끝까지 이어진다.
+ *
+ * 주의) 칩 수(D24FC512_CHIP_COUNT)를 바꾸면 Block 수가 바뀌므로 EEPROM_Archive_Format()을 한다.
+ */
+
+#define EEPROM_ARCHIVE_START       0x8000UL                 // 0x0000 ~ 0x7FFF : 설정 + Record Log
+#define EEPROM_ARCHIVE_END         D24FC512_CAPACITY
+#define EEPROM_ARCHIVE_BLOCK_SIZE  PAGE_NO
+#define EEPROM_ARCHIVE_BLOCKS      ((uint16_t)((EEPROM_ARCHIVE_END - EEPROM_ARCHIVE_START) / EEPROM_ARCHIVE_BLOCK_SIZE))
+#define EEPROM_ARCHIVE_CHANNELS    4                        // 예) ADC, DS1621, DHT11 온도, DHT11 습도
+#define EEPROM_ARCHIVE_HEADER_SIZE (16 + 4 * EEPROM_ARCHIVE_CHANNELS)
+#define EEPROM_ARCHIVE_SAMPLE_SIZE (1 + 2 * EEPROM_ARCHIVE_CHANNELS)
+#define EEPROM_ARCHIVE_SAMPLES     ((EEPROM_ARCHIVE_BLOCK_SIZE - EEPROM_ARCHIVE_HEADER_SIZE) / EEPROM_ARCHIVE_SAMPLE_SIZE)
+
+typedef void (*archive_sample_cb_t)(uint32_t time, const int16_t *value);
+typedef void (*archive_bucket_cb_t)(uint32_t time, const int16_t *min, const int16_t *max);
+
+/*
+ * Archive 영역에서 head를 찾고, 마지막 Block이 덜 찼으면 RAM으로 올려 이어서 채운다.
+ * 기록된 Block이 있으면 true. 다른 함수보다 먼저 한 번 호출해야 한다.
+ * Bus 에러로 끝까지 읽지 못하면 false이고, 다시 Mount할 때까지 Append/Query/Aggregate도 false가 된다.
+ * (head를 모르는 채로 쓰면 살아 있는 Block을 덮어쓸 수 있다)
+ */
+bool EEPROM_Archive_Mount(void);
+bool EEPROM_Archive_Format(void);       // 모든 Block 무효화 (Block마다 Write Cycle 한 번), Bus 에러면 false
+
+/*
+ * Sample 하나를 추가한다. Block이 가득 찰 때만 EEPROM에 쓴다. (Page Write 한 번)
+ * time이 마지막 Sample 시각보다 이르면 버리고 false.
+ * 가득 찬 Block을 기록하지 못하면 그 Block은 RAM에 남아 다음 Append/Flush가 다시 쓰고,
+ * 그동안 새 Block이 필요한 Sample은 false로 버린다.
+ */
+bool EEPROM_Archive_Append(uint32_t time, const int16_t *value);
+/*
+ * #Flush
+ * 채우는 중인 Block을 지금 기록한다. (전원을 끄기 전, 오래 쉬기 전 등)
+ * 주의) Flush한 Block은 가득 찰 때까지 같은 Page에 다시 쓰이면서 채워진다.
+ *   - 다시 쓰는 도중 전원이 꺼지면 Page 전체가 깨져 전에 Flush한 Sample까지 그 Block을 통째로 잃는다.
+ *   - Flush할 때마다 같은 Page에 Write Cycle이 하나씩 더 든다.
+ *   그러므로 Sample마다 부르지 말고 꼭 남겨야 할 때만 부른다.
+ * 기록하지 못하면 false이고 Block은 dirty로 남는다.
+ */
+bool EEPROM_Archive_Flush(void);
+
+/*
+ * #RangeQuery
+ * t1 <= time <= t2 인 Sample을 시간 순서대로 cb로 넘긴다. found가 NULL이 아니면 넘긴 Sample 수를 넣는다.
+ * cb에서 printf하면 결과가 UART로 바로 흘러 나간다. (전체를 RAM에 모으지 않는다)
+ * Bus 에러가 나면 거기서 멈추고 false. (그때까지 넘긴 Sample은 맞는 값이다)
+ */
+bool EEPROM_Archive_Query(uint32_t t1, uint32_t t2, archive_sample_cb_t cb, uint16_t *found);
+
+/*
+ * #Aggregate
+ * [t1, t2]를 period초 구간(Bucket)으로 나누어 구간별 채널 min/max를 cb로 넘긴다. (Sample 없는 구간은 생략)
+ * Bucket 하나에 완전히 들어가는 Block은 Header의 min/max만 읽는다.
+ * 예) 최근 하루 1시간별 최대 : EEPROM_Archive_Aggregate(now - 86400, now, 3600, cb)
+ * Bus 에러가 나면 거기서 멈추고 false. (합치던 Bucket은 내보내지 않는다)
+ */
+bool EEPROM_Archive_Aggregate(uint32_t t1, uint32_t t2, uint32_t period, archive_bucket_cb_t cb);
+
+bool EEPROM_Archive_LastTime(uint32_t *time);   // 마지막 Sample 시각, 없으면 false
+
+#endif /* D24FC512_ARCHIVE_H_ */
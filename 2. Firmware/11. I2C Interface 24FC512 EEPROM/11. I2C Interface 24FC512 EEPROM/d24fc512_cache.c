@@ -0,0 +1,258 @@
+﻿#define F_CPU 5000000UL
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include "i2c.h"
+#include "d24fc512.h"
+#include "d24fc512_cache.h"
+
+#define CACHE_NONE		0xFFFFFFFFUL
+
+typedef struct
+{
+	uint32_t base;			// Page 시작 주소, CACHE_NONE이면 빈 칸
+	uint8_t  dirty_lo;		// dirty 구간 [dirty_lo, dirty_hi), 같으면 clean
+	uint8_t  dirty_hi;
+	uint8_t  age;			// 0 = 가장 최근에 사용
+	uint8_t  data[PAGE_NO];
+} cache_page_t;
+
+static cache_page_t cache[D24FC512_CACHE_PAGES];
+static volatile uint16_t cache_idle = 0;	// 남은 Idle 시간 [ms], 0이면 대기 없음
+
+// cache_idle(16bit)은 Tick ISR이 바꾼다. sei() 전에 불려도 인터럽트를 켜지 않도록 SREG를 복원한다.
+static void EEPROM_Cache_SetIdle(uint16_t ms)
+{
+	uint8_t sreg = SREG;
+	
+	cli();
+	cache_idle = ms;
+	SREG = sreg;
+}
+
+static void EEPROM_Cache_Touch(cache_page_t *page)
+{
+	uint8_t i;
+	
+	for (i = 0; i < D24FC512_CACHE_PAGES; i++)
+	{
+		if (cache[i].age < page->age)
+			cache[i].age++;
+	}
+	page->age = 0;
+}
+
+// 실패하면 dirty 구간을 그대로 두어 다음 Write-back에서 다시 기록한다.
+static bool EEPROM_Cache_WriteBack(cache_page_t *page)
+{
+	if (page->dirty_hi == page->dirty_lo)
+		return true;
+	
+	// dirty 구간은 한 Page 안에 있으므로 Page Write 한 번 (ACK Polling 포함)
+	if (!D24FC512_Write_Address_Page(page->base + page->dirty_lo, &page->data[page->dirty_lo],
+	                                 page->dirty_hi - page->dirty_lo))
+		return false;
+	page->dirty_lo = page->dirty_hi = 0;
+	return true;
+}
+
+static cache_page_t* EEPROM_Cache_Find(uint32_t base)
+{
+	uint8_t i;
+	
+	for (i = 0; i < D24FC512_CACHE_PAGES; i++)
+	{
+		if (cache[i].base == base)
+			return &cache[i];
+	}
+	return NULL;
+}
+
+/*
+ * Page를 Cache에 올린다. 빈 칸이 없으면 가장 오래된 Page를 내보낸다.
+ * 내보낼 Page를 기록하지 못했으면 그 Page를 그대로 두고, Read에 실패했으면 빈 칸으로 만들고 NULL.
+ */
+static cache_page_t* EEPROM_Cache_Load(uint32_t base)
+{
+	cache_page_t *page = &cache[0];
+	uint8_t i;
+	
+	for (i = 1; i < D24FC512_CACHE_PAGES; i++)
+	{
+		if (page->base == CACHE_NONE)
+			break;
+		if (cache[i].base == CACHE_NONE || cache[i].age > page->age)
+			page = &cache[i];
+	}
+	
+	if (!EEPROM_Cache_WriteBack(page))
+		return NULL;
+	
+	if (!D24FC512_Read_Address_Block(base, page->data, PAGE_NO))
+	{
+		page->base = CACHE_NONE;
+		return NULL;
+	}
+	page->base = base;
+	page->dirty_lo = page->dirty_hi = 0;
+	return page;
+}
+
+void EEPROM_Cache_Init(void)
+{
+	uint8_t i;
+	
+	for (i = 0; i < D24FC512_CACHE_PAGES; i++)
+	{
+		cache[i].base = CACHE_NONE;
+		cache[i].dirty_lo = cache[i].dirty_hi = 0;
+		cache[i].age = i;
+	}
+	cache_idle = 0;
+}
+
+bool EEPROM_Cache_Read(uint32_t address, uint8_t *buffer, uint16_t length)
+{
+	bool ok = true;
+	
+	while (length)
+	{
+		uint32_t base = address & ~(uint32_t)(PAGE_NO - 1);
+		uint8_t  offset = address & (PAGE_NO - 1);
+		uint16_t n = PAGE_NO - offset;
+		cache_page_t *page;
+		
+		if (n > length)
+			n = length;
+		
+		page = EEPROM_Cache_Find(base);
+		if (page)
+		{
+			memcpy(buffer, &page->data[offset], n);
+			EEPROM_Cache_Touch(page);
+		}
+		else if (!D24FC512_Read_Address_Block(address, buffer, n))
+		{
+			ok = false;
+		}
+		
+		address += n;
+		buffer += n;
+		length -= n;
+	}
+	return ok;
+}
+
+bool EEPROM_Cache_Write(uint32_t address, const uint8_t *buffer, uint16_t length)
+{
+	bool ok = true;
+	
+	while (length)
+	{
+		uint32_t base = address & ~(uint32_t)(PAGE_NO - 1);
+		uint8_t  offset = address & (PAGE_NO - 1);
+		uint16_t n = PAGE_NO - offset;
+		cache_page_t *page;
+		
+		if (n > length)
+			n = length;
+		
+		page = EEPROM_Cache_Find(base);
+		if (page == NULL)
+			page = EEPROM_Cache_Load(base);
+		if (page == NULL)
+		{
+			ok = false;		// Page를 올리지 못했다. 이 Page 몫은 기록하지 않는다.
+			break;
+		}
+		
+		memcpy(&page->data[offset], buffer, n);
+		
+		// dirty 구간 확장 (처음 dirty가 되는 경우 구간을 새로 잡는다)
+		if (page->dirty_hi == page->dirty_lo)
+		{
+			page->dirty_lo = offset;
+			page->dirty_hi = offset + n;
+		}
+		else
+		{
+			if (offset < page->dirty_lo) page->dirty_lo = offset;
+			if (offset + n > page->dirty_hi) page->dirty_hi = offset + n;
+		}
+		EEPROM_Cache_Touch(page);
+		
+		address += n;
+		buffer += n;
+		length -= n;
+	}
+	
+	EEPROM_Cache_SetIdle(D24FC512_CACHE_IDLE_MS);
+	return ok;
+}
+
+uint8_t EEPROM_Cache_Read_Uint8(uint32_t address)
+{
+	uint8_t data;
+	
+	EEPROM_Cache_Read(address, &data, 1);
+	return data;
+}
+
+// D24FC512_Read_Address_Uint16()과 같은 byte 순서
+uint16_t EEPROM_Cache_Read_Uint16(uint32_t address)
+{
+	uint16_t data;
+	
+	EEPROM_Cache_Read(address, (uint8_t *)&data, 2);
+	return data;
+}
+
+bool EEPROM_Cache_Write_Uint8(uint32_t address, uint8_t data)
+{
+	return EEPROM_Cache_Write(address, &data, 1);
+}
+
+bool EEPROM_Cache_Write_Uint16(uint32_t address, uint16_t data)
+{
+	return EEPROM_Cache_Write(address, (const uint8_t *)&data, 2);
+}
+
+bool EEPROM_Cache_Flush(void)
+{
+	bool ok = true;
+	uint8_t i;
+	
+	EEPROM_Cache_SetIdle(0);
+	
+	for (i = 0; i < D24FC512_CACHE_PAGES; i++)
+	{
+		if (cache[i].base != CACHE_NONE && !EEPROM_Cache_WriteBack(&cache[i]))
+			ok = false;
+	}
+	
+	// 기록하지 못한 Page는 dirty로 남아 있으므로 Idle Timeout 뒤에 다시 시도한다.
+	if (!ok)
+		EEPROM_Cache_SetIdle(D24FC512_CACHE_IDLE_MS);
+	return ok;
+}
+
+void EEPROM_Cache_TickISR(void)
+{
+	if (cache_idle > 1)
+		cache_idle--;
+}
+
+void EEPROM_Cache_Task(void)
+{
+	uint8_t sreg = SREG;
+	bool expired;
+	
+	cli();
+	expired = (cache_idle == 1);
+	SREG = sreg;
+	
+	if (expired)
+		EEPROM_Cache_Flush();
+}
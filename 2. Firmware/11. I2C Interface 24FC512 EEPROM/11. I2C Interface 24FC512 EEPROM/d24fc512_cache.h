@@ -0,0 +1,54 @@
+﻿#ifndef D24FC512_CACHE_H_
+#define D24FC512_CACHE_H_
+
+/*
+ * #WriteBackCache #WriteCoalescing
+ *
+ * D24FC512 앞에 두는 RAM Page Cache.
+ *
+ * EEPROM은 1byte를 써도 128byte Page를 쓸 때와 같은 Write Cycle(최대 5ms)이 들고,
+ * Cell 수명(Endurance)도 Write Cycle 횟수로 소모된다.
+ * 카운터나 샘플처럼 작은 값을 자주 바꾸는 경우 Cache에 모아 두었다가
+ * Page Write 한 번으로 내려 쓰면 시간과 수명을 모두 아낄 수 있다.
+ *
+ *  - Write : 해당 Page를 Cache에 올리고(처음 한 번 Page 전체 Read) RAM에만 기록, dirty 표시
+ *  - Read  : Cache에 있는 Page는 RAM에서, 없으면 EEPROM에서 바로 읽는다. (Read는 Cache에 올리지 않음)
+ *  - Write-back : dirty 구간(처음 ~ 마지막으로 바뀐 byte)을 Page Write 한 번으로 기록
+ *        1) 새 Page를 올리려고 오래된 Page를 내보낼 때 (LRU)
+ *        2) EEPROM_Cache_Flush()
+ *        3) 마지막 Write 후 D24FC512_CACHE_IDLE_MS 동안 변화가 없을 때 (EEPROM_Cache_Task())
+ *
+ * Bus 에러가 나면 false를 돌려준다.
+ *  - Write-back에 실패한 Page는 dirty로 남아 다음 Write-back(Flush, Idle Timeout, LRU)에서 다시 기록된다.
+ *    내보낼 Page를 기록하지 못하면 새 Page를 올리지 않으므로 그 Write는 false가 된다.
+ *  - Page를 올리는 Read에 실패하면 그 Page는 Cache에 남기지 않는다.
+ *  - Read_Uint8/Uint16은 실패를 알릴 수 없으므로 확인이 필요하면 EEPROM_Cache_Read()를 쓴다.
+ *
+ * 주의) Flush 전에 전원이 꺼지면 Cache의 내용은 사라진다.
+ *       전원 차단을 감지할 수 있다면 그때 EEPROM_Cache_Flush()를 호출한다.
+ *       Cache를 쓰는 주소 범위는 D24FC512_* 함수로 직접 쓰지 않는다.
+ */
+
+#define D24FC512_CACHE_PAGES     2       // Cache할 Page 수 (1Page = 128byte RAM)
+#define D24FC512_CACHE_IDLE_MS   500     // 이 시간 동안 Write가 없으면 dirty Page를 기록
+
+void EEPROM_Cache_Init(void);
+
+bool EEPROM_Cache_Read(uint32_t address, uint8_t *buffer, uint16_t length);
+bool EEPROM_Cache_Write(uint32_t address, const uint8_t *buffer, uint16_t length);
+
+uint8_t  EEPROM_Cache_Read_Uint8(uint32_t address);
+uint16_t EEPROM_Cache_Read_Uint16(uint32_t address);
+bool     EEPROM_Cache_Write_Uint8(uint32_t address, uint8_t data);
+bool     EEPROM_Cache_Write_Uint16(uint32_t address, uint16_t data);
+
+bool EEPROM_Cache_Flush(void);          // dirty Page를 모두 기록 (Blocking), 하나라도 실패하면 false
+
+/*
+ * EEPROM_Cache_TickISR() : 1ms Timer ISR에서 호출 (Idle 시간 계산)
+ * EEPROM_Cache_Task()    : Main Loop에서 호출, Idle Timeout이 지나면 Flush
+ */
+void EEPROM_Cache_TickISR(void);
+void EEPROM_Cache_Task(void);
+
+#endif /* D24FC512_CACHE_H_ */
@@ -0,0 +1,127 @@
+﻿#define F_CPU 5000000UL
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include "i2c.h"
+#include "d24fc512.h"
+#include "d24fc512_config.h"
+
+typedef struct
+{
+	uint16_t magic;
+	uint8_t  version;
+	uint8_t  length;
+	uint16_t seq;
+	uint16_t crc;
+} __attribute__((packed)) config_header_t;
+
+static const uint16_t config_slot[2] = { EEPROM_CONFIG_SLOT_A, EEPROM_CONFIG_SLOT_B };
+static int8_t   config_active = -1;		// -1 = 유효한 Slot 없음
+static bool     config_loaded = false;	// Load가 Bus 에러 없이 끝났다. (false면 Save하지 않는다)
+static uint16_t config_seq = 0;
+static uint8_t  config_version;			// active Slot의 version, length
+static uint8_t  config_length;
+
+static uint16_t EEPROM_Config_Crc(const config_header_t *hdr, const uint8_t *payload)
+{
+	uint16_t crc = D24FC512_Crc16(0xFFFF, (const uint8_t *)hdr, EEPROM_CONFIG_HEADER_SIZE - 2);
+	return D24FC512_Crc16(crc, payload, hdr->length);
+}
+
+static bool EEPROM_Config_HeaderValid(const config_header_t *hdr)
+{
+	return hdr->magic == EEPROM_CONFIG_MAGIC && hdr->length <= EEPROM_CONFIG_PAYLOAD_MAX;
+}
+
+eeprom_config_result_t EEPROM_Config_Load(void *data, uint8_t length, uint8_t *version)
+{
+	config_header_t hdr[2];
+	uint8_t payload[EEPROM_CONFIG_PAYLOAD_MAX];
+	uint8_t order[2], i, s;
+	
+	config_loaded = false;
+	config_active = -1;
+	
+	// Header를 하나라도 읽지 못하면 어느 Slot이 최신인지 알 수 없다.
+	for (i = 0; i < 2; i++)
+	{
+		if (!D24FC512_Read_Address_Block(config_slot[i], (uint8_t *)&hdr[i], EEPROM_CONFIG_HEADER_SIZE))
+			return EEPROM_CONFIG_ERROR;
+	}
+	
+	// 둘 다 유효하면 seq가 새로운 쪽 먼저 (16bit wrap 고려)
+	if (EEPROM_Config_HeaderValid(&hdr[0]) && EEPROM_Config_HeaderValid(&hdr[1]))
+		order[0] = ((int16_t)(hdr[1].seq - hdr[0].seq) > 0) ? 1 : 0;
+	else
+		order[0] = EEPROM_Config_HeaderValid(&hdr[1]) ? 1 : 0;
+	order[1] = order[0] ^ 1;
+	
+	for (i = 0; i < 2; i++)
+	{
+		s = order[i];
+		if (!EEPROM_Config_HeaderValid(&hdr[s]))
+			continue;
+		
+		// 더 새로운 Slot을 읽지 못했는데 이전 Slot으로 넘어가면, 다음 Save가 새로운 Slot을 덮어쓴다.
+		if (!D24FC512_Read_Address_Block(config_slot[s] + EEPROM_CONFIG_HEADER_SIZE, payload, hdr[s].length))
+			return EEPROM_CONFIG_ERROR;
+		if (hdr[s].crc != EEPROM_Config_Crc(&hdr[s], payload))
+			continue;
+		
+		memcpy(data, payload, (hdr[s].length < length) ? hdr[s].length : length);
+		if (version)
+			*version = hdr[s].version;
+		config_active = s;
+		config_seq = hdr[s].seq;
+		config_version = hdr[s].version;
+		config_length = hdr[s].length;
+		config_loaded = true;
+		return EEPROM_CONFIG_VALID;
+	}
+	
+	// 유효한 Slot이 없어도 seq는 두 Header 중 큰 값 다음부터 쓴다.
+	config_seq = ((int16_t)(hdr[1].seq - hdr[0].seq) > 0) ? hdr[1].seq : hdr[0].seq;
+	config_loaded = true;
+	return EEPROM_CONFIG_EMPTY;
+}
+
+bool EEPROM_Config_Save(const void *data, uint8_t length, uint8_t version)
+{
+	config_header_t hdr;
+	uint8_t current[EEPROM_CONFIG_PAYLOAD_MAX];
+	uint8_t target = (config_active == 0) ? 1 : 0;
+	
+	if (length > EEPROM_CONFIG_PAYLOAD_MAX || !config_loaded)
+		return false;
+	
+	// active Slot과 내용이 같으면 아무것도 쓰지 않는다. (주기적인 전체 저장은 Read만 든다)
+	// 읽지 못했으면 같은지 알 수 없으므로 저장한다.
+	if (config_active >= 0 && config_version == version && config_length == length)
+	{
+		if (D24FC512_Read_Address_Block(config_slot[config_active] + EEPROM_CONFIG_HEADER_SIZE, current, length)
+		    && memcmp(current, data, length) == 0)
+			return true;
+	}
+	
+	hdr.magic = EEPROM_CONFIG_MAGIC;
+	hdr.version = version;
+	hdr.length = length;
+	hdr.seq = config_seq + 1;
+	hdr.crc = EEPROM_Config_Crc(&hdr, (const uint8_t *)data);
+	
+	// 1) Payload  2) Header : Header가 다 써져야 새 Slot이 유효해진다.
+	// inactive Slot에는 보통 한 세대 전 값이 있으므로 바뀐 구간만 쓴다.
+	// 어느 쪽이든 실패하면 active Slot은 그대로 두고, 다음 Save가 같은 target에 다시 쓴다.
+	if (!EEPROM_UpdateAnyBlock(config_slot[target] + EEPROM_CONFIG_HEADER_SIZE, (const uint8_t *)data, length, NULL))
+		return false;
+	if (!D24FC512_Write_Address_Page(config_slot[target], (uint8_t *)&hdr, EEPROM_CONFIG_HEADER_SIZE))
+		return false;
+	
+	config_active = target;
+	config_seq = hdr.seq;
+	config_version = version;
+	config_length = length;
+	return true;
+}
@@ -0,0 +1,56 @@
+﻿#ifndef D24FC512_CONFIG_H_
+#define D24FC512_CONFIG_H_
+
+/*
+ * #Config #A_B_Slot #AtomicUpdate
+ *
+ * 설정값을 한 곳에 덮어쓰면, 쓰는 도중 전원이 꺼졌을 때 반쯤 바뀐 값과 정상 값을 구분할 수 없다.
+ * 그래서 설정을 두 Slot(A/B)에 번갈아 저장한다.
+ *
+ *   Slot A : 0x0000 ~ 0x007F (Page 0)
+ *   Slot B : 0x0080 ~ 0x00FF (Page 1)
+ *
+ *   [Header 8byte][Payload 최대 120byte]
+ *   Header = magic(2) version(1) length(1) seq(2) crc16(2)
+ *   crc16은 Header(magic ~ seq) + Payload 에 대한 값이다.
+ *
+ * 저장 : 항상 현재 쓰지 않는(inactive) Slot에 Payload를 먼저 쓰고, Header를 마지막에 쓴다.
+ *        어느 시점에 전원이 꺼져도 이전 Slot은 그대로 남는다.
+ * 부팅 : Slot마다 Header 하나씩만 읽어 magic이 맞는 Slot 중 seq가 더 새로운 것을 고르고,
+ *        그 Payload의 CRC가 맞으면 사용, 아니면 다른 Slot으로 넘어간다.
+ *
+ * Bus 에러로 읽지 못한 Slot은 "없는 Slot"과 다르게 다룬다.
+ * 없다고 보면 다음 Save가 살아 있는 최신 Slot을 덮어쓸 수 있으므로,
+ * Load가 Bus 에러로 끝나면 다시 Load가 성공할 때까지 Save는 아무것도 쓰지 않고 false를 리턴한다.
+ */
+
+#define EEPROM_CONFIG_SLOT_A       0x0000
+#define EEPROM_CONFIG_SLOT_B       0x0080
+#define EEPROM_CONFIG_MAGIC        0xC0F1
+#define EEPROM_CONFIG_HEADER_SIZE  8
+#define EEPROM_CONFIG_PAYLOAD_MAX  (PAGE_NO - EEPROM_CONFIG_HEADER_SIZE)
+
+typedef enum
+{
+	EEPROM_CONFIG_VALID,		// 유효한 설정을 읽었다.
+	EEPROM_CONFIG_EMPTY,		// 유효한 Slot이 없다. (처음 쓰는 EEPROM, 둘 다 CRC 불일치)
+	EEPROM_CONFIG_ERROR			// Bus 에러로 끝까지 읽지 못했다.
+} eeprom_config_result_t;
+
+/*
+ * 유효한 설정을 읽어 data에 넣는다. (저장된 길이와 length 중 작은 만큼, 나머지는 그대로 둔다)
+ * version에는 저장할 때의 version을 돌려준다. (NULL 가능)
+ * EEPROM_CONFIG_EMPTY → 기본값을 쓰고 EEPROM_Config_Save()로 저장한다.
+ * EEPROM_CONFIG_ERROR → 기본값을 쓰되 저장하지 않는다. (Save도 false가 된다)
+ */
+eeprom_config_result_t EEPROM_Config_Load(void *data, uint8_t length, uint8_t *version);
+
+/*
+ * inactive Slot에 저장하고 active Slot을 바꾼다. (Blocking)
+ * EEPROM_Config_Load()가 Bus 에러 없이 끝나야 어느 Slot이 active인지 알 수 있으므로, 그 전에는 false.
+ * active Slot과 version, 내용이 모두 같으면 아무것도 쓰지 않고 true를 리턴한다.
+ * Payload나 Header를 쓰지 못하면 false이고 active Slot은 그대로다. (다음 Save가 같은 Slot에 다시 쓴다)
+ */
+bool EEPROM_Config_Save(const void *data, uint8_t length, uint8_t version);
+
+#endif /* D24FC512_CONFIG_H_ */
@@ -0,0 +1,240 @@
+﻿#define F_CPU 5000000UL
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include "i2c.h"
+#include "d24fc512.h"
+#include "d24fc512_log.h"
+
+typedef struct
+{
+	uint32_t seq;
+	uint8_t  length;
+	uint8_t  type;
+	uint8_t  payload[EEPROM_LOG_PAYLOAD_MAX];
+	uint16_t crc;
+} __attribute__((packed)) log_record_t;
+
+#define LOG_HEADER_SIZE		6		// seq + length + type
+#define LOG_UNKNOWN			0xFFFF
+
+/*
+ * Slot을 읽은 결과. Bus 에러는 "없는 Record"와 구분해야 한다.
+ * (읽지 못한 Record를 없다고 보면 Mount가 head를 잘못 찾거나, 최신 값을 복사하지 않고 밀어낸다)
+ */
+typedef enum
+{
+	LOG_SLOT_VALID,
+	LOG_SLOT_EMPTY,			// 지워졌거나 CRC가 맞지 않는다.
+	LOG_SLOT_ERROR			// Bus 에러로 읽지 못했다.
+} log_slot_t;
+
+static bool     log_mounted = false;		// Mount가 Bus 에러 없이 끝났다.
+static uint32_t log_head_seq = 0;			// 0 = 비어 있음
+static uint16_t log_latest[EEPROM_LOG_TYPES];	// type별 최신 Record의 Slot (LOG_UNKNOWN = 아직 모름)
+static uint32_t log_latest_seq[EEPROM_LOG_TYPES];	// 0 = 이 Log에 없음 (log_latest가 알려진 경우)
+
+static uint32_t EEPROM_Log_Address(uint16_t slot)
+{
+	return EEPROM_LOG_START + (uint32_t)slot * EEPROM_LOG_SLOT_SIZE;
+}
+
+static uint16_t EEPROM_Log_Crc(const log_record_t *rec)
+{
+	return D24FC512_Crc16(0xFFFF, (const uint8_t *)rec, sizeof(log_record_t) - 2);
+}
+
+// Slot을 읽어 CRC까지 맞으면 LOG_SLOT_VALID
+static log_slot_t EEPROM_Log_ReadSlot(uint16_t slot, log_record_t *rec)
+{
+	if (!D24FC512_Read_Address_Block(EEPROM_Log_Address(slot), (uint8_t *)rec, sizeof(log_record_t)))
+		return LOG_SLOT_ERROR;
+	
+	if (rec->seq != 0 && rec->seq != 0xFFFFFFFFUL
+	    && (uint16_t)(rec->seq % EEPROM_LOG_SLOTS) == slot
+	    && rec->length <= EEPROM_LOG_PAYLOAD_MAX
+	    && rec->type < EEPROM_LOG_TYPES
+	    && rec->crc == EEPROM_Log_Crc(rec))
+		return LOG_SLOT_VALID;
+	return LOG_SLOT_EMPTY;
+}
+
+bool EEPROM_Log_Mount(void)
+{
+	log_record_t rec;
+	log_slot_t r;
+	uint32_t lap0;
+	uint16_t lo, hi, mid;
+	uint8_t i;
+	
+	log_mounted = false;
+	for (i = 0; i < EEPROM_LOG_TYPES; i++)
+		log_latest[i] = LOG_UNKNOWN;
+	
+	r = EEPROM_Log_ReadSlot(0, &rec);
+	if (r == LOG_SLOT_ERROR)
+		return false;
+	if (r == LOG_SLOT_EMPTY)
+	{
+		// Slot 0이 없으면 비어 있거나, 새 lap의 Slot 0을 쓰다가 전원이 꺼진 경우
+		r = EEPROM_Log_ReadSlot(EEPROM_LOG_SLOTS - 1, &rec);
+		if (r == LOG_SLOT_ERROR)
+			return false;
+		log_mounted = true;
+		if (r == LOG_SLOT_VALID)
+		{
+			log_head_seq = rec.seq;
+			return true;
+		}
+		log_head_seq = 0;
+		for (i = 0; i < EEPROM_LOG_TYPES; i++)
+		{
+			log_latest[i] = 0;
+			log_latest_seq[i] = 0;
+		}
+		return false;
+	}
+	
+	// P(k) = valid && lap(k) == lap0 를 만족하는 마지막 k (P(0) = true)
+	lap0 = rec.seq / EEPROM_LOG_SLOTS;
+	log_head_seq = rec.seq;
+	lo = 0;
+	hi = EEPROM_LOG_SLOTS - 1;
+	while (lo < hi)
+	{
+		mid = lo + (hi - lo + 1) / 2;
+		r = EEPROM_Log_ReadSlot(mid, &rec);
+		if (r == LOG_SLOT_ERROR)
+			return false;
+		if (r == LOG_SLOT_VALID && rec.seq / EEPROM_LOG_SLOTS == lap0)
+		{
+			lo = mid;
+			log_head_seq = rec.seq;
+		}
+		else
+		{
+			hi = mid - 1;
+		}
+	}
+	log_mounted = true;
+	return true;
+}
+
+// head부터 거꾸로 type의 최신 Record를 찾는다. (Bus 에러면 기억하지 않고 LOG_SLOT_ERROR)
+static log_slot_t EEPROM_Log_Find(uint8_t type, log_record_t *rec)
+{
+	uint8_t hdr[LOG_HEADER_SIZE];
+	log_slot_t r;
+	uint32_t seq;
+	uint16_t n, slot;
+	
+	if (log_latest[type] != LOG_UNKNOWN)
+	{
+		if (log_latest_seq[type] == 0)
+			return LOG_SLOT_EMPTY;
+		return EEPROM_Log_ReadSlot(log_latest[type], rec);
+	}
+	
+	for (n = 0, seq = log_head_seq; n < EEPROM_LOG_WINDOW && seq >= EEPROM_LOG_SLOTS; n++, seq--)
+	{
+		slot = (uint16_t)(seq % EEPROM_LOG_SLOTS);
+		
+		// Header만 먼저 보고 type이 같을 때만 전체를 읽어 CRC 확인
+		if (!D24FC512_Read_Address_Block(EEPROM_Log_Address(slot), hdr, LOG_HEADER_SIZE))
+			return LOG_SLOT_ERROR;
+		if (hdr[5] != type || memcmp(hdr, &seq, 4) != 0)
+			continue;
+		r = EEPROM_Log_ReadSlot(slot, rec);
+		if (r == LOG_SLOT_ERROR)
+			return LOG_SLOT_ERROR;
+		if (r == LOG_SLOT_EMPTY)
+			continue;
+		
+		log_latest[type] = slot;
+		log_latest_seq[type] = seq;
+		return LOG_SLOT_VALID;
+	}
+	
+	log_latest[type] = 0;
+	log_latest_seq[type] = 0;
+	return LOG_SLOT_EMPTY;
+}
+
+static bool EEPROM_Log_Write(uint8_t type, const void *data, uint8_t length)
+{
+	log_record_t rec;
+	uint16_t slot;
+	
+	memset(&rec, 0xFF, sizeof(rec));
+	rec.seq = log_head_seq ? log_head_seq + 1 : EEPROM_LOG_SLOTS;	// 첫 Record는 Slot 0 (lap 1)
+	rec.length = length;
+	rec.type = type;
+	memcpy(rec.payload, data, length);
+	rec.crc = EEPROM_Log_Crc(&rec);
+	
+	slot = (uint16_t)(rec.seq % EEPROM_LOG_SLOTS);
+	if (!D24FC512_Write_Address_Page(EEPROM_Log_Address(slot), (uint8_t *)&rec, sizeof(rec)))
+		return false;		// head를 옮기지 않으므로 다음 Append가 같은 Slot에 다시 쓴다.
+	
+	log_head_seq = rec.seq;
+	log_latest[type] = slot;
+	log_latest_seq[type] = rec.seq;
+	return true;
+}
+
+bool EEPROM_Log_Append(uint8_t type, const void *data, uint8_t length)
+{
+	log_record_t victim;
+	log_slot_t r;
+	uint32_t out;
+	
+	if (!log_mounted || type >= EEPROM_LOG_TYPES || length > EEPROM_LOG_PAYLOAD_MAX)
+		return false;
+	
+	/*
+	 * 새 Record(seq = head + 1)를 쓰면 seq = head + 1 - WINDOW 가 창 밖으로 나간다.
+	 * 그것이 자기 type의 최신 값이면 먼저 복사한다. 복사도 Record 하나를 밀어내므로 반복한다.
+	 * (최대 EEPROM_LOG_TYPES번)
+	 * 밀려날 Record를 읽지 못했으면(Bus 에러) 최신 값인지 알 수 없으므로 아무것도 쓰지 않고 실패한다.
+	 */
+	while (log_head_seq + 1 >= (uint32_t)EEPROM_LOG_WINDOW + EEPROM_LOG_SLOTS)
+	{
+		out = log_head_seq + 1 - EEPROM_LOG_WINDOW;
+		r = EEPROM_Log_ReadSlot((uint16_t)(out % EEPROM_LOG_SLOTS), &victim);
+		if (r == LOG_SLOT_ERROR)
+			return false;
+		if (r == LOG_SLOT_EMPTY || victim.seq != out)
+			break;
+		if (victim.type == type)
+			break;		// 곧 새 값이 들어오므로 복사할 필요 없음
+		r = EEPROM_Log_Find(victim.type, &victim);
+		if (r == LOG_SLOT_ERROR)
+			return false;
+		if (r == LOG_SLOT_EMPTY || log_latest_seq[victim.type] != out)
+			break;		// 더 새로운 값이 있다 → 그냥 버린다.
+		if (!EEPROM_Log_Write(victim.type, victim.payload, victim.length))
+			return false;
+	}
+	
+	return EEPROM_Log_Write(type, data, length);
+}
+
+bool EEPROM_Log_ReadLatest(uint8_t type, void *data, uint8_t *length)
+{
+	log_record_t rec;
+	
+	if (!log_mounted || type >= EEPROM_LOG_TYPES || EEPROM_Log_Find(type, &rec) != LOG_SLOT_VALID)
+		return false;
+	
+	memcpy(data, rec.payload, rec.length);
+	if (length)
+		*length = rec.length;
+	return true;
+}
+
+uint32_t EEPROM_Log_HeadSeq(void)
+{
+	return log_head_seq;
+}
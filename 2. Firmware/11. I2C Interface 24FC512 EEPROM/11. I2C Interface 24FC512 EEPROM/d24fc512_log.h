@@ -0,0 +1,61 @@
+﻿#ifndef D24FC512_LOG_H_
+#define D24FC512_LOG_H_
+
+/*
+ * #RecordLog #WearLeveling #FastMount
+ *
+ * 고정 주소에 값을 덮어쓰면 그 Cell만 계속 Write Cycle을 소모한다.
+ * Record Log는 값을 바꿀 때마다 새 Record를 다음 Slot에 "추가"하고,
+ * Slot을 원형으로 돌려 쓰므로 모든 Slot이 고르게 한 번씩 쓰인다.
+ *
+ * Slot 구조 (32byte, Page 안에 4개씩 정렬 → Record 하나가 Page Write 한 번)
+ *   seq(4) length(1) type(1) payload(24) crc16(2)
+ *
+ *   - seq는 1씩 증가하고 항상 slot = seq % EEPROM_LOG_SLOTS 에 기록한다.
+ *     lap = seq / EEPROM_LOG_SLOTS 로 두면 Slot 0 ~ head는 이번 lap, 그 뒤는 이전 lap이다.
+ *   - CRC가 맞지 않는 Slot(쓰던 중 전원 차단 등)은 없는 Record로 본다.
+ *
+ * #Mount
+ * "valid && lap == Slot 0의 lap" 은 Slot 0 ~ head 에서 참, 그 뒤에서 거짓이므로
+ * 이진 탐색으로 head를 찾는다. (1016 Slot → Record Read 약 10번)
+ *
+ * #GarbageCollection
+ * 최근 EEPROM_LOG_WINDOW 개의 Record만 유효하다. 새 Record를 쓰기 전에, 창 밖으로 밀려날
+ * Record가 그 type의 최신 값이면 먼저 head에 복사(Copy-forward)한다.
+ * 복사본이 완전히 써진 뒤에야 원본이 창 밖으로 나가므로 어느 시점에 전원이 꺼져도
+ * type별 최신 값 하나는 항상 남는다. (밀려나는 원본은 head 바로 다음 Slot이라 아직 덮어쓰이지 않았다)
+ *
+ * 주의) Log 영역은 D24FC512_* / EEPROM_Cache_* 로 직접 쓰지 않는다.
+ */
+
+#define EEPROM_LOG_START         0x0100UL                 // 0x0000 ~ 0x00FF은 설정 영역으로 남긴다.
+#define EEPROM_LOG_END           0x8000UL                 // 0x8000 ~ 은 Sample Archive. Slot 수가 바뀌면 기존 Log를 Mount할 수 없으므로 고정
+#define EEPROM_LOG_SLOT_SIZE     32
+#define EEPROM_LOG_SLOTS         ((uint16_t)((EEPROM_LOG_END - EEPROM_LOG_START) / EEPROM_LOG_SLOT_SIZE))
+#define EEPROM_LOG_WINDOW        (EEPROM_LOG_SLOTS - 1)
+#define EEPROM_LOG_PAYLOAD_MAX   (EEPROM_LOG_SLOT_SIZE - 8)
+#define EEPROM_LOG_TYPES         8                        // type 0 ~ 7
+
+/*
+ * Log 영역에서 head를 찾는다. 기록된 Record가 있으면 true.
+ * 다른 함수보다 먼저 한 번 호출해야 한다.
+ * Bus 에러로 끝까지 읽지 못하면 false이고, 다시 Mount할 때까지 Append/ReadLatest도 false가 된다.
+ * (head를 모르는 채로 쓰면 살아 있는 Record를 덮어쓸 수 있다)
+ */
+bool EEPROM_Log_Mount(void);
+
+/*
+ * type의 새 값을 추가한다. (length <= EEPROM_LOG_PAYLOAD_MAX, Blocking)
+ * Bus 에러(Copy-forward 포함)면 false. 이미 써진 Record는 유효하고, 실패한 Slot은 다음 Append가 다시 쓴다.
+ */
+bool EEPROM_Log_Append(uint8_t type, const void *data, uint8_t length);
+
+/*
+ * type의 가장 최근 값을 읽는다. 없으면 false.
+ * 처음 찾을 때만 head부터 거꾸로 찾고, 이후에는 RAM에 기억한 Slot을 바로 읽는다.
+ */
+bool EEPROM_Log_ReadLatest(uint8_t type, void *data, uint8_t *length);
+
+uint32_t EEPROM_Log_HeadSeq(void);      // 마지막 Record의 seq (없으면 0)
+
+#endif /* D24FC512_LOG_H_ */
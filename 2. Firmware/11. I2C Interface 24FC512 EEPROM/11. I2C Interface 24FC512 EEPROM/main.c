@@ -2,26 +2,26 @@
 
 /*
  * #I2C #EEPROM #D24FC512
- * #SignCheck #BootSequence
+ * #ConfigSlot #BootSequence
  *
  * 본 장에서는 외부 EEPROM(D24FC512)에 접근하여
- * 시스템 최초 동작(Sign)을 확인하고,
+ * 저장된 설정값이 있는지 확인하고,
  * 정상적인 값이 없을 경우 초기화 값을 기록하는 예제를 다룬다.
  *
  * EEPROM은 단순히 읽기/쓰기 외에도
  * "시스템 상태 유지" 또는 "부팅 시 설정값 로드" 같은 역할을 수행한다.
  *
- * 본 예제에서는 Sign(0xAA55)을 EEPROM에 저장하여
+ * 본 예제에서는 설정값(buttonCount 등)을 A/B 두 Slot에 CRC와 함께 저장하여
  * 시스템이 첫 실행인지, 이미 저장된 값이 있는지를 판단한다.
  *
- * Sign 값이 존재하면 버튼 값(buttonCount 등)을 읽고,
- * Sign 값이 없으면 EEPROM을 초기 상태로 구성한다.
+ * 유효한 Slot이 있으면 설정값을 읽고,
+ * 없으면 기본값으로 EEPROM을 초기 상태로 구성한다.
  *
- * EEPROM Address	Stored Byte
- * 0x00	0xAA
- * 0x01	0x55
+ * EEPROM Address	Stored
+ * 0x0000 ~ 0x007F	Config Slot A
+ * 0x0080 ~ 0x00FF	Config Slot B
  *
- * callback) main() 내부의 Sign Check 부분을 먼저 보자.
+ * callback) main() 내부의 Config Load 부분을 먼저 보자.
  */
 
 #include <avr/io.h>
@@ -32,71 +32,184 @@
 
 #include "i2c.h"
 #include "d24fc512.h"
+#include "d24fc512_cache.h"
+#include "d24fc512_config.h"
+#include "d24fc512_log.h"
+#include "d24fc512_archive.h"
 #include "uart.h"
 
 /*
  * EEPROM 내부 주소 구성
  *
- * D24F512_SIGN_ADDRESS     : 시스템 부팅 Sign 저장 (2 byte)
- * D24F512_BUTTON_ADDRESS   : 버튼 Count 저장 (2 byte)
+ * 0x0000 ~ 0x00FF : 설정값 A/B Slot (d24fc512_config.h 참고)
+ * 0x0100 ~ 0x7FFF : Record Log (d24fc512_log.h 참고)
+ * 0x8000 ~ 0xFFFF : Sample Archive (d24fc512_archive.h 참고)
  *
  * EEPROM은 주소 단위로 Read/Write가 가능하므로
  * 프로젝트 요구사항에 따라 구조를 자유롭게 설계할 수 있다.
  *
  * callback) main()에서 Read/Write 동작을 보자.
  */
-#define D24F512_SIGN_ADDRESS    0x00   // 0x00 ~ 0x01
+typedef struct
+{
+	uint16_t buttonCount;
+	uint8_t  ledMode;
+} app_config_t;
+
+#define APP_CONFIG_VERSION      1
+
+/*
+ * Record Log type (0x0100 ~ 0x7FFF 영역)
+ * 자주 바뀌는 값은 고정 주소 대신 Log에 추가하여 Cell 수명을 고르게 쓴다.
+ */
+#define LOG_TYPE_BOOT_COUNT     0
 
 void CLK_Init(void);
+void TCB0_Init(void);
+
+// Archive 질의 결과를 UART로 바로 내보낸다.
+static void Archive_PrintSample(uint32_t time, const int16_t *value)
+{
+	printf("%lu : %d %d %d %d\r\n", (unsigned long)time, value[0], value[1], value[2], value[3]);
+}
+
+static void Archive_PrintBucket(uint32_t time, const int16_t *min, const int16_t *max)
+{
+	printf("%lu : max %d %d %d %d\r\n", (unsigned long)time, max[0], max[1], max[2], max[3]);
+}
 
 /*
  * #MainRoutine
- * #EEPROM_SignCheck
+ * #EEPROM_ConfigLoad
  *
  * 1) I2C_Init()  
  *    → 외부 EEPROM 접근을 위한 TWI/I2C 초기화.
  *
- * 2) EEPROM Sign 값 확인  
- *    - Sign 값이 0xAA55 라면 이미 시스템이 부팅된 적이 있다는 의미이다.
- *      → 버튼 값을 EEPROM에서 읽어온다.
+ * 2) EEPROM 설정값 확인  
+ *    - CRC가 맞는 Slot이 있다면 이미 시스템이 부팅된 적이 있다는 의미이다.
+ *      → 설정값을 EEPROM에서 읽어온다.
  *
- *    - Sign 값이 다르면 (초기값이거나, 메모리 초기화된 상태)
- *      → Sign(0xAA55) 값을 쓰고, 버튼 값을 0x00으로 초기화한다.
+ *    - 유효한 Slot이 없으면 (초기값이거나, 메모리 초기화된 상태)
+ *      → 기본값(버튼 값 0x00)을 저장한다.
+ *
+ *    - Bus 에러로 읽지 못했으면
+ *      → 기본값으로 동작하되 저장하지 않는다. (저장된 설정을 덮어쓰지 않도록)
  *
  * EEPROM은 전원이 꺼져도 값이 유지되므로
  * MCU가 재부팅되거나 전원이 꺼져도 설정값/카운트값을 보존할 수 있다.
  *
- * callback) D24FC512_Read_Address_Uint16(), D24FC512_Write_Address_Uint16()을 참고하자.
+ * callback) EEPROM_Config_Load(), EEPROM_Config_Save()를 참고하자.
  */
 int main(void)
 {
 	CLK_Init();
-	
+	TCB0_Init();	// I2C Watchdog (1ms)
     I2C_Init();
 	
 	USART0_Init(115200);
+	EEPROM_Cache_Init();
 	
 	sei();
+	
+	// 버스에 연결된 Slave 확인 (DS1621 0x48, 24FC512 0x50, PCF8563 0x51)
+	{
+		uint8_t found[8], n, i;
+		
+		n = I2C_ScanBus(found, sizeof(found));
+		printf("I2C scan :");
+		for (i = 0; i < n; i++) printf(" 0x%02X", found[i]);
+		printf("\r\n");
+	}
+	
 	printf("register memory!!\r\n");
 	printf("0x00 : %x\r\n",D24FC512_Read_Address_Uint8(0x00));
 	printf("0x01 : %x\r\n",D24FC512_Read_Address_Uint8(0x01));
 	printf("0x02 : %x\r\n",D24FC512_Read_Address_Uint8(0x02));
 	printf("0x03 : %x\r\n",D24FC512_Read_Address_Uint8(0x03));
-	// Write 이후에 _delay_ms(5) 가 필요하다.
+	// Write 함수는 ACK Polling으로 Write Cycle 완료까지 기다린 뒤 리턴한다.
+	
+	{
+		app_config_t config = { 0 };
+		eeprom_config_result_t result;
+		uint8_t version;
+		
+		result = EEPROM_Config_Load(&config, sizeof(config), &version);
+		if (result == EEPROM_CONFIG_VALID && version == APP_CONFIG_VERSION)
+		{
+			// 저장된 설정값 읽기
+			printf("Already Exist!!\r\n");
+			printf("buttonCount : %u, ledMode : %u\r\n", config.buttonCount, config.ledMode);
+		}
+		else if (result == EEPROM_CONFIG_ERROR)
+		{
+			// 읽지 못했을 뿐 저장된 설정이 있을 수 있으므로 기본값으로 동작만 한다.
+			printf("EEPROM Read Error!!\r\n");
+			config.buttonCount = 0;
+			config.ledMode = 0;
+		}
+		else
+		{
+			// 기본값 신규 기록
+			printf("Empty Memory!!\r\n");
+			config.buttonCount = 0;
+			config.ledMode = 0;
+			EEPROM_Config_Save(&config, sizeof(config), APP_CONFIG_VERSION);
+		}
+	}
+	
+	
+	// 부팅 횟수 : 최신 값을 읽고 +1 한 값을 새 Record로 추가
+	{
+		uint32_t bootCount = 0;
+		
+		EEPROM_Log_Mount();
+		EEPROM_Log_ReadLatest(LOG_TYPE_BOOT_COUNT, &bootCount, NULL);
+		bootCount++;
+		EEPROM_Log_Append(LOG_TYPE_BOOT_COUNT, &bootCount, sizeof(bootCount));
+		printf("boot count : %lu (log seq %lu)\r\n", (unsigned long)bootCount, (unsigned long)EEPROM_Log_HeadSeq());
+	}
+	
+	
+	// Sample Archive : 센서 보드가 EEPROM_Archive_Append()로 쌓은 기록을 질의한다.
+	{
+		uint32_t last;
+		
+		EEPROM_Archive_Mount();
+		if (EEPROM_Archive_LastTime(&last))
+		{
+			printf("hourly max (last 24h)\r\n");
+			if (!EEPROM_Archive_Aggregate(last > 86400UL ? last - 86400UL : 0, last, 3600UL, Archive_PrintBucket))
+				printf("archive read error\r\n");
+			printf("samples (last 10min)\r\n");
+			if (!EEPROM_Archive_Query(last > 600UL ? last - 600UL : 0, last, Archive_PrintSample, NULL))
+				printf("archive read error\r\n");
+		}
+	}
+	
 	
-    if (D24FC512_Read_Address_Uint16(D24F512_SIGN_ADDRESS) == 0xaa55)
-    {
-		// 저장된 버튼 값 읽기
-		printf("Already Exist!!\r\n");
-		printf("D24F512_SIGN_ADDRESS : %x\r\n",D24FC512_Read_Address_Uint16(D24F512_SIGN_ADDRESS));
-    }
-    else
-    {
-		// Sign 값 신규 기록
-		printf("Empty Memory!!\r\n");
-	    D24FC512_Write_Address_Uint16(D24F512_SIGN_ADDRESS, 0xaa55);
-    }
-    while (1) { }
+	// 처음 256byte 덤프 : UART로 한 버퍼를 보내는 동안 다음 버퍼를 I2C로 읽는다.
+	{
+		static d24fc512_stream_t stream;
+		const uint8_t *p;
+		uint16_t n, i, addr = 0;
+		
+		D24FC512_Stream_Open(&stream, 0x0000, 256);
+		while (!D24FC512_Stream_Done(&stream))
+		{
+			if ((n = D24FC512_Stream_Get(&stream, &p)) == 0)
+				continue;
+			for (i = 0; i < n; i++, addr++)
+				printf((addr & 0x0F) == 0x0F ? "%02X\r\n" : "%02X ", p[i]);
+			D24FC512_Stream_Release(&stream);
+		}
+	}
+	
+	I2C_DumpStats();
+    while (1)
+	{
+		I2C_Task();				// Bus Error/Timeout 뒤의 Bus Recovery
+		EEPROM_Cache_Task();	// 작은 Write들은 Cache에 모였다가 Idle 후 Page Write 한 번으로 기록된다.
+	}
 }
 
 void CLK_Init(void)
@@ -104,3 +217,18 @@ void CLK_Init(void)
     CCP = CCP_IOREG_gc;  
     CLKCTRL.MCLKCTRLB = CLKCTRL_PDIV_4X_gc | CLKCTRL_PEN_bm;
 }
+
+void TCB0_Init(void)
+{
+	TCB0.CCMP = 5000;
+	TCB0.CTRLA |= TCB_ENABLE_bm;
+	TCB0.INTCTRL |= TCB_CAPT_bm;
+}
+
+ISR(TCB0_INT_vect)
+{
+	I2C_TickISR();
+	EEPROM_Cache_TickISR();
+	
+	TCB0.INTFLAGS |= TCB_CAPT_bm;
+}
\ No newline at end of file
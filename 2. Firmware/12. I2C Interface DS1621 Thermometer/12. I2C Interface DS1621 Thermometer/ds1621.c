@@ -3,9 +3,13 @@
 #include <avr/interrupt.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <util/delay.h>
 #include "i2c.h"
 #include "ds1621.h"
 
+static i2c_xfer_t ds1621_xfer;
+static uint8_t    ds1621_buf[2];
+static bool       ds1621_pending = false;
 
 void DS1621_START_CONVERT_T(void)
 {
@@ -16,17 +20,387 @@ uint16_t DS1621_READ_TEMPERATURE(void)
 	return I2C_Read_Cmd_Uint16(DS1621_SLAVE_ADDRESS, READ_TEMPERATURE);
 }
 
-void DS1621_SetHighLimit(uint8_t HighLimit)
+// 내부 EEPROM Write 중에는 NVB = 1
+static void DS1621_WaitNV(void)
 {
-	I2C_Write_Cmd_Uint8( DS1621_SLAVE_ADDRESS, ACCESS_TH, HighLimit);
+	uint8_t n;
+	
+	for (n = 0; n < DS1621_NV_WRITE_MS; n++)
+	{
+		if (!(DS1621_ReadConfig() & DS1621_CFG_NVB))
+			break;
+		_delay_ms(1);
+	}
 }
 
-void DS1621_SetLowLimit(uint8_t LowLimit)
+/*
+ * half-degree ↔ 9bit 2의 보수 2byte
+ *   MSB = half >> 1 (산술 Shift, 정수부), LSB bit7 = half & 1 (0.5°C)
+ *   예) -1 (-0.5°C) → 0xFF 0x80 (-1 + 0.5)
+ */
+static void DS1621_WriteLimit(uint8_t cmd, int16_t halfDegree)
 {
-	I2C_Write_Cmd_Uint8( DS1621_SLAVE_ADDRESS, ACCESS_TL, LowLimit);
+	uint16_t data = ((uint16_t)(uint8_t)(halfDegree >> 1) << 8) | ((halfDegree & 1) ? 0x80 : 0x00);
+	
+	I2C_Write_Cmd_Uint16(DS1621_SLAVE_ADDRESS, cmd, data);
+	DS1621_WaitNV();
+}
+
+static int16_t DS1621_ReadLimit(uint8_t cmd)
+{
+	return (int16_t)I2C_Read_Cmd_Uint16(DS1621_SLAVE_ADDRESS, cmd) >> 7;
+}
+
+void DS1621_SetHighLimit(int16_t halfDegree)
+{
+	DS1621_WriteLimit(ACCESS_TH, halfDegree);
+}
+
+void DS1621_SetLowLimit(int16_t halfDegree)
+{
+	DS1621_WriteLimit(ACCESS_TL, halfDegree);
+}
+
+int16_t DS1621_GetHighLimit(void)
+{
+	return DS1621_ReadLimit(ACCESS_TH);
+}
+
+int16_t DS1621_GetLowLimit(void)
+{
+	return DS1621_ReadLimit(ACCESS_TL);
+}
+
+uint8_t DS1621_ReadConfig(void)
+{
+	return I2C_Read_Cmd_Uint8(DS1621_SLAVE_ADDRESS, ACCESS_CONFIG);
+}
+
+void DS1621_WriteConfig(uint8_t config)
+{
+	I2C_Write_Cmd_Uint8(DS1621_SLAVE_ADDRESS, ACCESS_CONFIG, config & (DS1621_CFG_THF | DS1621_CFG_TLF | DS1621_CFG_POL | DS1621_CFG_1SHOT));
+	DS1621_WaitNV();
+}
+
+// mask bit를 value로 바꾼다. 이미 같으면 쓰지 않는다. (내부 EEPROM 수명)
+static void DS1621_UpdateConfig(uint8_t mask, bool value)
+{
+	uint8_t config = DS1621_ReadConfig();
+	uint8_t next = value ? (config | mask) : (config & ~mask);
+	
+	if (next != config)
+		DS1621_WriteConfig(next);
+}
+
+void DS1621_SetPolarity(bool activeHigh)
+{
+	DS1621_UpdateConfig(DS1621_CFG_POL, activeHigh);
+}
+
+void DS1621_SetOneShot(bool oneShot)
+{
+	DS1621_UpdateConfig(DS1621_CFG_1SHOT, oneShot);
 }
 
 void DS1621_STOP_CONVERT_T(void)
 {
 	I2C_Write_Command(DS1621_SLAVE_ADDRESS, STOP_CONVERT_T);
-}
\ No newline at end of file
+}
+
+/*
+ * 0.5°C bit는 버리고(TEMP_READ) Counter/Slope로 소수부를 다시 구한다.
+ * Slope가 0이면(변환 전 등) 0.5°C 해상도 값을 그대로 쓴다.
+ */
+static int16_t DS1621_CentiDegree(uint16_t raw, uint8_t remain, uint8_t slope)
+{
+	int16_t centi = (int16_t)(int8_t)(raw >> 8) * 100;
+	
+	if (slope == 0)
+		return centi + ((raw & 0x80) ? 50 : 0);
+	
+	return centi - 25 + ((int16_t)slope - remain) * 100 / slope;
+}
+
+/*
+ * READ_TEMPERATURE, READ_COUNTER, READ_SLOPE를 한 트랜잭션으로 읽는 Segment.
+ * 명령마다 방향이 바뀌므로 Repeated START 5번, STOP 1번으로 끝난다.
+ * rx = { TEMP MSB, TEMP LSB, COUNT_REMAIN, SLOPE }
+ */
+static uint8_t ds1621_hr_cmd[3] = { READ_TEMPERATURE, READ_COUNTER, READ_SLOPE };
+
+static void DS1621_HighResSegments(i2c_segment_t *seg, uint8_t *rx)
+{
+	uint8_t i;
+	
+	for (i = 0; i < 3; i++)
+	{
+		seg[2 * i].buffer = &ds1621_hr_cmd[i];
+		seg[2 * i].length = 1;
+		seg[2 * i].flags = I2C_SEG_WRITE;
+		seg[2 * i + 1].buffer = rx;
+		seg[2 * i + 1].length = (i == 0) ? 2 : 1;
+		seg[2 * i + 1].flags = I2C_SEG_READ;
+		rx += seg[2 * i + 1].length;
+	}
+}
+
+static uint16_t DS1621_HighResDecode(const uint8_t *rx, int16_t *centi)
+{
+	uint16_t raw = ((uint16_t)rx[0] << 8) | rx[1];
+	
+	*centi = DS1621_CentiDegree(raw, rx[2], rx[3]);
+	return raw;
+}
+
+bool DS1621_ReadHighRes(int16_t *centi, uint16_t *raw)
+{
+	i2c_segment_t seg[6];
+	uint8_t rx[4];
+	uint16_t value;
+	
+	DS1621_HighResSegments(seg, rx);
+	if (I2C_Transaction(DS1621_SLAVE_ADDRESS, seg, 6) != I2C_NOERROR)
+		return false;
+	
+	value = DS1621_HighResDecode(rx, centi);
+	if (raw)
+		*raw = value;
+	return true;
+}
+
+bool DS1621_RequestTemperature(void)
+{
+	if (ds1621_pending)
+		return false;
+	
+	I2C_Xfer_Prepare(&ds1621_xfer, DS1621_SLAVE_ADDRESS, READ_TEMPERATURE, 1, ds1621_buf, 2, I2C_XFER_READ);
+	ds1621_xfer.priority = DS1621_I2C_PRIORITY;
+	ds1621_pending = I2C_Submit(&ds1621_xfer);
+	return ds1621_pending;
+}
+
+bool DS1621_GetTemperature(uint16_t *temp)
+{
+	if (!ds1621_pending || ds1621_xfer.status == I2C_BUSY)
+		return false;
+	
+	ds1621_pending = false;
+	if (ds1621_xfer.status != I2C_NOERROR)
+		return false;
+	
+	*temp = ((uint16_t)ds1621_buf[0] << 8) | ds1621_buf[1];
+	return true;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+#define SMP_IDLE		0
+#define SMP_START		1
+#define SMP_CONVERT		2
+#define SMP_POLL		3
+#define SMP_READ		4
+
+static i2c_xfer_t       smp_xfer;
+static i2c_segment_t    smp_seg[6];
+static uint8_t          smp_cmd;
+static uint8_t          smp_rx[4];
+static uint8_t          smp_state = SMP_IDLE;
+static uint8_t          smp_polls;
+static volatile uint16_t smp_period = 0;	// 다음 변환 시작까지 [ms]
+static volatile uint16_t smp_wait = 0;		// 변환 대기 [ms]
+static ds1621_sample_t  smp_cache = { 0, 0, 0 };
+
+static void DS1621_Sampler_Submit(uint8_t cmd, uint8_t rxLength)
+{
+	smp_cmd = cmd;
+	smp_seg[0].buffer = &smp_cmd;
+	smp_seg[0].length = 1;
+	smp_seg[0].flags = I2C_SEG_WRITE;
+	smp_seg[1].buffer = smp_rx;
+	smp_seg[1].length = rxLength;
+	smp_seg[1].flags = I2C_SEG_READ;
+	
+	I2C_Xfer_Segments(&smp_xfer, DS1621_SLAVE_ADDRESS, smp_seg, rxLength ? 2 : 1);
+	smp_xfer.priority = DS1621_I2C_PRIORITY;
+	I2C_Submit(&smp_xfer);
+}
+
+// 16bit 남은 시간은 TickISR이 중간에 바꿀 수 있으므로 인터럽트를 막고 한 번에 읽는다.
+static uint16_t DS1621_Sampler_Remaining(volatile uint16_t *ms)
+{
+	uint16_t remaining;
+	uint8_t sreg = SREG;
+	
+	cli();
+	remaining = *ms;
+	SREG = sreg;
+	return remaining;
+}
+
+static void DS1621_Sampler_Wait(uint16_t ms)
+{
+	cli();
+	smp_wait = ms;
+	sei();
+}
+
+void DS1621_Sampler_Init(void)
+{
+	// Counter/Slope가 변환 결과와 맞도록 1SHOT 모드로 둔다. (이미 그렇다면 쓰지 않는다)
+	DS1621_SetOneShot(true);
+	
+	smp_state = SMP_IDLE;
+	cli();
+	smp_period = 0;
+	smp_cache.seq = 0;
+	sei();
+}
+
+void DS1621_Sampler_TickISR(void)
+{
+	if (smp_period) smp_period--;
+	if (smp_wait) smp_wait--;
+}
+
+void DS1621_Sampler_Task(void)
+{
+	uint16_t raw;
+	int16_t centi;
+	
+	if (smp_state != SMP_IDLE && smp_state != SMP_CONVERT && smp_xfer.status == I2C_BUSY)
+		return;
+	
+	switch (smp_state)
+	{
+		case SMP_IDLE:
+			if (DS1621_Sampler_Remaining(&smp_period))
+				return;
+			cli();
+			smp_period = DS1621_SAMPLE_PERIOD_MS;
+			sei();
+			DS1621_Sampler_Submit(START_CONVERT_T, 0);
+			smp_state = SMP_START;
+			break;
+		
+		case SMP_START:
+			if (smp_xfer.status != I2C_NOERROR)
+			{
+				smp_state = SMP_IDLE;	// 다음 주기에 다시
+				break;
+			}
+			smp_polls = 0;
+			DS1621_Sampler_Wait(DS1621_CONVERT_MS);
+			smp_state = SMP_CONVERT;
+			break;
+		
+		case SMP_CONVERT:
+			if (DS1621_Sampler_Remaining(&smp_wait))
+				return;
+			DS1621_Sampler_Submit(ACCESS_CONFIG, 1);
+			smp_state = SMP_POLL;
+			break;
+		
+		case SMP_POLL:
+			if (smp_xfer.status != I2C_NOERROR || ++smp_polls > DS1621_POLL_MAX)
+			{
+				smp_state = SMP_IDLE;
+				break;
+			}
+			if (!(smp_rx[0] & DS1621_CFG_DONE))
+			{
+				DS1621_Sampler_Wait(DS1621_POLL_MS);
+				smp_state = SMP_CONVERT;
+				break;
+			}
+			DS1621_HighResSegments(smp_seg, smp_rx);
+			I2C_Xfer_Segments(&smp_xfer, DS1621_SLAVE_ADDRESS, smp_seg, 6);
+			smp_xfer.priority = DS1621_I2C_PRIORITY;
+			I2C_Submit(&smp_xfer);
+			smp_state = SMP_READ;
+			break;
+		
+		case SMP_READ:
+			if (smp_xfer.status == I2C_NOERROR)
+			{
+				raw = DS1621_HighResDecode(smp_rx, &centi);
+				cli();
+				smp_cache.centi = centi;
+				smp_cache.raw = raw;
+				if (++smp_cache.seq == 0)
+					smp_cache.seq = 1;
+				sei();
+			}
+			smp_state = SMP_IDLE;
+			break;
+	}
+}
+
+bool DS1621_GetSample(ds1621_sample_t *sample)
+{
+	uint8_t sreg = SREG;
+	
+	cli();
+	*sample = smp_cache;
+	SREG = sreg;
+	return sample->seq != 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+static volatile bool     alarm_event = false;
+static volatile bool     alarm_active = false;
+static ds1621_alarm_cb_t alarm_cb = NULL;
+
+void DS1621_Alarm_Init(int16_t highHalf, int16_t lowHalf, ds1621_alarm_cb_t cb)
+{
+	DS1621_SetHighLimit(highHalf);
+	DS1621_SetLowLimit(lowHalf);
+	DS1621_SetPolarity(true);		// TOUT Active High
+	
+	alarm_cb = cb;
+	
+	DS1621_TOUT_PORT.DIRCLR = (1 << DS1621_TOUT_PIN);
+	DS1621_TOUT_PORT.DS1621_TOUT_PINCTRL = PORT_ISC_BOTHEDGES_gc;
+	DS1621_TOUT_PORT.INTFLAGS = (1 << DS1621_TOUT_PIN);
+	
+	cli();
+	alarm_active = DS1621_Alarm_Active();
+	alarm_event = alarm_active;		// 이미 Active라면 바로 알린다.
+	sei();
+}
+
+bool DS1621_Alarm_Active(void)
+{
+	return (DS1621_TOUT_PORT.IN & (1 << DS1621_TOUT_PIN)) != 0;
+}
+
+bool DS1621_Alarm_Event(bool *active)
+{
+	bool event;
+	uint8_t sreg = SREG;
+	
+	cli();
+	event = alarm_event;
+	alarm_event = false;
+	*active = alarm_active;
+	SREG = sreg;
+	return event;
+}
+
+void DS1621_Alarm_PinISR(void)
+{
+	bool active;
+	
+	if (DS1621_TOUT_PORT.INTFLAGS & (1 << DS1621_TOUT_PIN))
+	{
+		DS1621_TOUT_PORT.INTFLAGS = (1 << DS1621_TOUT_PIN);
+		
+		active = DS1621_Alarm_Active();
+		if (active != alarm_active)
+		{
+			alarm_active = active;
+			alarm_event = true;
+			if (alarm_cb)
+				alarm_cb(active);
+		}
+	}
+}
@@ -2,6 +2,7 @@
 #define DS1621_H_
 
 #define DS1621_SLAVE_ADDRESS 0x48
+#define DS1621_I2C_PRIORITY I2C_PRIO_HIGH // 비동기 Read의 I2C 큐 priority
 
 #define START_CONVERT_T 0xEE // 온도 변환 시작 명령
 #define READ_TEMPERATURE 0xAA // 온도 값을 읽어오는 명령
@@ -11,24 +12,157 @@
 
 #define STOP_CONVERT_T 0x22 // 온도 변환 중단 명령
 
-// Tout Pin을 통해 온도 인터럽트가 발생한다.
+// TOUT Pin을 통해 온도 인터럽트가 발생한다. (아래 #TOUT 참고)
 #define ACCESS_TH 0xA1 // 온도 경계 레지스터 High Limit
 #define ACCESS_TL 0xA2 // 온도 경계 레지스터 Low Limit
 
-/* 
- * 변경할 일이 없을 것 같아서 함수 구현은 안했다.
- * Bit 2 : High → 온도 1회 변환(One-Shot)
- * Bit 1 : Low  → Tout 핀 High Idle 상태
- * Bit 0 : Low  → Comparator 모드(TH/TL 벗어나면 즉시 Active)
+/*
+ * #ConfigRegister
+ * Bit 7 : DONE  → 1 = 변환 완료 (읽기 전용)
+ * Bit 6 : THF   → 온도가 TH 이상이 된 적 있음 (0을 써서 지운다)
+ * Bit 5 : TLF   → 온도가 TL 이하가 된 적 있음 (0을 써서 지운다)
+ * Bit 4 : NVB   → 1 = 내부 EEPROM(TH/TL/CONFIG) 기록 중 (최대 10ms, 읽기 전용)
+ * Bit 1 : POL   → TOUT 출력 극성 (1 = Active High)
+ * Bit 0 : 1SHOT → 1 = START_CONVERT_T마다 1회 변환, 0 = 연속 변환
+ * POL, 1SHOT은 DS1621 내부 EEPROM에 저장되므로 값이 바뀔 때만 쓴다.
  */
 #define ACCESS_CONFIG 0xAC // 동작 모드 설정
 
+#define DS1621_CFG_DONE  0x80
+#define DS1621_CFG_THF   0x40
+#define DS1621_CFG_TLF   0x20
+#define DS1621_CFG_NVB   0x10
+#define DS1621_CFG_POL   0x02
+#define DS1621_CFG_1SHOT 0x01
+
+#define DS1621_NV_WRITE_MS 10   // 내부 EEPROM Write 시간 (최대)
+
 void DS1621_START_CONVERT_T(void);
 uint16_t DS1621_READ_TEMPERATURE(void);
 
 void DS1621_STOP_CONVERT_T(void);
 
-void DS1621_SetHighLimit(uint8_t);
-void DS1621_SetLowLimit(uint8_t);
+/*
+ * #Thermostat #TH_TL
+ * TH/TL은 온도 Register와 같은 9bit 2의 보수 (MSB = 정수부, LSB bit7 = 0.5°C) 2byte이다.
+ * 값은 0.5°C 단위 정수(half-degree)로 주고 받는다.
+ *   예) 30.5°C → 61, -10.0°C → -20
+ * TOUT은 온도 >= TH 에서 Active, 온도 <= TL 에서 Inactive가 된다. (TL ~ TH 사이는 Hysteresis)
+ * 내부 EEPROM에 저장되므로 Write 후 NVB가 0이 될 때까지 기다린다.
+ */
+#define DS1621_HALF(deg)    ((int16_t)((deg) * 2))     // 정수/상수 온도 → half-degree
+
+void DS1621_SetHighLimit(int16_t halfDegree);
+void DS1621_SetLowLimit(int16_t halfDegree);
+int16_t DS1621_GetHighLimit(void);
+int16_t DS1621_GetLowLimit(void);
+
+/*
+ * DS1621_SetPolarity() : true = TOUT Active High (POL = 1)
+ * DS1621_SetOneShot()  : true = 1SHOT, false = 연속 변환
+ * 둘 다 값이 실제로 바뀔 때만 Config Register를 쓴다.
+ */
+void DS1621_SetPolarity(bool activeHigh);
+void DS1621_SetOneShot(bool oneShot);
+
+/*
+ * DS1621_ReadConfig()  : Config Register를 읽는다.
+ * DS1621_WriteConfig() : POL, 1SHOT, THF, TLF를 쓴다. (DONE, NVB는 무시된다)
+ *                        내부 EEPROM Write가 끝날 때까지(NVB = 0) 기다린 뒤 리턴한다.
+ */
+uint8_t DS1621_ReadConfig(void);
+void DS1621_WriteConfig(uint8_t config);
+
+/*
+ * #HighResolution #FixedPoint
+ * DS1621_ReadHighRes() : READ_TEMPERATURE(2byte), READ_COUNTER(1byte), READ_SLOPE(1byte)를
+ *                        Repeated START로 이은 트랜잭션 하나로 읽고, 0.01°C 단위 정수로 돌려준다.
+ *
+ *   centi = TEMP_READ(정수부) * 100 - 25 + (SLOPE - COUNT_REMAIN) * 100 / SLOPE
+ *
+ *   예) TEMP_READ = 25, COUNT_REMAIN = 30, SLOPE = 80 → 2500 - 25 + 62 = 2537 (25.37°C)
+ *
+ * float 없이 정수 곱셈/나눗셈 한 번이면 되고, 출력도 printf("%d.%02d")로 충분하므로
+ * printf float 라이브러리가 필요 없다.
+ * COUNTER/SLOPE는 마지막 변환 결과이므로 정확한 값은 변환이 끝난 직후에 읽는다. (1SHOT 모드 권장)
+ * raw가 NULL이 아니면 READ_TEMPERATURE 값(DS1621_READ_TEMPERATURE() 형식)도 함께 돌려준다.
+ * I2C 에러면 false.
+ */
+bool DS1621_ReadHighRes(int16_t *centi, uint16_t *raw);
+
+/*
+ * #NonBlockingRead
+ * DS1621_RequestTemperature() : READ_TEMPERATURE 트랜잭션을 I2C 큐에 넣고 바로 리턴한다.
+ *                               (이전 요청이 아직 끝나지 않았으면 false)
+ * DS1621_GetTemperature()     : 요청한 Read가 정상 완료되었으면 true와 함께 값을 돌려준다.
+ *                               값 형식은 DS1621_READ_TEMPERATURE()와 같다.
+ */
+bool DS1621_RequestTemperature(void);
+bool DS1621_GetTemperature(uint16_t *temp);
+
+/*
+ * #SamplingEngine #CachedValue
+ *
+ * 1SHOT 모드로 DS1621_SAMPLE_PERIOD_MS마다 변환을 시작하고, 변환 시간(DS1621_CONVERT_MS) 동안은
+ * 아무것도 하지 않다가 DONE bit를 확인한 뒤 High Resolution 값을 읽어 RAM Cache에 넣는다.
+ * 모든 I2C 전송은 큐(비동기)로 진행되며, main loop는 DS1621_Sampler_Task()에서 상태만 확인한다.
+ *
+ *   IDLE ──(주기)──> START ──> CONVERT(750ms 대기) ──> POLL(DONE?) ──> READ ──> IDLE
+ *                                   ^                     │ 아직
+ *                                   └────── 10ms ─────────┘
+ *
+ * DS1621_GetSample()은 Cache만 복사하므로 O(1)이고 버스를 쓰지 않는다. (ISR에서도 호출 가능)
+ * seq는 새 값이 들어올 때마다 1씩 증가하므로 바뀐 값만 처리할 수 있다.
+ *
+ * 사용 예)
+ *   DS1621_Sampler_Init();               // sei() 뒤
+ *   ISR(TCB0) { DS1621_Sampler_TickISR(); }  // 1ms
+ *   while (1) { DS1621_Sampler_Task(); ... DS1621_GetSample(&s) ... }
+ */
+#define DS1621_SAMPLE_PERIOD_MS 1000
+#define DS1621_CONVERT_MS       750     // 변환 시간 (최대)
+#define DS1621_POLL_MS          10      // DONE이 아니면 다시 확인할 간격
+#define DS1621_POLL_MAX         50
+
+typedef struct
+{
+	int16_t  centi;     // 0.01°C
+	uint16_t raw;       // DS1621_READ_TEMPERATURE() 형식
+	uint16_t seq;       // 0 = 아직 값 없음
+} ds1621_sample_t;
+
+void DS1621_Sampler_Init(void);
+void DS1621_Sampler_TickISR(void);
+void DS1621_Sampler_Task(void);
+bool DS1621_GetSample(ds1621_sample_t *sample);     // 값이 한 번이라도 들어왔으면 true
+
+/*
+ * #TOUT #PinChangeInterrupt
+ *
+ * DS1621 TOUT을 AVR 입력 Pin에 연결하고 양쪽 Edge 인터럽트를 건다.
+ * 온도가 TH를 넘거나 TL 아래로 내려가는 순간 ISR이 Alarm 이벤트를 남기므로
+ * 과열 대응이 Polling 주기와 무관하고, 평소에는 I2C 트래픽이 필요 없다.
+ * (TOUT은 변환할 때마다 갱신된다. 연속 변환 모드면 DS1621 혼자 Thermostat으로 동작한다)
+ *
+ * DS1621_Alarm_Init()    : TH/TL을 쓰고, POL = Active High, Pin 인터럽트 설정
+ * DS1621_Alarm_Active()  : 현재 TOUT 상태 (Pin만 읽는다)
+ * DS1621_Alarm_Event()   : 마지막 호출 이후 TOUT이 바뀌었으면 true, active에 현재 상태
+ * DS1621_Alarm_Callback  : NULL이 아니면 ISR 안에서 바로 호출한다. (긴급 차단 등)
+ * DS1621_Alarm_PinISR()  : Port 인터럽트에서 호출한다. TOUT Pin의 Flag만 보고 지운다.
+ *
+ * Port 인터럽트 Vector는 Port 하나에 하나뿐이라 같은 Port의 다른 Pin(PCF8563 CLKOUT 등)과 나눠 쓴다.
+ * 그래서 Vector는 Driver가 아니라 Application이 갖고, 각 Driver의 PinISR()을 차례로 호출한다.
+ *   ISR(PORTD_PORT_vect) { DS1621_Alarm_PinISR(); }
+ */
+#define DS1621_TOUT_PORT    PORTD
+#define DS1621_TOUT_PIN     2
+#define DS1621_TOUT_PINCTRL PIN2CTRL
+
+typedef void (*ds1621_alarm_cb_t)(bool active);
+
+void DS1621_Alarm_Init(int16_t highHalf, int16_t lowHalf, ds1621_alarm_cb_t cb);
+bool DS1621_Alarm_Active(void);
+bool DS1621_Alarm_Event(bool *active);
+void DS1621_Alarm_PinISR(void);
 
 #endif /* DS1621_H_ */
\ No newline at end of file
@@ -3,10 +3,33 @@
 #include <avr/interrupt.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
+#include <util/delay.h>
 #include "i2c.h"
 
 i2c_info_t i2c_info;
 
+static i2c_xfer_t* i2c_current = NULL;		// 진행 중인 트랜잭션
+static i2c_xfer_t* i2c_head = NULL;			// 대기 큐 (priority 순)
+
+static volatile uint16_t i2c_watchdog = 0;	// 남은 시간 [ms], 0이면 정지
+static volatile bool i2c_recover_pending = false;	// Bus Recovery 대기 중 (I2C_Task()에서 수행)
+static i2c_error_t i2c_recover_status;		// Recovery 뒤에 마무리할 결과
+static uint8_t i2c_fault = I2C_FAULT_NONE;	// 현재 시도의 실패 원인
+static uint8_t i2c_retry = I2C_DEFAULT_RETRY;
+static i2c_dev_stats_t i2c_stats[I2C_DEV_STATS_SIZE];
+
+static volatile uint16_t i2c_time_hi = 0;	// Free-running Timer 상위 16bit
+static uint32_t i2c_t_start;				// 현재 트랜잭션의 첫 START 시각
+static uint16_t i2c_xfer_bytes;				// 현재 트랜잭션의 전체 byte 수
+static uint16_t i2c_transitions;			// 현재 트랜잭션의 Handler 호출 수
+static uint32_t i2c_isr_ticks;				// 현재 트랜잭션의 ISR 시간
+
+static void I2C_XferNext(void);
+static void I2C_XferFinish( i2c_error_t status );
+static void I2C_XferComplete( i2c_error_t status, bool recovered );
+static void I2C_Poll( i2c_xfer_t *xfer );
+
 i2c_handler_t I2C_HANDLER_IDLE(void)
 {
 	i2c_info.error = I2C_NOERROR;
@@ -66,71 +89,91 @@ i2c_handler_t I2C_HANDLER_SEND_ADDR_READ(void)
 	return I2C_RX;
 }
 
+/*
+ * 다음 Segment를 data_ptr/data_length에 올린다. 길이 0인 Segment는 건너뛴다.
+ * 더 이상 Segment가 없으면 false.
+ */
+static bool I2C_NextSegment(void)
+{
+	while ( i2c_info.seg_left )
+	{
+		const i2c_segment_t *seg = i2c_info.seg++;
+		
+		i2c_info.seg_left--;
+		if ( seg->length )
+		{
+			i2c_info.data_ptr = seg->buffer;
+			i2c_info.data_length = seg->length;
+			i2c_info.seg_read = ( seg->flags & I2C_SEG_READ ) ? true : false;
+			return true;
+		}
+	}
+	i2c_info.data_length = 0;
+	return false;
+}
+
+/*
+ * Write 방향: 앞 byte(또는 주소)의 ACK를 확인하고 다음 byte를 보낸다.
+ * Segment가 끝나면 바로 다음 Segment로 넘어간다.
+ *   Write → Write : STOP 없이 이어서 전송
+ *   Write → Read  : Repeated START
+ *   끝            : STOP
+ * Data byte에 NACK이 오면 STOP 후 에러로 끝낸다. (주소 NACK은 ISR이 I2C_ADDRESS_NACK으로 보낸다)
+ */
 i2c_handler_t I2C_HANDLER_TX(void)
 {
 	if ( TWI0.MSTATUS & TWI_RXACK_bm )
-	return I2C_HANDLER_STOP();
-	else {
-		i2c_info.addressNACKCheck = false;
-		TWI0.MDATA = *i2c_info.data_ptr++;
-		return ( --i2c_info.data_length )? I2C_TX : I2C_TX_COMPLETE;
+	{
+		TWI0.MCTRLB |= TWI_MCMD_STOP_gc;
+		i2c_info.error = I2C_ERROR;
+		i2c_fault = I2C_FAULT_NACK;
+		return I2C_HANDLER_RESET();
+	}
+	
+	i2c_info.addressNACKCheck = false;
+	
+	if ( i2c_info.data_length == 0 )
+	{
+		if ( !I2C_NextSegment() )
+			return I2C_HANDLER_STOP();
+		if ( i2c_info.seg_read )
+			return I2C_HANDLER_NACK_RESTART_READ();
 	}
+	
+	TWI0.MDATA = *i2c_info.data_ptr++;
+	i2c_info.data_length--;
+	return I2C_TX;
 }
 
+/*
+ * Read 방향: 받은 byte를 저장한다.
+ *   Read → Read  : ACK 후 다음 Segment 버퍼로 계속 수신
+ *   Read → Write : NACK + Repeated START
+ *   끝           : NACK + STOP
+ */
 i2c_handler_t I2C_HANDLER_RX(void)
 {
 	i2c_info.addressNACKCheck = false;
 	
 	*i2c_info.data_ptr++ = TWI0.MDATA;
-	if ( --i2c_info.data_length )
+	if ( --i2c_info.data_length || ( I2C_NextSegment() && i2c_info.seg_read ) )
 	{
 		TWI0.MCTRLB &= ~TWI_ACKACT_bm;
 		TWI0.MCTRLB |= TWI_MCMD_RECVTRANS_gc;
 		return I2C_RX;
 	}
-	else
-	{
-		i2c_info.bufferFree = true;
-		switch ( i2c_info.callbackDataXferComplete(i2c_info.callbackDataParameter) )
-		{
-			case I2C_RESTART_READ :
-			return I2C_HANDLER_NACK_RESTART_READ();
-			case I2C_RESTART_WRITE :
-			return I2C_HANDLER_NACK_RESTART_WRITE();
-			case I2C_CONTINUE :
-			case I2C_OPERATION_STOP :
-			default:
-			return I2C_HANDLER_NACK_STOP();
-		}
-	}
-}
-
-i2c_handler_t I2C_HANDLER_TX_COMPLETE(void)
-{
-	if ( TWI0.MSTATUS & TWI_RXACK_bm )
-	return I2C_HANDLER_STOP();
-	else
-	{
-		i2c_info.bufferFree = true;
-		switch ( i2c_info.callbackDataXferComplete(i2c_info.callbackDataParameter) )
-		{
-			case I2C_RESTART_READ :
-			return I2C_HANDLER_NACK_RESTART_READ();
-			case I2C_RESTART_WRITE :
-			return I2C_HANDLER_NACK_RESTART_WRITE();
-			case I2C_CONTINUE :
-			return I2C_HANDLER_TX();
-			case I2C_OPERATION_STOP :
-			default:
-			return I2C_HANDLER_STOP();
-		}
-	}
+	
+	if ( i2c_info.data_length )
+		return I2C_HANDLER_NACK_RESTART_WRITE();
+	return I2C_HANDLER_NACK_STOP();
 }
 
 i2c_handler_t I2C_HANDLER_ADDRESS_NACK(void)
 {
+	TWI0.MCTRLB |= TWI_MCMD_STOP_gc;
 	TWI0.MSTATUS |= TWI_ARBLOST_bm;
 	i2c_info.error = I2C_ERROR;
+	i2c_fault = I2C_FAULT_NACK;
 	return I2C_HANDLER_RESET();
 }
 
@@ -138,6 +181,7 @@ i2c_handler_t I2C_HANDLER_BUS_COLLISION( void )
 {
 	TWI0.MSTATUS |= TWI_ARBLOST_bm;
 	i2c_info.error = I2C_ERROR;
+	i2c_fault = I2C_FAULT_ARBLOST;
 	return I2C_HANDLER_RESET();
 }
 
@@ -147,6 +191,7 @@ i2c_handler_t I2C_HANDLER_BUS_ERROR( void )
 	TWI0.MCTRLB |= TWI_FLUSH_bm;
 	
 	i2c_info.error = I2C_ERROR;
+	i2c_fault = I2C_FAULT_BUSERR;
 	return I2C_HANDLER_RESET();
 }
 
@@ -156,7 +201,6 @@ stateHandler stateHandlerTable[] = {
 	I2C_HANDLER_SEND_ADDR_READ,
 	I2C_HANDLER_TX,
 	I2C_HANDLER_RX,
-	I2C_HANDLER_TX_COMPLETE,
 	I2C_HANDLER_STOP,
 	
 	I2C_HANDLER_NACK_STOP,
@@ -168,353 +212,662 @@ stateHandler stateHandlerTable[] = {
 	I2C_HANDLER_RESET
 };
 
-ISR( TWI0_TWIM_vect )
+/*
+ * TWI Master 이벤트 하나를 처리한다. (TWI0_TWIM_vect, 또는 인터럽트가 꺼진 I2C_Transfer()의 Polling)
+ * ARBLOST/BUSERR도 1을 써서 지우는 Flag이므로 MSTATUS |= RIF|WIF 로 지우면 함께 지워진다.
+ * 먼저 읽어 두고 RIF/WIF만 지운다. (ARBLOST/BUSERR는 각 Handler가 지운다)
+ */
+static void I2C_MasterEvent( void )
 {
-	TWI0.MSTATUS |= TWI_RIF_bm | TWI_WIF_bm;
+	uint16_t t0 = I2C_STATS_TIMER.CNT;
+	uint8_t status = TWI0.MSTATUS;
+	
+	TWI0.MSTATUS = status & ( TWI_RIF_bm | TWI_WIF_bm );
 	
-	if ( i2c_info.addressNACKCheck && (TWI0.MSTATUS & TWI_RXACK_bm) )
+	if ( i2c_info.addressNACKCheck && (status & TWI_RXACK_bm) )
 	i2c_info.handler = I2C_ADDRESS_NACK;
-	if ( TWI0.MSTATUS & TWI_ARBLOST_bm )
+	if ( status & TWI_ARBLOST_bm )
 	i2c_info.handler = I2C_BUS_COLLISION;
-	if ( TWI0.MSTATUS &  TWI_BUSERR_bm )
+	if ( status &  TWI_BUSERR_bm )
 	i2c_info.handler = I2C_BUS_ERROR;
 	
 	i2c_info.handler = stateHandlerTable[i2c_info.handler]();
+	i2c_transitions++;
+	i2c_isr_ticks += (uint16_t)( I2C_STATS_TIMER.CNT - t0 );	// CCMP = 0xFFFF 이므로 wrap도 맞게 계산된다.
+	
+	// STOP 또는 에러로 트랜잭션 종료 → 완료 통보 후 다음 Descriptor 시작
+	if ( !i2c_info.busy && i2c_current )
+		I2C_XferFinish( i2c_info.error );
+}
+
+ISR( TWI0_TWIM_vect )
+{
+	I2C_MasterEvent();
+}
+
+void I2C_Init(void)
+{
+	PORTA.DIRSET = PIN2_bm | PIN3_bm;
+	PORTA.OUTSET = PIN2_bm | PIN3_bm;
+	
+	TWI0.MBAUD = I2C_MBAUD( I2C_DEFAULT_SPEED, I2C_DEFAULT_RISE_NS );
+	TWI0.MCTRLA |= I2C_BUS_TIMEOUT | TWI_ENABLE_bm;
+	
+	I2C_STATS_TIMER.CCMP = 0xFFFF;
+	I2C_STATS_TIMER.INTCTRL = TCB_CAPT_bm;
+	I2C_STATS_TIMER.CTRLA = TCB_CLKSEL_CLKDIV2_gc | TCB_ENABLE_bm;
+}
+
+ISR( I2C_STATS_TIMER_vect )
+{
+	i2c_time_hi++;
+	I2C_STATS_TIMER.INTFLAGS = TCB_CAPT_bm;
+}
+
+// 인터럽트가 꺼진 상태에서 호출한다.
+static uint32_t I2C_Now( void )
+{
+	uint16_t hi = i2c_time_hi;
+	uint16_t cnt = I2C_STATS_TIMER.CNT;
+	
+	// Overflow 인터럽트가 아직 처리되지 않았으면 직접 반영
+	if ( ( I2C_STATS_TIMER.INTFLAGS & TCB_CAPT_bm ) && cnt < 0x8000 )
+		hi++;
+	return ( (uint32_t)hi << 16 ) | cnt;
+}
+
+uint32_t I2C_SetBusSpeed( uint32_t hz, uint16_t rise_time_ns )
+{
+	uint8_t baud, mctrla;
+	
+	if ( hz == 0 ) hz = I2C_DEFAULT_SPEED;
+	baud = I2C_MBAUD( hz, rise_time_ns );
+	
+	// 인터럽트가 꺼져 있으면 TWI ISR이 큐를 진행시키지 않으므로 I2C_Transfer()처럼 직접 Polling한다.
+	if ( SREG & CPU_I_bm )
+		while ( !I2C_IsIdle() ) I2C_Task();
+	else
+		I2C_Poll( NULL );
+	
+	mctrla = TWI0.MCTRLA;
+	TWI0.MCTRLA = mctrla & ~TWI_ENABLE_bm;
+	
+	if ( hz > I2C_SPEED_FAST )
+		TWI0.CTRLA |= TWI_FMPEN_bm;
+	else
+		TWI0.CTRLA &= ~TWI_FMPEN_bm;
+	
+	TWI0.MBAUD = baud;
+	TWI0.MCTRLA = mctrla;
+	TWI0.MSTATUS = TWI_BUSSTATE_IDLE_gc;
+	
+	return F_CPU / ( 10UL + 2UL * baud + I2C_RISE_CYCLES( rise_time_ns ) );
 }
 
-i2c_operation_t I2C_Stop_CB(void* p)
+void I2C_SetSdaTiming( uint8_t sdahold, uint8_t sdasetup )
 {
-	return I2C_OPERATION_STOP;
+	TWI0.CTRLA = ( TWI0.CTRLA & ~( TWI_SDAHOLD_gm | TWI_SDASETUP_bm ) )
+			   | ( sdahold & TWI_SDAHOLD_gm ) | ( sdasetup & TWI_SDASETUP_bm );
 }
 
-i2c_error_t I2C_OPEN(i2c_address_t address)
+//////////////////////////////////////////////////////////////////////////
+// Descriptor Queue
+
+static void I2C_XferStart( i2c_xfer_t *xfer )
 {
-	i2c_error_t ret = I2C_BUSY;
+	uint16_t total = 0;
+	uint8_t i;
 	
-	if(!i2c_info.inUse)
+	for ( i = 0; i < xfer->segment_count; i++ )
+		total += xfer->segments[i].length;
+	
+	if ( xfer->attempts == 0 )
 	{
-		i2c_info.SlaveAddress = address;
-		
-		i2c_info.busy = false;
-		i2c_info.inUse = true;
-		i2c_info.bufferFree = true;
-		i2c_info.addressNACKCheck = false;
-		
-		i2c_info.handler = I2C_IDLE;
-		
-		i2c_info.callbackDataXferComplete = I2C_Stop_CB;
-		i2c_info.callbackDataParameter = NULL;
-		
-		TWI0.MCTRLB		|= TWI_FLUSH_bm;
-		TWI0.MSTATUS	|= TWI_BUSSTATE_IDLE_gc;
-		TWI0.MSTATUS    |= TWI_RIF_bm | TWI_WIF_bm;
-		TWI0.MCTRLA		|= TWI_WIEN_bm | TWI_RIEN_bm;
-		
-		ret = I2C_NOERROR;
+		i2c_t_start = I2C_Now();
+		i2c_xfer_bytes = total;
+		i2c_transitions = 0;
+		i2c_isr_ticks = 0;
 	}
 	
-	return ret;
+	i2c_info.SlaveAddress = xfer->address;
+	i2c_info.busy = true;
+	i2c_info.addressNACKCheck = false;
+	i2c_info.error = I2C_NOERROR;
+	i2c_fault = I2C_FAULT_NONE;
+	i2c_watchdog = I2C_WATCHDOG_MS( total );
+	
+	i2c_info.seg = xfer->segments;
+	i2c_info.seg_left = xfer->segment_count;
+	
+	// Segment가 하나도 없으면 주소만 보내는 Write (ACK 확인용)
+	if ( !I2C_NextSegment() )
+		i2c_info.seg_read = false;
+	
+	TWI0.MCTRLB		|= TWI_FLUSH_bm;
+	TWI0.MSTATUS	|= TWI_BUSSTATE_IDLE_gc;
+	TWI0.MSTATUS    |= TWI_RIF_bm | TWI_WIF_bm;
+	TWI0.MCTRLA		|= TWI_WIEN_bm | TWI_RIEN_bm;
+	
+	i2c_info.handler = stateHandlerTable[ i2c_info.seg_read ? I2C_SEND_ADDR_READ : I2C_SEND_ADDR_WRITE ]();
+	i2c_transitions++;
 }
 
-i2c_error_t I2C_CLOSE(void)
+static i2c_dev_stats_t* I2C_StatsEntry( i2c_address_t slaveAddress )
 {
-	i2c_error_t ret = I2C_BUSY;
+	uint8_t i;
 	
-	if(!i2c_info.busy)
+	for ( i = 0; i < I2C_DEV_STATS_SIZE; i++ )
+	{
+		if ( i2c_stats[i].transfers && i2c_stats[i].address == slaveAddress )
+			return &i2c_stats[i];
+	}
+	for ( i = 0; i < I2C_DEV_STATS_SIZE; i++ )
+	{
+		if ( i2c_stats[i].transfers == 0 )
+		{
+			i2c_stats[i].address = slaveAddress;
+			return &i2c_stats[i];
+		}
+	}
+	return NULL;	// 표가 가득 차면 기록하지 않는다.
+}
+
+/*
+ * 현재 시도를 마무리한다. (인터럽트가 꺼진 상태에서만 호출)
+ * Bus Error와 Timeout은 Slave가 SDA를 잡고 있을 수 있으므로 먼저 Bus Recovery를 해야 한다.
+ * Bit-bang Recovery는 100us 이상 걸리므로 ISR에서 하지 않고, TWI 인터럽트를 끈 채
+ * 트랜잭션과 큐를 세워 두었다가 I2C_Task()가 Recovery 후 마무리한다.
+ */
+static void I2C_XferFinish( i2c_error_t status )
+{
+	i2c_watchdog = 0;
+	
+	if ( i2c_fault == I2C_FAULT_BUSERR || i2c_fault == I2C_FAULT_TIMEOUT )
 	{
-		i2c_info.inUse = false;
-		i2c_info.SlaveAddress = 0xff;
-		
 		TWI0.MCTRLA &= ~(TWI_WIEN_bm | TWI_RIEN_bm);
-		ret = i2c_info.error;
+		i2c_recover_status = status;
+		i2c_recover_pending = true;
+		return;
 	}
-	return ret;
+	I2C_XferComplete( status, false );
 }
 
-i2c_error_t I2C_M_READ_WRITE(i2c_m_read_write_t m_rw)
+/*
+ * 통계를 기록하고, 실패했고 재시도가 남아 있으면 같은 Descriptor를 처음부터 다시 시작한다.
+ * 끝났으면 완료 통보 후 큐의 다음 Descriptor를 시작한다. (인터럽트가 꺼진 상태에서만 호출)
+ */
+static void I2C_XferComplete( i2c_error_t status, bool recovered )
 {
-	i2c_error_t ret = I2C_BUSY;
+	i2c_xfer_t *xfer = i2c_current;
+	i2c_dev_stats_t *st = ( xfer->flags & I2C_XFER_NOSTATS ) ? NULL : I2C_StatsEntry( xfer->address );
+	
+	if ( st )
+	{
+		if ( ++st->transfers == 0 ) st->transfers = 1;	// 0은 빈 칸 표시로 쓰므로 건너뛴다.
+		switch ( i2c_fault )
+		{
+			case I2C_FAULT_NACK :		st->nack++;		break;
+			case I2C_FAULT_ARBLOST :	st->arblost++;	break;
+			case I2C_FAULT_BUSERR :		st->buserr++;	break;
+			case I2C_FAULT_TIMEOUT :	st->timeout++;	break;
+			default : break;
+		}
+		if ( recovered ) st->recoveries++;
+	}
+	
+	if ( status != I2C_NOERROR && xfer->attempts < i2c_retry && !( xfer->flags & I2C_XFER_NORETRY ) )
+	{
+		xfer->attempts++;
+		if ( st ) st->retries++;
+		I2C_XferStart( xfer );
+		return;
+	}
 	
-	if(!i2c_info.busy)
+	if ( st )
 	{
-		i2c_info.busy = true;
-		ret = I2C_NOERROR;
+		uint32_t us = I2C_TICKS_TO_US( I2C_Now() - i2c_t_start );
+		uint16_t t = ( us > 0xFFFF ) ? 0xFFFF : (uint16_t)us;
 		
-		i2c_info.handler = (m_rw == M_READ) ? I2C_SEND_ADDR_READ : I2C_SEND_ADDR_WRITE;
-		i2c_info.handler = stateHandlerTable[i2c_info.handler]();
+		if ( st->transactions == 0 || t < st->time_min ) st->time_min = t;
+		if ( t > st->time_max ) st->time_max = t;
+		st->time_sum += t;
+		st->transactions++;
+		st->transitions += i2c_transitions;
+		st->isr_ticks += i2c_isr_ticks;
+		
+		if ( status == I2C_NOERROR )
+			st->bytes += i2c_xfer_bytes;
+		else
+			st->failures++;
 	}
-	return ret;
+	
+	i2c_current = NULL;
+	xfer->status = status;
+	if ( xfer->callback )
+		xfer->callback(xfer);
+	
+	// callback 안에서 Submit한 경우 이미 다음 트랜잭션이 시작되었다.
+	if ( i2c_current == NULL )
+		I2C_XferNext();
 }
 
-void I2C_SetDataBuffer(uint8_t* buffer, uint16_t length)
+// 인터럽트가 꺼진 상태(ISR 또는 I2C_Submit)에서만 호출된다.
+static void I2C_XferNext(void)
 {
-	if(i2c_info.bufferFree)
+	i2c_xfer_t *xfer = i2c_head;
+	
+	if ( xfer )
+	{
+		i2c_head = xfer->next;
+		
+		i2c_current = xfer;
+		I2C_XferStart( xfer );
+	}
+	else
 	{
-		i2c_info.data_ptr = buffer;
-		i2c_info.data_length = length;
-		i2c_info.bufferFree = false;
+		TWI0.MCTRLA &= ~(TWI_WIEN_bm | TWI_RIEN_bm);
 	}
 }
 
-void I2C_SetDataXferCompleteCallback(i2c_callback_t cb, void* p)
+void I2C_Xfer_Segments( i2c_xfer_t *xfer, i2c_address_t slaveAddress, const i2c_segment_t *segments, uint8_t count )
 {
-	if(cb)
+	xfer->address = slaveAddress;
+	xfer->segments = segments;
+	xfer->segment_count = count;
+	
+	xfer->flags = 0;
+	xfer->priority = I2C_PRIO_NORMAL;
+	xfer->callback = NULL;
+	xfer->context = NULL;
+	xfer->status = I2C_NOERROR;
+}
+
+void I2C_Xfer_Prepare( i2c_xfer_t *xfer, i2c_address_t slaveAddress, uint16_t reg, uint8_t reg_length,
+					   uint8_t *data, uint16_t length, i2c_xfer_dir_t direction )
+{
+	if ( reg_length == 2 )
 	{
-		i2c_info.callbackDataXferComplete = cb;
-		i2c_info.callbackDataParameter = p;
+		xfer->reg[0] = (uint8_t)(reg >> 8);
+		xfer->reg[1] = (uint8_t)reg;
 	}
 	else
 	{
-		i2c_info.callbackDataXferComplete = I2C_Stop_CB;
-		i2c_info.callbackDataParameter = NULL;
+		xfer->reg[0] = (uint8_t)reg;
 	}
+	
+	xfer->seg[0].buffer = xfer->reg;
+	xfer->seg[0].length = reg_length;
+	xfer->seg[0].flags = I2C_SEG_WRITE;
+	
+	xfer->seg[1].buffer = data;
+	xfer->seg[1].length = length;
+	xfer->seg[1].flags = ( direction == I2C_XFER_READ ) ? I2C_SEG_READ : I2C_SEG_WRITE;
+	
+	I2C_Xfer_Segments( xfer, slaveAddress, xfer->seg, 2 );
 }
 
-void I2C_Init(void)
+bool I2C_Submit( i2c_xfer_t *xfer )
 {
-	PORTA.DIRSET = PIN2_bm | PIN3_bm;
-	PORTA.OUTSET = PIN2_bm | PIN3_bm;
+	uint8_t sreg;
+	
+	if ( xfer->segment_count && xfer->segments == NULL )
+		return false;
+	
+	xfer->status = I2C_BUSY;
+	xfer->attempts = 0;
+	xfer->next = NULL;
 	
-	TWI0.MBAUD = 20;
-	TWI0.MCTRLA |= TWI_ENABLE_bm;
+	sreg = SREG;
+	cli();
+	
+	if ( i2c_head == NULL || xfer->priority < i2c_head->priority )
+	{
+		xfer->next = i2c_head;
+		i2c_head = xfer;
+	}
+	else
+	{
+		i2c_xfer_t *p = i2c_head;
+		
+		while ( p->next && p->next->priority <= xfer->priority )
+			p = p->next;
+		xfer->next = p->next;
+		p->next = xfer;
+	}
+	
+	if ( i2c_current == NULL )
+		I2C_XferNext();
+	
+	SREG = sreg;
+	return true;
 }
 
-void I2C_Write_Command(i2c_address_t slaveAddress, uint8_t cmd)
+bool I2C_IsIdle( void )
 {
-	while(I2C_OPEN(slaveAddress) == I2C_BUSY);
-	I2C_SetDataBuffer(&cmd, (uint16_t)sizeof(cmd));
-	I2C_M_READ_WRITE(M_WRITE);
-	while(I2C_CLOSE() == I2C_BUSY);
+	return ( i2c_current == NULL ) && ( i2c_head == NULL );
 }
 
-i2c_operation_t I2C_Write_Cmd_Uint8_CB( void *p )
+/*
+ * 인터럽트가 꺼진 상태(sei() 전 초기화, ISR 또는 완료 callback 안)에서는
+ * TWI ISR도 I2C_TickISR()도 돌지 않는다. MSTATUS의 RIF/WIF를 직접 보고 진행시키고,
+ * Watchdog은 Stats Timer로 1ms를 세어 직접 돌린다.
+ * xfer가 끝날 때까지, xfer가 NULL이면 큐가 빌 때까지 진행시킨다.
+ */
+static void I2C_Poll( i2c_xfer_t *xfer )
 {
-	I2C_SetDataBuffer( p, 1 );
-	I2C_SetDataXferCompleteCallback( I2C_Stop_CB, NULL );
-	return I2C_CONTINUE;
+	uint16_t last = I2C_STATS_TIMER.CNT, now;
+	uint16_t ticks = 0;
+	
+	while ( xfer ? ( xfer->status == I2C_BUSY ) : !I2C_IsIdle() )
+	{
+		if ( i2c_recover_pending )
+			I2C_Task();
+		else if ( TWI0.MSTATUS & ( TWI_RIF_bm | TWI_WIF_bm ) )
+			I2C_MasterEvent();
+		
+		now = I2C_STATS_TIMER.CNT;
+		ticks += (uint16_t)( now - last );
+		last = now;
+		if ( ticks >= I2C_TICKS_PER_MS )
+		{
+			ticks -= I2C_TICKS_PER_MS;
+			I2C_TickISR();
+		}
+	}
 }
 
-void I2C_Write_Cmd_Uint8( i2c_address_t slaveAddress, uint8_t cmd, uint8_t data )
+i2c_error_t I2C_Transfer( i2c_xfer_t *xfer )
 {
-	while ( I2C_OPEN(slaveAddress) == I2C_BUSY ) ;
-	I2C_SetDataXferCompleteCallback( I2C_Write_Cmd_Uint8_CB, &data );
-	I2C_SetDataBuffer( &cmd, (uint16_t)sizeof(cmd) );
-	I2C_M_READ_WRITE(M_WRITE);
-	while ( I2C_CLOSE() == I2C_BUSY ) ;
+	if ( !I2C_Submit( xfer ) )
+		return I2C_ERROR;
+	
+	if ( SREG & CPU_I_bm )
+		while ( xfer->status == I2C_BUSY ) I2C_Task();
+	else
+		I2C_Poll( xfer );
+	return xfer->status;
 }
 
+//////////////////////////////////////////////////////////////////////////
+// Bus Health
 
-i2c_operation_t I2C_Write_Cmd_Uint16_CB( void *p )
+void I2C_TickISR( void )
 {
-	I2C_SetDataBuffer( p, 2 );
-	I2C_SetDataXferCompleteCallback( I2C_Stop_CB, NULL );
-	return I2C_CONTINUE;
+	if ( i2c_watchdog == 0 || --i2c_watchdog )
+		return;
+	
+	// 인터럽트가 오지 않는 트랜잭션 → TWI를 멈추고 강제로 종료
+	TWI0.MCTRLA &= ~(TWI_WIEN_bm | TWI_RIEN_bm);
+	i2c_info.busy = false;
+	i2c_info.error = I2C_ERROR;
+	i2c_info.handler = I2C_RESET;
+	i2c_fault = I2C_FAULT_TIMEOUT;
+	
+	if ( i2c_current )
+		I2C_XferFinish( I2C_TIMEOUT );
 }
 
-void I2C_Write_Cmd_Uint16( i2c_address_t slaveAddress, uint8_t cmd, uint16_t data )
+void I2C_Task( void )
 {
-	while ( I2C_OPEN( slaveAddress ) == I2C_BUSY ) ;
-	data =  data << 8 | data >> 8;
-	I2C_SetDataXferCompleteCallback( I2C_Write_Cmd_Uint16, &data );
-	I2C_SetDataBuffer( &cmd, (uint16_t)sizeof(cmd) );
-	I2C_M_READ_WRITE( M_WRITE );
-	while ( I2C_CLOSE() == I2C_BUSY ) ;
+	uint8_t sreg;
+	
+	if ( !i2c_recover_pending )
+		return;
+	
+	// TWI 인터럽트가 꺼져 있고 Watchdog도 멈춰 있으므로 여기서는 아무도 버스를 건드리지 않는다.
+	I2C_BusRecover();
+	
+	sreg = SREG;
+	cli();
+	i2c_recover_pending = false;
+	I2C_XferComplete( i2c_recover_status, true );
+	SREG = sreg;
+}
+
+/*
+ * TWI를 끄면 PA2/PA3는 PORT가 제어한다.
+ * Open-Drain을 흉내내기 위해 OUT은 0으로 두고 DIR로만 Low(출력)/High(입력, Pull-up)를 만든다.
+ */
+bool I2C_BusRecover( void )
+{
+	uint8_t mctrla = TWI0.MCTRLA;
+	uint8_t i;
+	bool released;
+	
+	TWI0.MCTRLA = mctrla & ~TWI_ENABLE_bm;
+	
+	I2C_SDA_PORT.OUTCLR = I2C_SDA_bm | I2C_SCL_bm;
+	I2C_SDA_PORT.DIRCLR = I2C_SDA_bm | I2C_SCL_bm;
+	_delay_us( I2C_RECOVERY_HALF_US );
+	
+	// SDA가 풀릴 때까지 최대 9clock (Slave가 보내던 byte + ACK)
+	for ( i = 0; i < 9 && !( I2C_SDA_PORT.IN & I2C_SDA_bm ); i++ )
+	{
+		I2C_SDA_PORT.DIRSET = I2C_SCL_bm;
+		_delay_us( I2C_RECOVERY_HALF_US );
+		I2C_SDA_PORT.DIRCLR = I2C_SCL_bm;
+		_delay_us( I2C_RECOVERY_HALF_US );
+	}
+	
+	// STOP : SCL High 동안 SDA Low → High
+	I2C_SDA_PORT.DIRSET = I2C_SCL_bm;
+	I2C_SDA_PORT.DIRSET = I2C_SDA_bm;
+	_delay_us( I2C_RECOVERY_HALF_US );
+	I2C_SDA_PORT.DIRCLR = I2C_SCL_bm;
+	_delay_us( I2C_RECOVERY_HALF_US );
+	I2C_SDA_PORT.DIRCLR = I2C_SDA_bm;
+	_delay_us( I2C_RECOVERY_HALF_US );
+	
+	released = ( I2C_SDA_PORT.IN & I2C_SDA_bm ) != 0;
+	
+	I2C_SDA_PORT.DIRSET = I2C_SDA_bm | I2C_SCL_bm;
+	I2C_SDA_PORT.OUTSET = I2C_SDA_bm | I2C_SCL_bm;
+	
+	TWI0.MCTRLA = mctrla;
+	TWI0.MCTRLB |= TWI_FLUSH_bm;
+	TWI0.MSTATUS = TWI_BUSSTATE_IDLE_gc;
+	
+	return released;
 }
 
-void I2C_Write_Block( i2c_address_t slaveAddress, uint8_t *buffer, uint8_t length )
+void I2C_SetRetryCount( uint8_t retries )
 {
-	while ( I2C_OPEN( slaveAddress ) == I2C_BUSY ) ;
-	I2C_SetDataBuffer( buffer, (uint16_t)length );
-	I2C_M_READ_WRITE( M_WRITE );
-	while ( I2C_CLOSE() == I2C_BUSY ) ;
+	i2c_retry = retries;
 }
 
-i2c_operation_t I2C_Read_Cmd_Uint8_CB( void *p )
+const i2c_dev_stats_t* I2C_GetDeviceStats( i2c_address_t slaveAddress )
 {
-	I2C_SetDataBuffer( p, 1 );
-	I2C_SetDataXferCompleteCallback( I2C_Stop_CB, NULL );
-	return I2C_RESTART_READ;
+	uint8_t i;
+	
+	for ( i = 0; i < I2C_DEV_STATS_SIZE; i++ )
+	{
+		if ( i2c_stats[i].transfers && i2c_stats[i].address == slaveAddress )
+			return &i2c_stats[i];
+	}
+	return NULL;
 }
 
-uint8_t I2C_Read_Cmd_Uint8( i2c_address_t slaveAddress, uint8_t cmd )
+void I2C_ClearDeviceStats( void )
 {
-	uint8_t	data;
-	
-	while ( I2C_OPEN( slaveAddress ) == I2C_BUSY ) ;
-	I2C_SetDataXferCompleteCallback( I2C_Read_Cmd_Uint8_CB, &data );
-	I2C_SetDataBuffer( &cmd, (uint16_t)sizeof(cmd) );
-	I2C_M_READ_WRITE( M_WRITE );
-	while ( I2C_CLOSE() == I2C_BUSY ) ;
+	uint8_t sreg = SREG;
 	
-	return data;
+	cli();
+	memset( i2c_stats, 0, sizeof(i2c_stats) );
+	SREG = sreg;
 }
 
-i2c_operation_t I2C_Read_Cmd_Uint16_CB( void *p )
+void I2C_DumpStats( void )
 {
-	I2C_SetDataBuffer( p, 2 );
-	I2C_SetDataXferCompleteCallback( I2C_Stop_CB, NULL );
-	return I2C_RESTART_READ;
+	i2c_dev_stats_t st;
+	uint8_t i, sreg;
+	
+	printf("ADDR  XFER  DONE  FAIL RETRY  NACK ARB  BERR  TOUT  RCVR    BYTES  MIN/AVG/MAX[us]\r\n");
+	for ( i = 0; i < I2C_DEV_STATS_SIZE; i++ )
+	{
+		sreg = SREG;
+		cli();
+		st = i2c_stats[i];		// 출력 중에 ISR이 바꾸지 않도록 복사
+		SREG = sreg;
+		
+		if ( st.transfers == 0 )
+			continue;
+		
+		printf("0x%02X %5u %5u %5u %5u %5u %4u %5u %5u %5u %8lu  %u/%lu/%u\r\n",
+			   st.address, st.transfers, st.transactions, st.failures, st.retries,
+			   st.nack, st.arblost, st.buserr, st.timeout, st.recoveries, (unsigned long)st.bytes,
+			   st.time_min, st.transactions ? (unsigned long)( st.time_sum / st.transactions ) : 0UL, st.time_max);
+		if ( st.transactions )
+			printf("      transitions/xfer %lu, ISR cycles/xfer %lu\r\n",
+				   (unsigned long)( st.transitions / st.transactions ),
+				   (unsigned long)( I2C_TICKS_TO_CYCLES( st.isr_ticks ) / st.transactions ));
+	}
 }
 
-uint16_t I2C_Read_Cmd_Uint16(i2c_address_t slaveAddress, uint8_t cmd)
+uint8_t I2C_ScanBus( uint8_t *found, uint8_t max )
 {
-	uint16_t data;
-	while(I2C_OPEN(slaveAddress) == I2C_BUSY);
-	I2C_SetDataXferCompleteCallback( I2C_Read_Cmd_Uint16_CB, &data );
-	I2C_SetDataBuffer( &cmd, (uint16_t)sizeof(cmd) );
-	I2C_M_READ_WRITE( M_WRITE );
-	while ( I2C_CLOSE() == I2C_BUSY ) ;
+	i2c_xfer_t xfer;
+	uint8_t address, count = 0;
 	
-	return ( data << 8 | data >> 8 );
+	for ( address = 0x08; address <= 0x77 && count < max; address++ )
+	{
+		I2C_Xfer_Segments( &xfer, address, NULL, 0 );
+		xfer.flags = I2C_XFER_NORETRY | I2C_XFER_NOSTATS;
+		if ( I2C_Transfer( &xfer ) == I2C_NOERROR )
+			found[count++] = address;
+	}
+	return count;
 }
 
-i2c_operation_t I2C_Read_Cmd_Block_CB( void *p )
+//////////////////////////////////////////////////////////////////////////
+// Blocking API (I2C_Transfer() wrapper)
+
+i2c_error_t I2C_Transaction( i2c_address_t slaveAddress, const i2c_segment_t *segments, uint8_t count )
 {
-	i2c_block_t *pp = (i2c_block_t *)p;
+	i2c_xfer_t xfer;
 	
-	I2C_SetDataBuffer( pp->buff, pp->len );
-	I2C_SetDataXferCompleteCallback( I2C_Stop_CB, NULL );
-	
-	return I2C_RESTART_READ;
+	I2C_Xfer_Segments( &xfer, slaveAddress, segments, count );
+	return I2C_Transfer( &xfer );
 }
 
-void I2C_Read_Cmd_Block( i2c_address_t slaveAddress, uint8_t cmd, uint8_t *buffer, uint8_t length )
+bool I2C_Probe( i2c_address_t slaveAddress )
 {
-	i2c_block_t block;
-	
-	block.buff = buffer;
-	block.len = (uint16_t)length;
-	
-	while ( I2C_OPEN( slaveAddress ) == I2C_BUSY ) ;
-	I2C_SetDataXferCompleteCallback( I2C_Read_Cmd_Block_CB, &block );
-	I2C_SetDataBuffer( &cmd, (uint16_t)sizeof(cmd) );
-	I2C_M_READ_WRITE( M_WRITE );
-	while ( I2C_CLOSE() == I2C_BUSY ) ;
+	return I2C_Transaction( slaveAddress, NULL, 0 ) == I2C_NOERROR;
 }
 
-//////////////////////////////////////////////////////////////////////////
-i2c_operation_t I2C_Write_Address_Uint8_CB( void *p )
+void I2C_Write_Command(i2c_address_t slaveAddress, uint8_t cmd)
 {
-	I2C_SetDataBuffer( p, 1 );
-	I2C_SetDataXferCompleteCallback( I2C_Stop_CB, NULL );
-	return I2C_CONTINUE;
+	i2c_xfer_t xfer;
+	
+	I2C_Xfer_Prepare( &xfer, slaveAddress, cmd, 1, NULL, 0, I2C_XFER_WRITE );
+	I2C_Transfer( &xfer );
 }
 
-void I2C_Write_Address_Uint8( i2c_address_t slaveAddress, uint16_t address, uint8_t data )
+void I2C_Write_Cmd_Uint8( i2c_address_t slaveAddress, uint8_t cmd, uint8_t data )
 {
-	while ( I2C_OPEN( slaveAddress ) == I2C_BUSY ) ;
-	I2C_SetDataXferCompleteCallback( I2C_Write_Address_Uint8_CB, &data );
-	address = address << 8 | address >> 8;
-	I2C_SetDataBuffer( &address, sizeof(address) );
-	I2C_M_READ_WRITE( M_WRITE );
-	while ( I2C_CLOSE() == I2C_BUSY ) ;
+	i2c_xfer_t xfer;
+	
+	I2C_Xfer_Prepare( &xfer, slaveAddress, cmd, 1, &data, 1, I2C_XFER_WRITE );
+	I2C_Transfer( &xfer );
 }
 
-i2c_operation_t I2C_Write_Address_Uint16_CB( void *p ) {
-	I2C_SetDataBuffer( p, 2 );
-	I2C_SetDataXferCompleteCallback( I2C_Stop_CB, NULL );
-	return I2C_CONTINUE;
+void I2C_Write_Cmd_Uint16( i2c_address_t slaveAddress, uint8_t cmd, uint16_t data )
+{
+	i2c_xfer_t xfer;
+	
+	data =  data << 8 | data >> 8;
+	I2C_Xfer_Prepare( &xfer, slaveAddress, cmd, 1, (uint8_t *)&data, 2, I2C_XFER_WRITE );
+	I2C_Transfer( &xfer );
 }
 
-void I2C_Write_Address_Uint16( i2c_address_t slaveAddress, uint16_t address, uint16_t data )
+void I2C_Write_Block( i2c_address_t slaveAddress, uint8_t *buffer, uint8_t length )
 {
-	while ( I2C_OPEN( slaveAddress ) == I2C_BUSY ) ;
-	I2C_SetDataXferCompleteCallback( I2C_Write_Address_Uint16_CB, &data );
-	address = address << 8 | address >> 8;
-	I2C_SetDataBuffer( &address, sizeof(address) );
-	I2C_M_READ_WRITE( M_WRITE );
-	while ( I2C_CLOSE() == I2C_BUSY ) ;
+	i2c_xfer_t xfer;
+	
+	I2C_Xfer_Prepare( &xfer, slaveAddress, 0, 0, buffer, (uint16_t)length, I2C_XFER_WRITE );
+	I2C_Transfer( &xfer );
 }
 
-i2c_operation_t I2C_Write_Address_Block_CB( void *p )
+uint8_t I2C_Read_Cmd_Uint8( i2c_address_t slaveAddress, uint8_t cmd )
 {
-	i2c_block_t *pp = (i2c_block_t *)p;
+	i2c_xfer_t xfer;
+	uint8_t	data = 0;
 	
-	I2C_SetDataBuffer( pp->buff, pp->len );
-	I2C_SetDataXferCompleteCallback( I2C_Stop_CB, NULL );
+	I2C_Xfer_Prepare( &xfer, slaveAddress, cmd, 1, &data, 1, I2C_XFER_READ );
+	I2C_Transfer( &xfer );
 	
-	return I2C_CONTINUE;
+	return data;
 }
 
-void I2C_Write_Address_Block( i2c_address_t slaveAddress, uint16_t address, uint8_t *buffer, uint16_t length )
+uint16_t I2C_Read_Cmd_Uint16(i2c_address_t slaveAddress, uint8_t cmd)
 {
-	i2c_block_t block;
+	i2c_xfer_t xfer;
+	uint16_t data = 0;
 	
-	block.buff = buffer;
-	block.len = length;
+	I2C_Xfer_Prepare( &xfer, slaveAddress, cmd, 1, (uint8_t *)&data, 2, I2C_XFER_READ );
+	I2C_Transfer( &xfer );
 	
-	while ( I2C_OPEN( slaveAddress ) == I2C_BUSY ) ;
-	I2C_SetDataXferCompleteCallback( I2C_Write_Address_Block_CB, &block );
-	address = address << 8 | address >> 8;
-	I2C_SetDataBuffer( &address, sizeof(address) );
-	I2C_M_READ_WRITE( M_WRITE );
-	while ( I2C_CLOSE() == I2C_BUSY ) ;
+	return ( data << 8 | data >> 8 );
 }
 
-i2c_operation_t I2C_Read_Address_Uint8_CB( void *p )
+void I2C_Read_Cmd_Block( i2c_address_t slaveAddress, uint8_t cmd, uint8_t *buffer, uint8_t length )
 {
-	I2C_SetDataBuffer( p, 1 );
-	I2C_SetDataXferCompleteCallback( I2C_Stop_CB, NULL );
-	return I2C_RESTART_READ;
+	i2c_xfer_t xfer;
+	
+	I2C_Xfer_Prepare( &xfer, slaveAddress, cmd, 1, buffer, (uint16_t)length, I2C_XFER_READ );
+	I2C_Transfer( &xfer );
 }
 
-uint8_t I2C_Read_Address_Uint8( i2c_address_t slaveAddress, uint16_t address )
+//////////////////////////////////////////////////////////////////////////
+void I2C_Write_Address_Uint8( i2c_address_t slaveAddress, uint16_t address, uint8_t data )
 {
-	uint8_t		data;
+	i2c_xfer_t xfer;
 	
-	while ( I2C_OPEN( slaveAddress ) == I2C_BUSY ) ;
-	I2C_SetDataXferCompleteCallback( I2C_Read_Address_Uint8_CB, &data );
-	address = address << 8 | address >> 8;
-	I2C_SetDataBuffer( &address, sizeof(address) );
-	I2C_M_READ_WRITE( M_WRITE );
-	while ( I2C_CLOSE() == I2C_BUSY ) ;
+	I2C_Xfer_Prepare( &xfer, slaveAddress, address, 2, &data, 1, I2C_XFER_WRITE );
+	I2C_Transfer( &xfer );
+}
+
+void I2C_Write_Address_Uint16( i2c_address_t slaveAddress, uint16_t address, uint16_t data )
+{
+	i2c_xfer_t xfer;
 	
-	return data;
+	I2C_Xfer_Prepare( &xfer, slaveAddress, address, 2, (uint8_t *)&data, 2, I2C_XFER_WRITE );
+	I2C_Transfer( &xfer );
 }
 
-i2c_operation_t I2C_Read_Address_Uint16_CB( void *p )
+void I2C_Write_Address_Block( i2c_address_t slaveAddress, uint16_t address, uint8_t *buffer, uint16_t length )
 {
-	I2C_SetDataBuffer( p, 2 );
-	I2C_SetDataXferCompleteCallback( I2C_Stop_CB, NULL );
-	return I2C_RESTART_READ;
+	i2c_xfer_t xfer;
+	
+	I2C_Xfer_Prepare( &xfer, slaveAddress, address, 2, buffer, length, I2C_XFER_WRITE );
+	I2C_Transfer( &xfer );
 }
 
-uint16_t I2C_Read_Address_Uint16( i2c_address_t slaveAddress, uint16_t address )
+uint8_t I2C_Read_Address_Uint8( i2c_address_t slaveAddress, uint16_t address )
 {
-	uint16_t		data;
+	i2c_xfer_t xfer;
+	uint8_t		data = 0;
 	
-	while ( I2C_OPEN( slaveAddress ) == I2C_BUSY ) ;
-	I2C_SetDataXferCompleteCallback( I2C_Read_Address_Uint16_CB, &data );
-	address = address << 8 | address >> 8;
-	I2C_SetDataBuffer( &address, sizeof(address) );
-	I2C_M_READ_WRITE( M_WRITE );
-	while ( I2C_CLOSE() == I2C_BUSY ) ;
+	I2C_Xfer_Prepare( &xfer, slaveAddress, address, 2, &data, 1, I2C_XFER_READ );
+	I2C_Transfer( &xfer );
 	
 	return data;
 }
 
-
-i2c_operation_t I2C_Read_Address_Block_CB( void *p )
+uint16_t I2C_Read_Address_Uint16( i2c_address_t slaveAddress, uint16_t address )
 {
-	i2c_block_t *pp = (i2c_block_t *)p;
+	i2c_xfer_t xfer;
+	uint16_t		data = 0;
 	
-	I2C_SetDataBuffer( pp->buff, pp->len );
-	I2C_SetDataXferCompleteCallback( I2C_Stop_CB, NULL );
+	I2C_Xfer_Prepare( &xfer, slaveAddress, address, 2, (uint8_t *)&data, 2, I2C_XFER_READ );
+	I2C_Transfer( &xfer );
 	
-	return I2C_RESTART_READ;
+	return data;
 }
 
 void I2C_Read_Address_Block( i2c_address_t slaveAddress, uint16_t address, uint8_t *buffer, uint16_t length )
 {
-	i2c_block_t block;
-	
-	block.buff = buffer;
-	block.len = length;
+	i2c_xfer_t xfer;
 	
-	while ( I2C_OPEN( slaveAddress ) == I2C_BUSY ) ;
-	I2C_SetDataXferCompleteCallback( I2C_Read_Address_Block_CB, &block );
-	address = address << 8 | address >> 8;
-	I2C_SetDataBuffer( &address, sizeof(address) );
-	I2C_M_READ_WRITE( M_WRITE );
-	while ( I2C_CLOSE() == I2C_BUSY ) ;
+	I2C_Xfer_Prepare( &xfer, slaveAddress, address, 2, buffer, length, I2C_XFER_READ );
+	I2C_Transfer( &xfer );
 }
@@ -0,0 +1,109 @@
+﻿#define F_CPU 5000000UL
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include "i2c_slave.h"
+
+#define I2C_SLAVE_NONE		0xFF
+
+static i2c_slave_regs_t	slave_regs[2];
+static volatile uint8_t	slave_front = 0;				// Host가 읽을 버퍼
+static volatile uint8_t	slave_latched = I2C_SLAVE_NONE;	// 트랜잭션 중 Host가 읽고 있는 버퍼
+static uint8_t			slave_pointer = 0;
+static bool				slave_first = false;		// 주소 다음 첫 Write byte(Register Pointer) 대기
+static uint8_t			slave_sent = 0;
+
+void I2C_Slave_Init(uint8_t address)
+{
+	PORTC.DIRCLR = PIN2_bm | PIN3_bm;
+
+	memset(slave_regs, 0, sizeof(slave_regs));
+
+	TWI0.DUALCTRL = TWI_ENABLE_bm;			// Slave를 PC2/PC3로 분리
+	TWI0.SADDR = address << 1;
+	TWI0.SCTRLA = TWI_DIEN_bm | TWI_APIEN_bm | TWI_PIEN_bm | TWI_ENABLE_bm;
+}
+
+i2c_slave_regs_t* I2C_Slave_Begin(void)
+{
+	uint8_t back;
+
+	cli();
+	back = slave_front ^ 1;
+	if (slave_latched == back) {
+		sei();
+		return NULL;
+	}
+	sei();
+
+	// front는 Commit 전까지 바뀌지 않으므로 인터럽트를 켠 상태로 복사해도 된다.
+	memcpy(&slave_regs[back], &slave_regs[slave_front], sizeof(i2c_slave_regs_t));
+	return &slave_regs[back];
+}
+
+void I2C_Slave_Commit(void)
+{
+	uint8_t back = slave_front ^ 1;
+
+	slave_regs[back].seq++;
+	cli();
+	slave_front = back;
+	sei();
+}
+
+ISR(TWI0_TWIS_vect)
+{
+	uint8_t status = TWI0.SSTATUS;
+
+	if (status & (TWI_COLL_bm | TWI_BUSERR_bm)) {
+		TWI0.SSTATUS = TWI_COLL_bm | TWI_BUSERR_bm;
+		TWI0.SCTRLB = TWI_SCMD_COMPTRANS_gc;
+		slave_latched = I2C_SLAVE_NONE;
+		return;
+	}
+
+	if (status & TWI_APIF_bm) {
+		if (status & TWI_AP_bm) {
+			// 주소 일치 (START 또는 Repeated START) → 이 시점의 front를 고정
+			slave_latched = slave_front;
+			slave_first = !(status & TWI_DIR_bm);
+			slave_sent = 0;
+			TWI0.SCTRLB = TWI_SCMD_RESPONSE_gc;
+		}
+		else {
+			// STOP
+			slave_latched = I2C_SLAVE_NONE;
+			TWI0.SCTRLB = TWI_SCMD_COMPTRANS_gc;
+		}
+		return;
+	}
+
+	if (status & TWI_DIF_bm) {
+		if (status & TWI_DIR_bm) {
+			// Host Read : 앞 byte에 NACK이면 전송 끝
+			if (slave_sent && (status & TWI_RXACK_bm)) {
+				TWI0.SCTRLB = TWI_SCMD_COMPTRANS_gc;
+				return;
+			}
+			if (slave_pointer < sizeof(i2c_slave_regs_t) && slave_latched != I2C_SLAVE_NONE)
+				TWI0.SDATA = ((const uint8_t *)&slave_regs[slave_latched])[slave_pointer];
+			else
+				TWI0.SDATA = 0xFF;
+			slave_pointer++;
+			slave_sent++;
+			TWI0.SCTRLB = TWI_SCMD_RESPONSE_gc;
+		}
+		else {
+			// Host Write : 첫 byte만 Register Pointer로 사용
+			uint8_t data = TWI0.SDATA;
+
+			if (slave_first) {
+				slave_pointer = data;
+				slave_first = false;
+			}
+			TWI0.SCTRLB = TWI_SCMD_RESPONSE_gc;
+		}
+	}
+}
@@ -0,0 +1,59 @@
+﻿#ifndef I2C_SLAVE_H_
+#define I2C_SLAVE_H_
+
+/*
+ * #TWI_Slave #DualMode #RegisterMap
+ *
+ * TWI0를 Dual Mode로 사용하여 Master(PA2/PA3)는 센서 버스를 그대로 쓰고,
+ * Slave(PC2 SDA / PC3 SCL)는 외부 Host(상위 제어기)에 보드 상태를 Register Map으로 제공한다.
+ *
+ * Host 사용법 (일반적인 I2C Register Read)
+ *   START, SLA+W, reg, Repeated START, SLA+R, data..., NACK, STOP
+ *   - 첫 Write byte가 Register Pointer가 되고, Read 마다 1씩 증가한다.
+ *   - Map 범위를 넘으면 0xFF를 보낸다. 그 외의 Write byte는 무시한다.
+ *
+ * #DoubleBuffer
+ * Map은 두 벌이 있고 Host는 항상 "front"를 읽는다.
+ * Host의 주소가 일치하는 순간 front를 latch하므로, 트랜잭션 도중에 애플리케이션이
+ * 값을 바꿔도 Host는 한 시점의 일관된 값만 받는다. (Tearing 없음)
+ * 애플리케이션은 I2C_Slave_Begin()으로 받은 "back"에 쓰고 I2C_Slave_Commit()으로 교체한다.
+ */
+
+#define I2C_SLAVE_ADDRESS       0x30
+
+/*
+ * Register Map (multi-byte는 Little-Endian)
+ *
+ * 0x00 status      : I2C_SLAVE_VALID_xxx (해당 값이 한 번 이상 갱신되었는지)
+ * 0x01 seq         : Commit 할 때마다 1씩 증가
+ * 0x02 adc         : 최근 ADC 값 (2 byte)
+ * 0x04 temperature : DS1621_READ_TEMPERATURE() 형식 (2 byte, MSB = 정수부, bit7 = 0.5°C)
+ * 0x06 rtc[7]      : 초, 분, 시, 일, 요일, 월, 년 (Binary)
+ * 0x0D keys        : Key bitmap (2 byte)
+ */
+#define I2C_SLAVE_VALID_ADC     0x01
+#define I2C_SLAVE_VALID_TEMP    0x02
+#define I2C_SLAVE_VALID_RTC     0x04
+#define I2C_SLAVE_VALID_KEYS    0x08
+
+typedef struct
+{
+	uint8_t  status;
+	uint8_t  seq;
+	uint16_t adc;
+	uint16_t temperature;
+	uint8_t  rtc[7];
+	uint16_t keys;
+} __attribute__((packed)) i2c_slave_regs_t;
+
+void I2C_Slave_Init(uint8_t address);
+
+/*
+ * back 버퍼를 front 값으로 채워 돌려준다. 바꿀 항목만 쓰고 I2C_Slave_Commit()을 호출한다.
+ * Host가 아직 이전 front(= 이번 back)를 읽는 중이면 NULL을 돌려주며, 기다리지 않고
+ * 다음 갱신 때 다시 시도하면 된다.
+ */
+i2c_slave_regs_t* I2C_Slave_Begin(void);
+void I2C_Slave_Commit(void);
+
+#endif /* I2C_SLAVE_H_ */
@@ -32,6 +32,7 @@
  *       + (Slope - Count_Remaining) / Slope
  *
  * 이 방법을 사용하면 0.01°C ~ 0.1°C 단위까지 정밀도가 향상된다.
+ * DS1621_ReadHighRes()는 이 계산을 0.01°C 단위 정수(centi-degree)로 한다. (float 없음)
  *
  * callback)
  * 일반적인 애플리케이션은 READ_TEMPERATURE로 충분하지만,
@@ -48,37 +49,96 @@
 
 #include "i2c.h"
 #include "ds1621.h"
+#include "i2c_slave.h"
 #include "uart.h"
 
 void CLK_Init(void);
 void TCB0_Init(void);
 
-volatile bool flag = false;
+/*
+ * #Benchmark
+ * 1로 바꾸면 부팅 때 같은 측정값을 두 가지 방법으로 문자열로 바꾸는 시간을 비교한다.
+ *   float : 예전 main()의 방식 ((float)정수부 + 0.5, sprintf "%4.1f")
+ *   int   : centi-degree, sprintf "%d.%02d"
+ * 시간은 I2C 통계용 Free-running Timer(CLK_PER/2)로 재므로 CPU cycle = tick * 2.
+ * Flash는 이 비교 코드를 끄고 float 경로를 없앤 뒤 libprintf_flt, libm을 빼고 .map/avr-size로 비교한다.
+ */
+#define DS1621_BENCHMARK 0
+
+#if DS1621_BENCHMARK
+static void DS1621_Benchmark(void)
+{
+	char buf[16];
+	uint16_t raw, t0, tFloat, tInt;
+	int16_t centi;
+	
+	if (!DS1621_ReadHighRes(&centi, &raw))
+		return;
+	
+	t0 = I2C_STATS_TIMER.CNT;
+	sprintf(buf,"%4.1f",((float)(raw>>8) + ((raw & 0x80) ? 0.5 : 0.0)) );
+	tFloat = I2C_STATS_TIMER.CNT - t0;
+	
+	t0 = I2C_STATS_TIMER.CNT;
+	sprintf(buf, "%d.%02d", centi / 100, (centi < 0 ? -centi : centi) % 100);
+	tInt = I2C_STATS_TIMER.CNT - t0;
+	
+	printf("float path : %u cycles\r\n", tFloat * 2);
+	printf("int path   : %u cycles (%s)\r\n", tInt * 2, buf);
+}
+#endif
 
 int main(void)
 {
 	char tbuffer[16];
-	uint16_t temp = 0;
+	ds1621_sample_t sample;
+	uint16_t lastSeq = 0;
+	bool alarm;
 	
 	CLK_Init();
 	TCB0_Init();
 	I2C_Init();
+	I2C_Slave_Init(I2C_SLAVE_ADDRESS);	// 상위 제어기용 Register Map
 	
 	USART0_Init(115200);
 	
 	sprintf(tbuffer,"Hello");
 	printf("%s\r\n", tbuffer);
 	
+	sei();	// I2C 전송은 TWI 인터럽트로 진행되므로 먼저 Enable
+	
+#if DS1621_BENCHMARK
 	DS1621_START_CONVERT_T();
+	DS1621_Benchmark();
+#endif
 	
-	sei();
+	DS1621_Sampler_Init();	// 1SHOT 모드, 1초마다 변환 → Cache
+	DS1621_Alarm_Init(DS1621_HALF(30), DS1621_HALF(28), NULL);	// 30°C 이상 Alarm, 28°C 이하 해제 (TOUT → PD2)
 	
     while (1) 
     {
-		if(flag)
+		I2C_Task();				// Bus Error/Timeout 뒤의 Bus Recovery
+		DS1621_Sampler_Task();	// 버스 상태만 확인하고 바로 리턴
+		
+		// TOUT Edge는 ISR이 잡는다. 여기서는 이벤트만 확인한다. (I2C 사용 없음)
+		if(DS1621_Alarm_Event(&alarm))
+			printf(alarm ? "OVER TEMP!!\r\n" : "temp normal\r\n");
+		
+		// Cache 읽기는 O(1), 버스 사용 없음. 새 값일 때만 처리한다.
+		if(DS1621_GetSample(&sample) && sample.seq != lastSeq)
 		{
-			flag = false;
-			sprintf(tbuffer,"%4.1f",((float)(DS1621_READ_TEMPERATURE()>>8) + ((DS1621_READ_TEMPERATURE() & 0x80) ? 0.5 : 0.0)) );
+			i2c_slave_regs_t *regs = I2C_Slave_Begin();
+			
+			lastSeq = sample.seq;
+			if(regs)	// Host가 이전 값을 읽는 중이면 이번 갱신은 건너뛴다.
+			{
+				regs->temperature = sample.raw;
+				regs->status |= I2C_SLAVE_VALID_TEMP;
+				I2C_Slave_Commit();
+			}
+			
+			sprintf(tbuffer, "%s%d.%02d", (sample.centi < 0 && sample.centi > -100) ? "-" : "", sample.centi / 100,
+			        (sample.centi < 0 ? -sample.centi : sample.centi) % 100);
 			printf("%s\r\n", tbuffer);
 		}
     }
@@ -99,11 +159,13 @@ void TCB0_Init(void)
 
 ISR(TCB0_INT_vect)
 {
-	static uint16_t Cnt1000Hz = 0;
-	uint16_t Cnt1Hz = (uint16_t)(Cnt1000Hz % 1000);
-	Cnt1000Hz++;
-	
-	if(Cnt1Hz == 0) flag = true;
+	I2C_TickISR();
+	DS1621_Sampler_TickISR();
 
 	TCB0.INTFLAGS |= TCB_CAPT_bm;
+}
+
+ISR(PORTD_PORT_vect)
+{
+	DS1621_Alarm_PinISR();	// TOUT (PD2)
 }
\ No newline at end of file
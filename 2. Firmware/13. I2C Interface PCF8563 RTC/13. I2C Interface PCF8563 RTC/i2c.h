@@ -3,6 +3,67 @@
 
 typedef uint16_t i2c_address_t;
 
+/*
+ * #BusSpeed
+ *
+ * 데이터시트의 SCL 주파수 공식
+ *   f_SCL = f_CLK_PER / (10 + 2 * MBAUD + f_CLK_PER * T_rise)
+ * 을 MBAUD에 대해 정리한 값이다. 나누어 떨어지지 않으면 올림하여
+ * 실제 f_SCL이 요청한 값보다 빨라지지 않게 한다. (0 ~ 255로 제한)
+ * 인자가 상수이면 컴파일 시간에 계산된다.
+ *
+ * MBAUD = 0 일 때가 최대 속도이므로 F_CPU = 5MHz 에서는 약 500kHz가 한계이다.
+ * Fm+(1MHz)는 F_CPU = 20MHz(Prescaler 없음)에서 사용할 수 있다.
+ */
+#define I2C_SCL_CYCLES(hz)			(((uint32_t)F_CPU + (hz) - 1) / (hz))
+#define I2C_RISE_CYCLES(ns)			(((uint32_t)F_CPU / 1000UL) * (ns) / 1000000UL)
+#define I2C_MBAUD_RAW(hz, ns)		(((int32_t)I2C_SCL_CYCLES(hz) - 10 - (int32_t)I2C_RISE_CYCLES(ns) + 1) / 2)
+#define I2C_MBAUD(hz, ns)			((I2C_MBAUD_RAW(hz, ns) < 0) ? 0 : \
+									 (I2C_MBAUD_RAW(hz, ns) > 255) ? 255 : (uint8_t)I2C_MBAUD_RAW(hz, ns))
+
+#define I2C_SPEED_STANDARD			100000UL
+#define I2C_SPEED_FAST				400000UL
+#define I2C_SPEED_FAST_PLUS			1000000UL
+
+#define I2C_DEFAULT_SPEED			I2C_SPEED_STANDARD
+#define I2C_DEFAULT_RISE_NS			0
+
+/*
+ * #BusHealth
+ *
+ * I2C_BUS_TIMEOUT     : TWI 하드웨어 Inactive Bus Timeout (MCTRLA.TIMEOUT)
+ *                       SCL이 이 시간 동안 High로 머물면 Bus State를 IDLE로 되돌린다.
+ * I2C_WATCHDOG_MS(n)  : n byte 트랜잭션의 소프트웨어 Watchdog 시간 [ms]
+ *                       100kHz에서 1byte(9clock)는 약 90us이므로 8byte/ms로 넉넉하게 잡는다.
+ * I2C_DEFAULT_RETRY   : 실패한 트랜잭션을 다시 시도하는 기본 횟수
+ * I2C_DEV_STATS_SIZE  : 에러 통계를 기록할 Slave 주소의 개수
+ *
+ * Watchdog은 I2C_TickISR()이 1ms마다 호출되어야 동작한다.
+ */
+#define I2C_BUS_TIMEOUT				TWI_TIMEOUT_200US_gc
+#define I2C_WATCHDOG_BASE_MS		5
+#define I2C_WATCHDOG_MS(n)			(I2C_WATCHDOG_BASE_MS + ((n) >> 3))
+#define I2C_DEFAULT_RETRY			2
+#define I2C_DEV_STATS_SIZE			4
+
+/*
+ * #Instrumentation
+ *
+ * 트랜잭션 시간 측정용 Free-running Timer.
+ * CLK_PER/2 (F_CPU 5MHz → 0.4us/tick)로 0xFFFF까지 세고, Overflow는 TCB1 인터럽트가 상위 16bit로 센다.
+ * 다른 용도로 TCB1을 쓰는 프로젝트라면 바꿔서 사용한다.
+ */
+#define I2C_STATS_TIMER				TCB1
+#define I2C_STATS_TIMER_vect		TCB1_INT_vect
+#define I2C_TICKS_TO_US(t)			((t) * 2UL / (F_CPU / 1000000UL))
+#define I2C_TICKS_TO_CYCLES(t)		((t) * 2UL)
+#define I2C_TICKS_PER_MS			(F_CPU / 2000UL)
+
+#define I2C_SDA_PORT				PORTA
+#define I2C_SDA_bm					PIN2_bm
+#define I2C_SCL_bm					PIN3_bm
+#define I2C_RECOVERY_HALF_US		5		// Bit-bang SCL 반주기 (약 100kHz)
+
 typedef enum
 {
 	I2C_IDLE,
@@ -10,7 +71,6 @@ typedef enum
 	I2C_SEND_ADDR_READ,
 	I2C_TX,
 	I2C_RX,
-	I2C_TX_COMPLETE,
 	I2C_STOP,
 	
 	I2C_NACK_STOP,
@@ -22,21 +82,54 @@ typedef enum
 	I2C_RESET
 }i2c_handler_t;
 
-typedef enum
-{
-	I2C_OPERATION_STOP,
-	I2C_RESTART_WRITE,
-	I2C_RESTART_READ,
-	I2C_CONTINUE
-}i2c_operation_t;
-
 typedef enum
 {
 	I2C_ERROR,
 	I2C_NOERROR,
-	I2C_BUSY
+	I2C_BUSY,
+	I2C_TIMEOUT						// Watchdog 만료 (Bus Recovery 후 종료)
 }i2c_error_t;
 
+typedef enum
+{
+	I2C_FAULT_NONE,
+	I2C_FAULT_NACK,
+	I2C_FAULT_ARBLOST,
+	I2C_FAULT_BUSERR,
+	I2C_FAULT_TIMEOUT
+}i2c_fault_t;
+
+/*
+ * Slave 주소별 통계.
+ * transfers    = 시도(attempt) 수, 에러 카운터도 시도 단위
+ * transactions = 재시도를 포함해 끝난 트랜잭션 수, failures는 그중 최종 실패 수
+ * bytes/time   = 끝난 트랜잭션 기준. time은 첫 START부터 완료까지 [us]
+ *                (평균 = time_sum / transactions, 65535us에서 포화)
+ * transitions  = stateHandlerTable 호출 횟수 합 (재시도 포함)
+ * isr_ticks    = TWI0_TWIM_vect 안에서 보낸 시간 합 [Timer tick, I2C_TICKS_TO_CYCLES()로 CPU cycle 환산]
+ *                완료 callback과 다음 Descriptor 시작 비용은 포함하지 않는다.
+ * Driver를 바꾼 뒤 transaction당 transitions/cycles를 비교하면 최적화 효과를 보드에서 바로 잴 수 있다.
+ */
+typedef struct
+{
+	i2c_address_t address;
+	uint16_t transfers;
+	uint16_t transactions;
+	uint16_t failures;
+	uint16_t retries;
+	uint16_t nack;
+	uint16_t arblost;
+	uint16_t buserr;
+	uint16_t timeout;
+	uint16_t recoveries;
+	uint32_t bytes;
+	uint16_t time_min;
+	uint16_t time_max;
+	uint32_t time_sum;
+	uint32_t transitions;
+	uint32_t isr_ticks;
+}i2c_dev_stats_t;
+
 typedef enum
 {
 	M_WRITE,
@@ -44,34 +137,185 @@ typedef enum
 }i2c_m_read_write_t;
 
 typedef i2c_handler_t (*stateHandler)(void);
-typedef i2c_operation_t (*i2c_callback_t)(void* p);
+
+/*
+ * #ScatterSegment
+ *
+ * 트랜잭션의 한 구간. 하나의 START ~ STOP 안에서 Segment 배열을 순서대로 처리한다.
+ * 방향이 바뀌는 곳(Write → Read, Read → Write)에서만 Repeated START를 넣고,
+ * 같은 방향의 Segment는 끊김 없이 이어서 보내거나 받는다. (길이 0인 Segment는 건너뜀)
+ *
+ * 예) Word Address 2byte를 쓰고 64byte를 읽는 EEPROM Read
+ *   i2c_segment_t seg[] = {
+ *       { addr, 2,  I2C_SEG_WRITE },
+ *       { buf,  64, I2C_SEG_READ  }
+ *   };
+ *   I2C_Transaction(0x50, seg, 2);
+ */
+#define I2C_SEG_WRITE				0x00
+#define I2C_SEG_READ				0x01
+
+typedef struct
+{
+	uint8_t* buffer;
+	uint16_t length;
+	uint8_t flags;					// I2C_SEG_WRITE / I2C_SEG_READ
+}i2c_segment_t;
 
 typedef struct
 {
 	uint8_t busy : 1;
-	uint8_t inUse : 1;
-	uint8_t bufferFree : 1;
 	uint8_t addressNACKCheck : 1;
+	uint8_t seg_read : 1;			// 현재 Segment 방향
 	
 	i2c_address_t SlaveAddress;
-	uint8_t* data_ptr;
+	uint8_t* data_ptr;				// 현재 Segment의 남은 구간
 	uint16_t data_length;
+	const i2c_segment_t* seg;		// 다음 Segment
+	uint8_t seg_left;
 	i2c_handler_t handler;
 	i2c_error_t error;
-	
-	i2c_callback_t callbackDataXferComplete;
-	void* callbackDataParameter;
 }i2c_info_t;
 
-typedef struct
+/*
+ * #NonBlocking #TransactionQueue
+ *
+ * 하나의 I2C 트랜잭션(START ~ STOP)을 기술하는 Descriptor.
+ * segments/segment_count가 트랜잭션 전체를 기술하며 segment_count가 0이면
+ * 주소만 보내고 ACK를 확인한다. (I2C_Probe())
+ *
+ * seg[]/reg[]는 I2C_Xfer_Prepare()가 쓰는 내부 저장소로
+ *   seg[0] = reg (Command, Register, Word Address 등) Write
+ *   seg[1] = data, direction에 따라 Write 또는 Read
+ * 의 흔한 형태를 호출한 쪽이 별도의 배열 없이 만들 수 있게 해준다.
+ *
+ * I2C_Submit()으로 큐에 넣으면 즉시 리턴하고, 이후의 모든 진행은 TWI0_TWIM_vect가 한다.
+ * 트랜잭션이 끝나면 status가 I2C_NOERROR/I2C_ERROR로 바뀌고 callback(ISR 문맥)이 호출되며,
+ * ISR은 곧바로 큐의 다음 Descriptor를 시작한다.
+ * Descriptor 메모리는 완료될 때까지 호출한 쪽이 유지해야 한다.
+ */
+typedef enum
 {
-	uint8_t* buff;
-	uint16_t len;
-}i2c_block_t;
+	I2C_XFER_WRITE,
+	I2C_XFER_READ
+}i2c_xfer_dir_t;
+
+/*
+ * #Priority
+ * 큐는 priority 순(0이 가장 높음)으로 정렬되고, 같은 priority 안에서는 들어온 순서를 지킨다.
+ * 진행 중인 트랜잭션은 끊지 않으므로, 높은 priority 요청의 최대 대기 시간은
+ * 낮은 priority Client가 한 번에 보내는 트랜잭션의 크기로 정해진다.
+ * 큰 전송을 하는 Client(EEPROM 등)는 이를 작게 나누어 Submit해야 한다.
+ */
+#define I2C_PRIO_HIGH				0		// RTC, 센서 등 지연에 민감한 짧은 Read
+#define I2C_PRIO_NORMAL				1		// 기본값 (Blocking API)
+#define I2C_PRIO_LOW				2		// EEPROM Block 전송 등
+
+#define I2C_XFER_NORETRY			0x01	// 실패해도 재시도하지 않는다.
+#define I2C_XFER_NOSTATS			0x02	// 주소별 통계에 기록하지 않는다. (Bus Scan 등)
+
+typedef struct i2c_xfer i2c_xfer_t;
+typedef void (*i2c_xfer_callback_t)(i2c_xfer_t *xfer);
+
+struct i2c_xfer
+{
+	i2c_address_t address;
+	
+	const i2c_segment_t* segments;
+	uint8_t segment_count;
+	
+	i2c_segment_t seg[2];
+	uint8_t reg[2];
+	
+	uint8_t flags;					// I2C_XFER_NORETRY / I2C_XFER_NOSTATS
+	uint8_t priority;				// I2C_PRIO_xxx
+	
+	i2c_xfer_callback_t callback;	// NULL 가능, ISR 문맥에서 호출
+	void* context;
+	
+	volatile i2c_error_t status;	// I2C_BUSY → I2C_NOERROR / I2C_ERROR / I2C_TIMEOUT
+	uint8_t attempts;				// 재시도 횟수 (I2C_Submit()에서 0으로 초기화)
+	i2c_xfer_t* next;
+};
 
 
 void I2C_Init(void);
 
+/*
+ * SCL 주파수를 바꾸고 실제로 설정된 주파수[Hz]를 돌려준다.
+ * hz가 400kHz를 넘으면 Fm+ 드라이버(TWI_FMPEN)를 켜고, 아니면 끈다.
+ * MBAUD는 Master가 꺼진 상태에서만 쓸 수 있으므로 진행 중인 트랜잭션과 큐가 끝날 때까지 기다린다.
+ * 인터럽트가 꺼진 상태에서 부르면 I2C_Transfer()처럼 TWI0를 Polling해서 큐를 직접 비운다.
+ */
+uint32_t I2C_SetBusSpeed( uint32_t hz, uint16_t rise_time_ns );
+
+/*
+ * SDA Hold/Setup 시간 설정 (TWI0.CTRLA)
+ * sdahold  : TWI_SDAHOLD_OFF_gc / _50NS_gc / _300NS_gc / _500NS_gc
+ * sdasetup : TWI_SDASETUP_4CYC_gc / TWI_SDASETUP_8CYC_gc
+ */
+void I2C_SetSdaTiming( uint8_t sdahold, uint8_t sdasetup );
+
+/*
+ * segments 배열(count개)로 Descriptor를 만든다. 배열은 완료될 때까지 유지되어야 한다.
+ * callback/context/flags는 0, priority는 I2C_PRIO_NORMAL로 초기화된다.
+ */
+void I2C_Xfer_Segments( i2c_xfer_t *xfer, i2c_address_t slaveAddress, const i2c_segment_t *segments, uint8_t count );
+
+/*
+ * reg_length(0~2) 바이트의 reg 값(2byte면 MSB 먼저)을 Write Segment로,
+ * data를 direction 방향의 Segment로 하는 2-Segment Descriptor를 만든다.
+ */
+void I2C_Xfer_Prepare( i2c_xfer_t *xfer, i2c_address_t slaveAddress, uint16_t reg, uint8_t reg_length,
+					   uint8_t *data, uint16_t length, i2c_xfer_dir_t direction );
+bool I2C_Submit( i2c_xfer_t *xfer );		// 큐에 priority 순으로 추가 (완료 callback 안에서 다시 Submit해도 된다)
+bool I2C_IsIdle( void );					// 진행 중이거나 대기 중인 트랜잭션이 없으면 true
+
+/*
+ * Submit 후 완료까지 대기 (Blocking)
+ * 보통은 TWI ISR이 진행시키는 동안 status만 보고 기다린다.
+ * 인터럽트가 꺼진 상태(sei() 전, ISR이나 완료 callback 안)에서 부르면 TWI0.MSTATUS를
+ * Polling해서 직접 진행시키고, Watchdog도 Stats Timer로 직접 센다. (앞에 대기 중인 트랜잭션도 함께 처리된다)
+ */
+i2c_error_t I2C_Transfer( i2c_xfer_t *xfer );
+
+/*
+ * 1ms 주기 Timer ISR에서 호출한다.
+ * 진행 중인 트랜잭션이 I2C_WATCHDOG_MS() 안에 끝나지 않으면 TWI를 멈추고
+ * I2C_Task()에 Bus Recovery를 맡긴다. Recovery 후 재시도하거나 I2C_TIMEOUT으로 완료된다.
+ */
+void I2C_TickISR( void );
+
+/*
+ * main loop에서 계속 호출한다.
+ * Bus Error나 Timeout 뒤의 Bus Recovery(SCL 9clock Bit-bang)는 ISR이 아니라 여기서 한다.
+ * Recovery가 끝날 때까지 그 트랜잭션과 큐는 멈춰 있으므로, 비동기 API만 쓰는 경우에도 반드시 부른다.
+ * (I2C_Transfer()와 I2C_SetBusSpeed()는 기다리는 동안 직접 부른다)
+ */
+void I2C_Task( void );
+
+/*
+ * Slave가 SDA를 Low로 잡고 있는 경우를 푼다.
+ * TWI를 끄고 SCL을 최대 9번 Bit-bang한 뒤 STOP을 만들고 TWI를 다시 켠다.
+ * SDA가 High로 풀렸으면 true. (트랜잭션 진행 중에는 호출하지 말 것)
+ */
+bool I2C_BusRecover( void );
+
+void I2C_SetRetryCount( uint8_t retries );
+const i2c_dev_stats_t* I2C_GetDeviceStats( i2c_address_t slaveAddress );	// 기록이 없으면 NULL
+void I2C_ClearDeviceStats( void );
+void I2C_DumpStats( void );					// 주소별 통계를 printf로 출력
+
+/*
+ * #BusScan
+ * 0x08 ~ 0x77 주소에 Address-only Write를 보내 ACK하는 주소를 found[]에 채우고 개수를 돌려준다.
+ * (재시도 없음, 통계에 기록하지 않음, Blocking)
+ */
+uint8_t I2C_ScanBus( uint8_t *found, uint8_t max );
+
+i2c_error_t I2C_Transaction( i2c_address_t slaveAddress, const i2c_segment_t *segments, uint8_t count );	// Blocking
+bool I2C_Probe( i2c_address_t slaveAddress );	// 주소 ACK 확인
+
 void I2C_Write_Command(i2c_address_t slaveAddress, uint8_t cmd);
 
 void I2C_Write_Cmd_Uint8( i2c_address_t slaveAddress, uint8_t cmd, uint8_t data );
@@ -11,11 +11,11 @@
 void CLK_Init(void);
 void TCB0_Init(void);
 
-volatile bool flag = false;
-
 int main(void)
 {
 	char  tBuffer[16] = { 0 };
+	char  dBuffer[16] = { 0 };
+	char  wBuffer[4] = { 0 };
 		
 	CLK_Init();
     I2C_Init();
@@ -25,6 +25,8 @@ int main(void)
 	
 	printf("PCF8563 RTC Start!\r\n");
 	
+	sei();	// I2C  TWI ͷƮ ǹǷ  Enable
+	
 	PCF8563_wrieTimeDate(14,1,00,22,11,22,2);
 	/*
 	 * Ű:
@@ -37,15 +39,21 @@ int main(void)
 	 *   dow :  (0=Ͽ)
 	 */
 	
-	sei();
+	// RTC ⼭   а, Ŀ CLKOUT 1Hz RAM Watch Ѵ.
+	PCF8563_Clock_Init(PCF8563_CLOCK_CLKOUT);
 	
     while (1) 
     {
-		if(flag)
+		I2C_Task();				// Bus Error/Timeout  Bus Recovery
+		PCF8563_Clock_Task();	// resync ֱ⿡ 񵿱 Read û
+		
+		if(PCF8563_Clock_SecondElapsed())
 		{
-			flag = false;
-			PCF8563_readTimeString(tBuffer, true);
-			printf("now Time : %s\r\n", tBuffer);
+			// ¥, , ð  RAM . (I2C Read )
+			PCF8563_readDateStringKR(dBuffer);
+			PCF8563_readDayOfWeek(wBuffer, false);
+			PCF8563_readTimeString(tBuffer, false);
+			printf("now : %s %s %s (epoch %lu)\r\n", dBuffer, wBuffer, tBuffer, (unsigned long)PCF8563_GetEpoch());
 		}
     }
 }
@@ -65,11 +73,13 @@ void TCB0_Init(void)
 
 ISR(TCB0_INT_vect)
 {
-	static uint16_t Cnt1000Hz = 0;
-	uint16_t Cnt1Hz = (uint16_t)(Cnt1000Hz % 1000);
-	Cnt1000Hz++;
-	
-	if(Cnt1Hz == 0) flag = true;
+	I2C_TickISR();
+	PCF8563_Clock_TickISR();	// PCF8563_CLOCK_TICK  ð踦 Ѵ.
 
 	TCB0.INTFLAGS |= TCB_CAPT_bm;
+}
+
+ISR(PORTD_PORT_vect)
+{
+	PCF8563_Clock_PinISR();		// CLKOUT 1Hz (PD3)
 }
\ No newline at end of file
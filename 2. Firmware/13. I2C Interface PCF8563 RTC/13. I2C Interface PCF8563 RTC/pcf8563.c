@@ -7,7 +7,7 @@
 #include <stdio.h>
 
 #include "i2c.h"
-#include "PCF8563.h"
+#include "pcf8563.h"
 
 char*	DAY_OF_WEEK_LONG[] = { "Sunday", "Monday", "Tuesday", "Wednesday", "Thursday", "Friday", "Saturday" };
 char*	DAY_OF_WEEK_SHORT[] = { "SUN", "MON", "TUE", "WED", "THU", "FRI", "SAT" };
@@ -46,13 +46,24 @@ void PCF8563_wrieTimeDate( uint8_t hr, uint8_t min, uint8_t sec, uint8_t yr, uin
 	send_buff[9] = BIN2BCD( yr );
 	
 	I2C_Write_Block( PCF8563_ADDR, send_buff, sizeof( send_buff ) );
+	
+	// RAM의 Watch도 같이 맞춘다.
+	cli();
+	Watch.seconds	= sec;
+	Watch.minutes	= min;
+	Watch.hours		= hr;
+	Watch.days		= day;
+	Watch.weekdays	= dow;
+	Watch.months	= mon;
+	Watch.years		= yr;
+	sei();
 }
 
-static void PCF8563_readTimeDate( void ) {
-	uint8_t recv_buff[7];
-	
-	I2C_Read_Cmd_Block( PCF8563_ADDR, PCF8563_Seconds, recv_buff, sizeof( recv_buff ));
-	
+static i2c_xfer_t		pcf8563_xfer;
+static uint8_t			pcf8563_recv[7];
+static volatile bool	pcf8563_updated = false;
+
+static void PCF8563_decodeTimeDate( const uint8_t *recv_buff ) {
 	Watch.seconds	= BCD2BIN( recv_buff[0] & 0x7f );
 	Watch.minutes	= BCD2BIN( recv_buff[1] & 0x7f );
 	Watch.hours		= BCD2BIN( recv_buff[2] & 0x3f );
@@ -62,38 +73,82 @@ static void PCF8563_readTimeDate( void ) {
 	Watch.years		= BCD2BIN( recv_buff[6] );
 }
 
+static void PCF8563_readTimeDate( void ) {
+	uint8_t recv_buff[7];
+	
+	I2C_Read_Cmd_Block( PCF8563_ADDR, PCF8563_Seconds, recv_buff, sizeof( recv_buff ));
+	PCF8563_decodeTimeDate( recv_buff );
+}
+
+// TWI ISR 문맥에서 호출된다.
+static void PCF8563_readTimeDate_CB( i2c_xfer_t *xfer ) {
+	if ( xfer->status == I2C_NOERROR ) {
+		PCF8563_decodeTimeDate( pcf8563_recv );
+		pcf8563_updated = true;
+	}
+}
+
+bool PCF8563_requestTimeDate( void ) {
+	if ( pcf8563_xfer.status == I2C_BUSY ) return false;
+	
+	I2C_Xfer_Prepare( &pcf8563_xfer, PCF8563_ADDR, PCF8563_Seconds, 1, pcf8563_recv, sizeof( pcf8563_recv ), I2C_XFER_READ );
+	pcf8563_xfer.callback = PCF8563_readTimeDate_CB;
+	pcf8563_xfer.priority = PCF8563_I2C_PRIORITY;
+	return I2C_Submit( &pcf8563_xfer );
+}
+
+bool PCF8563_isTimeDateUpdated( void ) {
+	if ( !pcf8563_updated ) return false;
+	pcf8563_updated = false;
+	return true;
+}
+
+void PCF8563_getWatch( CLOCK_t *clock ) {
+	uint8_t sreg = SREG;
+	
+	cli();
+	*clock = Watch;
+	SREG = sreg;
+}
+
 uint16_t PCF8563_readMinSec( void ) {
+	CLOCK_t now;
 	uint16_t minsec;
 	
-	PCF8563_readTimeDate();
+	PCF8563_getWatch( &now );
 	
-	minsec = (BIN2BCD(Watch.minutes) << 8) + BIN2BCD(Watch.seconds);
+	minsec = (BIN2BCD(now.minutes) << 8) + BIN2BCD(now.seconds);
 	
 	return minsec;
 }
 
 void PCF8563_readDateStringKR( char * buff ) {
-	PCF8563_readTimeDate();
-	sprintf( buff, "20%02d-%02d-%02d", Watch.years, Watch.months, Watch.days );
+	CLOCK_t now;
+	
+	PCF8563_getWatch( &now );
+	sprintf( buff, "20%02d-%02d-%02d", now.years, now.months, now.days );
 }
 
 void PCF8563_readDateStringUS( char * buff ) {
-	PCF8563_readTimeDate();
-	sprintf( buff, "%02d-%02d-20%02d", Watch.days, Watch.months, Watch.years );
+	CLOCK_t now;
+	
+	PCF8563_getWatch( &now );
+	sprintf( buff, "%02d-%02d-20%02d", now.days, now.months, now.years );
 }
 
 void PCF8563_readTimeString( char buff[], bool ap ) {
+	CLOCK_t now;
 	uint8_t	am;
 	bool pmFlag = false;
 	
-	PCF8563_readTimeDate();
-	am = Watch.hours;
+	PCF8563_getWatch( &now );
+	am = now.hours;
 	if ( ap && ( am > 12 ) ) {
 		pmFlag = true;
 		am -= 12;
 	}
 	
-	sprintf( buff, "%02d:%02d:%02d", am, Watch.minutes, Watch.seconds );
+	sprintf( buff, "%02d:%02d:%02d", am, now.minutes, now.seconds );
 	if ( ap ) {
 		buff[8] = ( pmFlag )? 'p' : 'a';
 		buff[9] = 'm';
@@ -103,10 +158,187 @@ void PCF8563_readTimeString( char buff[], bool ap ) {
 
 void PCF8563_readDayOfWeek( char* buff, bool b ) {
 	char *dw;
+	uint8_t wd = Watch.weekdays;	// 1byte 읽기는 Atomic
 	
-	PCF8563_readTimeDate();
-	dw = ( b )? DAY_OF_WEEK_LONG[Watch.weekdays] : DAY_OF_WEEK_SHORT[Watch.weekdays];
+	dw = ( b )? DAY_OF_WEEK_LONG[wd] : DAY_OF_WEEK_SHORT[wd];
 	
 	while ( *dw ) *buff++ = *dw++;
 	*buff = 0;
-}
\ No newline at end of file
+}
+
+//////////////////////////////////////////////////////////////////////////
+static const uint8_t DAYS_IN_MONTH[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+static uint8_t				clock_source = PCF8563_CLOCK_TICK;
+static volatile uint16_t	clock_ms = 0;
+static volatile uint16_t	clock_resync = 0;		// 다음 resync까지 [s]
+static volatile bool		clock_second = false;
+
+// 2000 ~ 2099 에서는 4로 나누어 떨어지면 윤년 (2000년은 400의 배수라 윤년)
+static uint8_t PCF8563_daysInMonth( uint8_t month, uint8_t year ) {
+	if ( month == 2 && ( year & 0x03 ) == 0 ) return 29;
+	return DAYS_IN_MONTH[month - 1];
+}
+
+// ISR 문맥에서 호출된다. Watch를 1초 진행한다.
+static void PCF8563_advanceSecond( void ) {
+	clock_second = true;
+	if ( clock_resync ) clock_resync--;
+	
+	if ( ++Watch.seconds < 60 ) return;
+	Watch.seconds = 0;
+	if ( ++Watch.minutes < 60 ) return;
+	Watch.minutes = 0;
+	if ( ++Watch.hours < 24 ) return;
+	Watch.hours = 0;
+	
+	Watch.weekdays = ( Watch.weekdays + 1 ) % 7;
+	if ( Watch.months == 0 || Watch.months > 12 ) Watch.months = 1;		// RTC 값이 깨졌을 때 보호
+	if ( ++Watch.days <= PCF8563_daysInMonth( Watch.months, Watch.years ) ) return;
+	Watch.days = 1;
+	if ( ++Watch.months <= 12 ) return;
+	Watch.months = 1;
+	if ( ++Watch.years > 99 ) Watch.years = 0;
+}
+
+void PCF8563_Clock_Init( uint8_t source ) {
+	clock_source = source;
+	
+	PCF8563_readTimeDate();		// 부팅 때 한 번만 I2C Read
+	
+	if ( source == PCF8563_CLOCK_CLKOUT ) {
+		I2C_Write_Cmd_Uint8( PCF8563_ADDR, PCF8563_ClkoutControl, PCF8563_CLKOUT_1HZ );
+		
+		// Open-drain 출력 → Pull-up, 초가 바뀌는 Falling Edge에서 +1초
+		PCF8563_CLKOUT_PORT.DIRCLR = ( 1 << PCF8563_CLKOUT_PIN );
+		PCF8563_CLKOUT_PORT.PCF8563_CLKOUT_PINCTRL = PORT_PULLUPEN_bm | PORT_ISC_FALLING_gc;
+		PCF8563_CLKOUT_PORT.INTFLAGS = ( 1 << PCF8563_CLKOUT_PIN );
+	}
+	
+	cli();
+	clock_ms = 0;
+	clock_resync = ( source == PCF8563_CLOCK_CLKOUT )? PCF8563_RESYNC_CLKOUT_S : PCF8563_RESYNC_TICK_S;
+	sei();
+}
+
+void PCF8563_Clock_TickISR( void ) {
+	if ( clock_source != PCF8563_CLOCK_TICK ) return;
+	
+	if ( ++clock_ms >= 1000 ) {
+		clock_ms = 0;
+		PCF8563_advanceSecond();
+	}
+}
+
+void PCF8563_Clock_PinISR( void ) {
+	if ( PCF8563_CLKOUT_PORT.INTFLAGS & ( 1 << PCF8563_CLKOUT_PIN ) ) {
+		PCF8563_CLKOUT_PORT.INTFLAGS = ( 1 << PCF8563_CLKOUT_PIN );
+		PCF8563_advanceSecond();
+	}
+}
+
+void PCF8563_Clock_Task( void ) {
+	uint16_t resync;
+	uint8_t sreg = SREG;
+	
+	// 16bit를 읽는 도중 1초 ISR이 바꿀 수 있으므로 한 번에 복사한다.
+	cli();
+	resync = clock_resync;
+	SREG = sreg;
+	if ( resync ) return;
+	
+	// Drift 보정 : 비동기 Read 결과가 TWI ISR에서 Watch를 덮어쓴다.
+	if ( PCF8563_requestTimeDate() ) {
+		cli();
+		clock_ms = 0;		// Tick 위상도 RTC Read 시점에 맞춘다.
+		clock_resync = ( clock_source == PCF8563_CLOCK_CLKOUT )? PCF8563_RESYNC_CLKOUT_S : PCF8563_RESYNC_TICK_S;
+		sei();
+	}
+}
+
+bool PCF8563_Clock_SecondElapsed( void ) {
+	if ( !clock_second ) return false;
+	clock_second = false;
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// 평년 기준, 1월 1일부터 각 월 1일 전까지의 일수. [12]는 1년 전체 (월 찾기의 끝 표시)
+static const uint16_t DAYS_BEFORE_MONTH[13] = { 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334, 365 };
+
+#define DAYS_PER_4YEARS		1461		// 윤년(366) + 평년(365) * 3
+
+bool PCF8563_isValidClock( const CLOCK_t *clock ) {
+	if ( clock->seconds > 59 || clock->minutes > 59 || clock->hours > 23 ) return false;
+	if ( clock->years > 99 || clock->months == 0 || clock->months > 12 ) return false;
+	return clock->days != 0 && clock->days <= PCF8563_daysInMonth( clock->months, clock->years );
+}
+
+uint32_t PCF8563_ClockToEpoch( const CLOCK_t *clock ) {
+	uint8_t  y = clock->years;
+	uint16_t days;
+	
+	// 그 해 1월 1일까지 : 365 * y + (y 이전의 윤년 수). 2000년이 윤년이므로 (y + 3) / 4
+	days = (uint16_t)y * 365 + ( ( y + 3 ) >> 2 );
+	days += DAYS_BEFORE_MONTH[clock->months - 1] + ( clock->days - 1 );
+	if ( clock->months > 2 && ( y & 0x03 ) == 0 ) days++;
+	
+	return (uint32_t)days * PCF8563_SECONDS_PER_DAY
+	     + (uint16_t)clock->hours * 3600U + (uint16_t)clock->minutes * 60U + clock->seconds;
+}
+
+void PCF8563_EpochToClock( uint32_t epoch, CLOCK_t *clock ) {
+	uint16_t days = (uint16_t)( epoch / PCF8563_SECONDS_PER_DAY );
+	uint32_t rem  = epoch - (uint32_t)days * PCF8563_SECONDS_PER_DAY;
+	uint16_t secs;
+	uint8_t  y, m;
+	bool     leap;
+	
+	// 시각 : 하루 안의 초 (0 ~ 86399)
+	clock->hours = (uint8_t)( rem / 3600U );
+	secs = (uint16_t)( rem - (uint32_t)clock->hours * 3600U );
+	clock->minutes = (uint8_t)( secs / 60U );
+	clock->seconds = (uint8_t)( secs - clock->minutes * 60U );
+	
+	clock->weekdays = (uint8_t)( ( days + 6 ) % 7 );	// 2000-01-01 = 토요일
+	
+	// 년 : 4년 묶음 → 묶음 안의 년. 묶음의 첫 해가 윤년(366일)이다.
+	y = (uint8_t)( days / DAYS_PER_4YEARS ) * 4;
+	days %= DAYS_PER_4YEARS;
+	leap = ( days < 366 );
+	if ( !leap ) {
+		days -= 1;					// 첫 해의 2월 29일을 빼면 나머지는 365일씩
+		y += (uint8_t)( days / 365 );
+		days %= 365;
+	}
+	clock->years = y;
+	
+	// 월 : 윤년이면 2월 29일(59) 이후를 하루 당겨서 평년 표로 찾는다.
+	if ( leap && days >= 59 ) {
+		if ( days == 59 ) {
+			clock->months = 2;
+			clock->days = 29;
+			return;
+		}
+		days--;
+	}
+	m = (uint8_t)( days >> 5 );		// 한 달은 28 ~ 31일이므로 days / 32 는 실제 월보다 최대 1 작다.
+	if ( days >= DAYS_BEFORE_MONTH[m + 1] ) m++;
+	clock->months = m + 1;
+	clock->days = (uint8_t)( days - DAYS_BEFORE_MONTH[m] + 1 );
+}
+
+uint32_t PCF8563_GetEpoch( void ) {
+	CLOCK_t now;
+	
+	PCF8563_getWatch( &now );
+	return PCF8563_ClockToEpoch( &now );
+}
+
+void PCF8563_SetEpoch( uint32_t epoch ) {
+	CLOCK_t clock;
+	
+	PCF8563_EpochToClock( epoch, &clock );
+	PCF8563_wrieTimeDate( clock.hours, clock.minutes, clock.seconds,
+	                      clock.years, clock.months, clock.days, clock.weekdays );
+}
@@ -12,6 +12,7 @@
  */
 
 #define PCF8563_ADDR            0x51    // 7bit I2C Slave Address (1010 0001b)
+#define PCF8563_I2C_PRIORITY    I2C_PRIO_HIGH   // 비동기 Read의 I2C 큐 priority
 
 /*
  * 레지스터 주소 정의
@@ -21,6 +22,9 @@
  */
 #define PCF8563_ControlStatus1  0x00
 #define PCF8563_Seconds         0x02
+#define PCF8563_ClkoutControl   0x0D    // bit7 FE(출력 Enable), bit1~0 FD(주파수, 11b = 1Hz)
+
+#define PCF8563_CLKOUT_1HZ      0x83
 
 /*
  * #CLOCK_t #구조체
@@ -48,6 +52,8 @@ typedef struct PCF8563_REG {
     uint8_t years;
 } CLOCK_t;
 
+extern CLOCK_t Watch;
+
 /*
  * #PCF8563_wrieTimeDate
  *
@@ -71,7 +77,7 @@ void PCF8563_wrieTimeDate(uint8_t hr, uint8_t min, uint8_t sec,
 /*
  * #PCF8563_readMinSec
  *
- * RTC에서 "분/초"만 빠르게 읽어오기 위한 함수.
+ * "분/초"만 빠르게 얻기 위한 함수.
  * 반환값 구조: 0xMMSS (상위 바이트=분, 하위 바이트=초)
  *
  * 예) 0x0A14 → 10분 20초
@@ -81,7 +87,7 @@ uint16_t PCF8563_readMinSec(void);
 /*
  * #PCF8563_readDateStringKR
  *
- * PCF8563_readTimeDate()로 RTC 값을 읽은 후 날짜를 한국식(YYYY-MM-DD) 문자열로 변환한다.
+ * 날짜를 한국식(YYYY-MM-DD) 문자열로 변환한다.
  *
  * 예) "2025-02-11"
  */
@@ -118,4 +124,76 @@ void PCF8563_readTimeString(char buff[], bool ap);
  */
 void PCF8563_readDayOfWeek(char* buff, bool b);
 
+/*
+ * #NonBlockingRead
+ *
+ * PCF8563_requestTimeDate()   : 시간/날짜 7byte Read를 I2C 큐에 넣고 바로 리턴한다.
+ *                               (이전 요청이 진행 중이면 false)
+ * PCF8563_isTimeDateUpdated() : Read가 끝나 Watch가 갱신되었으면 true (한 번만)
+ *
+ * Watch는 TWI ISR에서 갱신되므로 true를 받은 직후에 읽는다.
+ */
+bool PCF8563_requestTimeDate(void);
+bool PCF8563_isTimeDateUpdated(void);
+
+/*
+ * #ClockService #RamCachedTime
+ *
+ * 위의 readXxx() 문자열 함수들은 I2C를 쓰지 않고 RAM의 Watch만 사용한다.
+ * (날짜 + 시간 + 요일을 출력해도 RTC Read는 0번)
+ * Watch는 아래 Clock Service가 관리한다.
+ *
+ *  1) PCF8563_Clock_Init() : 부팅 때 RTC를 한 번 읽어 Watch를 채운다. (Blocking)
+ *  2) 1초마다 Watch를 RAM에서 직접 +1초 한다. (초 → 분 → 시 → 일/요일 → 월 → 년, 윤년 포함)
+ *     PCF8563_CLOCK_CLKOUT : PCF8563 CLKOUT(1Hz)을 Pin 인터럽트로 받는다. (RTC 수정 발진기 기준)
+ *     PCF8563_CLOCK_TICK   : 1ms Tick(PCF8563_Clock_TickISR())을 1000번 세어 1초로 본다. (MCU 발진기 기준)
+ *  3) resync 주기마다 PCF8563_Clock_Task()가 비동기 Read를 요청해 Drift를 바로잡는다.
+ *     Tick은 MCU 발진기 오차가 쌓이므로 더 자주 맞춘다.
+ *
+ * CLKOUT은 Open-drain 출력이므로 입력 Pin의 Pull-up을 켠다.
+ * Port 인터럽트 Vector는 같은 Port의 다른 Pin(DS1621 TOUT 등)과 나눠 쓰므로 Application이 갖고,
+ * 그 ISR에서 PCF8563_Clock_PinISR()을 호출한다.   ISR(PORTD_PORT_vect) { PCF8563_Clock_PinISR(); }
+ * Watch는 ISR에서 바뀌므로 여러 필드를 함께 쓸 때는 PCF8563_getWatch()로 복사해서 쓴다.
+ */
+#define PCF8563_CLOCK_CLKOUT    0
+#define PCF8563_CLOCK_TICK      1
+
+#define PCF8563_CLKOUT_PORT     PORTD
+#define PCF8563_CLKOUT_PIN      3
+#define PCF8563_CLKOUT_PINCTRL  PIN3CTRL
+
+#define PCF8563_RESYNC_CLKOUT_S 3600    // [s]
+#define PCF8563_RESYNC_TICK_S   60      // [s]
+
+void PCF8563_Clock_Init(uint8_t source);
+void PCF8563_Clock_TickISR(void);       // 1ms Timer ISR에서 호출 (PCF8563_CLOCK_TICK일 때만 동작)
+void PCF8563_Clock_PinISR(void);        // CLKOUT Port ISR에서 호출 (CLKOUT Pin의 Flag만 보고 지운다)
+void PCF8563_Clock_Task(void);          // main loop에서 호출 (resync 요청)
+bool PCF8563_Clock_SecondElapsed(void); // 마지막 호출 이후 1초가 지났으면 true (한 번만)
+void PCF8563_getWatch(CLOCK_t *clock);  // Watch 복사 (인터럽트를 잠시 끈다)
+
+/*
+ * #Epoch #Timestamp
+ *
+ * 2000-01-01 00:00:00 부터 센 초(uint32_t). 자정, 월말, 연말을 넘는 시간 간격도 뺄셈 한 번으로 구한다.
+ * (2099-12-31 23:59:59 = 3155759999 까지 uint32_t에 들어간다)
+ *
+ * 변환은 반복문 없이 표와 간단한 계산으로 한다.
+ *   - 월 : 1월 1일부터 각 월 1일까지의 누적 일수 표 (윤년이면 3월부터 +1)
+ *   - 년 : 2000 ~ 2099 에서는 4년마다 윤년이므로 4년 = 1461일 단위로 나눈다.
+ *   - 요일 : 2000-01-01은 토요일(6)
+ *
+ * PCF8563_GetEpoch() : RAM의 Watch를 변환 (I2C 사용 없음)
+ * PCF8563_SetEpoch() : epoch를 CLOCK_t로 바꿔 RTC와 Watch에 쓴다. (요일도 계산해서 쓴다)
+ * PCF8563_isValidClock() : 범위, 월별 일수, 2월 29일(윤년만)을 검사한다.
+ */
+#define PCF8563_EPOCH_UNIX_OFFSET   946684800UL     // Unix time(1970) = epoch + 이 값
+#define PCF8563_SECONDS_PER_DAY     86400UL
+
+uint32_t PCF8563_ClockToEpoch(const CLOCK_t *clock);
+void PCF8563_EpochToClock(uint32_t epoch, CLOCK_t *clock);
+bool PCF8563_isValidClock(const CLOCK_t *clock);
+uint32_t PCF8563_GetEpoch(void);
+void PCF8563_SetEpoch(uint32_t epoch);
+
 #endif /* PCF8563_H_ */
@@ -0,0 +1,406 @@
+#define F_CPU 5000000UL
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "i2c.h"
+#include "d24fc512.h"
+#include "d24fc512_archive.h"
+#include "twi_sim.h"
+#include "sim_devices.h"
+
+/*
+ * #SampleArchive #RangeQuery
+ *
+ * d24fc512_archive.c를 RAM 24FC512 모델 위에서 돌리며 PC 쪽 모델(추가한 Sample 전체)과 비교한다.
+ *
+ *   - 시각은 대부분 0 ~ 29초씩, 가끔 255초를 넘게(새 Block), 가끔 거꾸로 간다. (거꾸로 가면 false여야 한다)
+ *   - Block을 원형으로 여러 바퀴 돌린다. EEPROM에 남은 Sample은 항상 모델의 뒷부분과 같아야 한다.
+ *   - 무작위 [t1, t2]의 Query가 모델과 같고, Aggregate의 Bucket별 min/max가 모델로 계산한 값과 같다.
+ *   - Query/Aggregate는 Page Write를 하지 않는다.
+ *   - 모든 Page Write는 Archive 영역(EEPROM_ARCHIVE_START ~) 안이다. (설정, Record Log를 건드리지 않는다)
+ *   - Flush 후 Mount하면 모두 남고, Flush 없이 Mount하면 채우던 Block만 잃는다.
+ *
+ * 끝으로 Bus 에러 경로를 본다.
+ *   - Read 주소만 NACK : Query/Aggregate/Mount는 false, Mount 실패 뒤 Append도 false이고 아무것도 쓰지 않는다.
+ *   - 칩 전원 꺼짐     : Flush는 false, 가득 찬 Block은 RAM에 남고 새 Block이 필요한 Sample만 false.
+ *                        칩이 돌아오면 받은 Sample이 모두 기록된다. Format도 false이고 이후 Append가 거부된다.
+ *
+ * 인터럽트는 켜지 않는다. (모든 호출이 I2C_Transfer()의 Polling 경로로 돈다)
+ *
+ * 사용법 : archive_check [seed]
+ */
+
+#define APPENDS				( 30UL * EEPROM_ARCHIVE_BLOCKS )
+#define MODEL_MAX			( 2UL * EEPROM_ARCHIVE_BLOCKS * EEPROM_ARCHIVE_SAMPLES )
+#define CALL_LIMIT_US		20000000UL
+
+typedef struct
+{
+	uint32_t time;
+	int16_t value[EEPROM_ARCHIVE_CHANNELS];
+}sample_t;
+
+typedef struct
+{
+	uint32_t time;
+	int16_t min[EEPROM_ARCHIVE_CHANNELS];
+	int16_t max[EEPROM_ARCHIVE_CHANNELS];
+}bucket_t;
+
+static sim_24fc512_t eeprom;
+static sample_t model[MODEL_MAX], got[MODEL_MAX];
+static bucket_t expect_bucket[MODEL_MAX], got_bucket[MODEL_MAX];
+static uint32_t model_count, got_count, expect_buckets, got_buckets;
+
+static uint32_t violations;
+static uint32_t queries;
+
+static void violation( uint32_t step, const char *what )
+{
+	violations++;
+	if ( violations <= 20 )
+		printf( "  !! step %lu : %s (model %lu)\r\n", (unsigned long)step, what, (unsigned long)model_count );
+}
+
+static void check_commit( sim_24fc512_t *m, uint16_t page )
+{
+	if ( page < EEPROM_ARCHIVE_START )
+		violation( 0, "Archive 영역 밖에 기록했다" );
+}
+
+// Firmware 호출마다 Hang을 감시한다.
+static void limit( void )
+{
+	sim_set_deadline( sim_now + SIM_US( CALL_LIMIT_US ) );
+}
+
+static void got_sample( uint32_t time, const int16_t *value )
+{
+	if ( got_count >= MODEL_MAX )
+		return;
+	got[got_count].time = time;
+	memcpy( got[got_count].value, value, sizeof(got[0].value) );
+	got_count++;
+}
+
+static void got_bucket_cb( uint32_t time, const int16_t *min, const int16_t *max )
+{
+	if ( got_buckets >= MODEL_MAX )
+		return;
+	got_bucket[got_buckets].time = time;
+	memcpy( got_bucket[got_buckets].min, min, sizeof(got_bucket[0].min) );
+	memcpy( got_bucket[got_buckets].max, max, sizeof(got_bucket[0].max) );
+	got_buckets++;
+}
+
+static bool query( uint32_t t1, uint32_t t2, uint16_t *found )
+{
+	limit();
+	got_count = 0;
+	return EEPROM_Archive_Query( t1, t2, got_sample, found );
+}
+
+/*
+ * 원형으로 밀려난 Block만큼 모델 앞부분을 버린다.
+ * EEPROM(+ 채우는 중인 Block)에 있는 Sample은 모델의 뒷부분과 정확히 같아야 한다.
+ */
+static void trim_model( uint32_t step )
+{
+	if ( !query( 0, 0xFFFFFFFFUL, NULL ) )
+	{
+		violation( step, "Bus 에러가 없는데 Query가 실패했다" );
+		return;
+	}
+	if ( got_count > model_count
+	  || memcmp( got, &model[model_count - got_count], got_count * sizeof(sample_t) ) != 0 )
+	{
+		violation( step, "남은 Sample이 모델의 뒷부분과 다르다" );
+		return;
+	}
+	memmove( model, &model[model_count - got_count], got_count * sizeof(sample_t) );
+	model_count = got_count;
+}
+
+static void check_query( uint32_t step, uint32_t t1, uint32_t t2 )
+{
+	uint32_t i, n = 0;
+	uint16_t found = 0;
+
+	if ( !query( t1, t2, &found ) )
+		violation( step, "Bus 에러가 없는데 Query가 실패했다" );
+	queries++;
+	for ( i = 0; i < model_count; i++ )
+	{
+		if ( model[i].time < t1 || model[i].time > t2 )
+			continue;
+		if ( n >= got_count || memcmp( &got[n], &model[i], sizeof(sample_t) ) != 0 )
+		{
+			violation( step, "Query 결과가 모델과 다르다" );
+			return;
+		}
+		n++;
+	}
+	if ( n != got_count || found != got_count )
+		violation( step, "Query Sample 수가 모델과 다르다" );
+}
+
+static void check_aggregate( uint32_t step, uint32_t t1, uint32_t t2, uint32_t period )
+{
+	bucket_t *b = NULL;
+	uint32_t i, index, current = 0;
+	uint8_t c;
+
+	expect_buckets = 0;
+	for ( i = 0; i < model_count; i++ )
+	{
+		if ( model[i].time < t1 || model[i].time > t2 )
+			continue;
+		index = ( model[i].time - t1 ) / period;
+		if ( b == NULL || index != current )
+		{
+			b = &expect_bucket[expect_buckets++];
+			b->time = t1 + index * period;
+			memcpy( b->min, model[i].value, sizeof(b->min) );
+			memcpy( b->max, model[i].value, sizeof(b->max) );
+			current = index;
+			continue;
+		}
+		for ( c = 0; c < EEPROM_ARCHIVE_CHANNELS; c++ )
+		{
+			if ( model[i].value[c] < b->min[c] ) b->min[c] = model[i].value[c];
+			if ( model[i].value[c] > b->max[c] ) b->max[c] = model[i].value[c];
+		}
+	}
+
+	limit();
+	got_buckets = 0;
+	if ( !EEPROM_Archive_Aggregate( t1, t2, period, got_bucket_cb ) )
+		violation( step, "Bus 에러가 없는데 Aggregate가 실패했다" );
+
+	if ( got_buckets != expect_buckets
+	  || memcmp( got_bucket, expect_bucket, expect_buckets * sizeof(bucket_t) ) != 0 )
+		violation( step, "Aggregate 결과가 모델과 다르다" );
+}
+
+static void check_random_range( uint32_t step )
+{
+	uint32_t t1, t2, x, writes = eeprom.page_writes;
+
+	if ( model_count == 0 )
+		return;
+	t1 = model[sim_random() % model_count].time;
+	t2 = model[sim_random() % model_count].time;
+	if ( t1 > t2 )
+	{
+		x = t1;
+		t1 = t2;
+		t2 = x;
+	}
+	if ( sim_random() % 4 == 0 )		// Sample 사이의 시각에서 시작/끝
+	{
+		t1 = ( t1 > 0 ) ? t1 - 1 : 0;
+		t2 += 1;
+	}
+
+	check_query( step, t1, t2 );
+	check_aggregate( step, t1, t2, 1 + sim_random() % 3000 );
+	if ( eeprom.page_writes != writes )
+		violation( step, "질의가 EEPROM에 기록했다" );
+}
+
+static uint32_t next_time( uint32_t last )
+{
+	uint32_t r = sim_random() % 100;
+
+	if ( r < 3 && last > 100 )
+		return last - 1 - sim_random() % 50;		// 거꾸로
+	if ( r < 6 )
+		return last + 256 + sim_random() % 1000;	// dt 1byte를 넘는다 → 새 Block
+	return last + sim_random() % 30;				// 0초(같은 시각) 포함
+}
+
+static void run( void )
+{
+	sample_t s;
+	uint32_t step, last = 1000, t;
+	bool ok;
+	uint8_t c;
+
+	for ( step = 0; step < APPENDS; step++ )
+	{
+		s.time = next_time( last );
+		for ( c = 0; c < EEPROM_ARCHIVE_CHANNELS; c++ )
+			s.value[c] = (int16_t)sim_random();
+
+		limit();
+		ok = EEPROM_Archive_Append( s.time, s.value );
+		if ( ok != ( s.time >= last || model_count == 0 ) )
+			violation( step, ok ? "이른 시각의 Sample을 받았다" : "Sample을 받지 않았다" );
+		if ( ok )
+		{
+			if ( model_count == MODEL_MAX )
+				trim_model( step );
+			model[model_count++] = s;
+			last = s.time;
+		}
+
+		if ( step % 97 == 0 )
+		{
+			trim_model( step );
+			check_random_range( step );
+		}
+
+		// Flush 후 Mount : 아무것도 잃지 않는다.
+		if ( step % 500 == 250 )
+		{
+			EEPROM_Archive_Flush();
+			limit();
+			if ( !EEPROM_Archive_Mount() )
+				violation( step, "Flush 후 Mount 실패" );
+			trim_model( step );
+		}
+
+		// Flush 없이 Mount (전원 차단) : 채우던 Block만 잃는다.
+		if ( step % 700 == 350 )
+		{
+			limit();
+			EEPROM_Archive_Mount();
+			query( 0, 0xFFFFFFFFUL, NULL );
+			for ( t = 0; t < model_count && got_count && memcmp( &model[t], &got[0], sizeof(sample_t) ) != 0; t++ );
+			if ( got_count && ( t + got_count > model_count
+			  || memcmp( &model[t], got, got_count * sizeof(sample_t) ) != 0
+			  || model_count - ( t + got_count ) > EEPROM_ARCHIVE_SAMPLES ) )
+				violation( step, "Mount가 채우던 Block보다 많이 잃었다" );
+			memcpy( model, got, got_count * sizeof(sample_t) );
+			model_count = got_count;
+			if ( EEPROM_Archive_LastTime( &t ) )
+				last = t;
+		}
+	}
+
+	trim_model( APPENDS );
+	check_query( APPENDS, 0, 0xFFFFFFFFUL );
+	check_aggregate( APPENDS, 0, 0xFFFFFFFFUL, 3600 );
+}
+
+static bool append( uint32_t time )
+{
+	sample_t s;
+	uint8_t c;
+
+	s.time = time;
+	for ( c = 0; c < EEPROM_ARCHIVE_CHANNELS; c++ )
+		s.value[c] = (int16_t)sim_random();
+	limit();
+	if ( !EEPROM_Archive_Append( s.time, s.value ) )
+		return false;
+	if ( model_count == MODEL_MAX )
+		trim_model( APPENDS );
+	model[model_count++] = s;
+	return true;
+}
+
+static void bus_errors( void )
+{
+	uint32_t t, writes;
+	uint16_t i, accepted;
+
+	limit();
+	if ( !EEPROM_Archive_Flush() || !EEPROM_Archive_LastTime( &t ) )
+		violation( APPENDS, "Bus 에러 전 Flush 실패" );
+
+	// Read 주소만 NACK
+	writes = eeprom.page_writes;
+	eeprom.nack_read = true;
+	if ( query( 0, 0xFFFFFFFFUL, NULL ) )
+		violation( APPENDS, "Read 실패인데 Query가 성공했다" );
+	limit();
+	got_buckets = 0;
+	if ( EEPROM_Archive_Aggregate( 0, 0xFFFFFFFFUL, 3600, got_bucket_cb ) || got_buckets )
+		violation( APPENDS, "Read 실패인데 Aggregate가 Bucket을 내보냈다" );
+	limit();
+	if ( EEPROM_Archive_Mount() )
+		violation( APPENDS, "Read 실패인데 Mount가 성공했다" );
+	eeprom.nack_read = false;
+	if ( append( t + 1 ) || query( 0, 0xFFFFFFFFUL, NULL ) )
+		violation( APPENDS, "Mount 실패 뒤 Append/Query를 받았다" );
+	if ( eeprom.page_writes != writes )
+		violation( APPENDS, "Read 실패 중에 기록했다" );
+
+	limit();
+	if ( !EEPROM_Archive_Mount() )
+		violation( APPENDS, "Bus가 돌아온 뒤 Mount 실패" );
+	trim_model( APPENDS );
+
+	// 칩 전원 꺼짐 : 받은 Sample은 RAM에 남고, 새 Block이 필요해지면 거부된다.
+	eeprom.off = true;
+	for ( i = 0, accepted = 0; i < 3 * EEPROM_ARCHIVE_SAMPLES; i++ )
+	{
+		if ( append( ++t ) && accepted++ != i )
+			violation( APPENDS + 1, "칩이 꺼졌는데 Block이 찬 뒤의 Sample을 받았다" );
+	}
+	if ( accepted == 0 || accepted > EEPROM_ARCHIVE_SAMPLES )
+		violation( APPENDS + 1, "칩이 꺼졌는데 받은 Sample 수가 이상하다" );
+	limit();
+	if ( EEPROM_Archive_Flush() )
+		violation( APPENDS + 1, "칩이 꺼졌는데 Flush가 성공했다" );
+	eeprom.off = false;
+
+	limit();
+	if ( !EEPROM_Archive_Flush() )
+		violation( APPENDS + 1, "칩이 돌아온 뒤 Flush 실패" );
+	trim_model( APPENDS + 1 );		// 받은 Sample이 모두 기록되었다.
+	if ( !append( ++t ) )
+		violation( APPENDS + 1, "칩이 돌아온 뒤 Append 실패" );
+	limit();
+	EEPROM_Archive_Flush();
+	limit();
+	if ( !EEPROM_Archive_Mount() )
+		violation( APPENDS + 1, "칩이 돌아온 뒤 Mount 실패" );
+	trim_model( APPENDS + 1 );
+
+	// Format 실패 → 다시 Format할 때까지 Append 거부
+	eeprom.off = true;
+	limit();
+	if ( EEPROM_Archive_Format() )
+		violation( APPENDS + 2, "칩이 꺼졌는데 Format이 성공했다" );
+	eeprom.off = false;
+	if ( append( ++t ) )
+		violation( APPENDS + 2, "Format 실패 뒤 Append를 받았다" );
+	limit();
+	if ( !EEPROM_Archive_Format() || !query( 0, 0xFFFFFFFFUL, NULL ) || got_count )
+		violation( APPENDS + 2, "Format 뒤 Sample이 남았다" );
+	model_count = 0;
+	if ( !append( ++t ) || !query( 0, 0xFFFFFFFFUL, NULL ) || got_count != 1 )
+		violation( APPENDS + 2, "Format 뒤 Append 실패" );
+}
+
+int main( int argc, char **argv )
+{
+	uint32_t seed = ( argc > 1 ) ? (uint32_t)strtoul( argv[1], NULL, 0 ) : 1;
+
+	sim_reset();
+	sim_seed( seed );
+	sim_24fc512_init( &eeprom );
+	eeprom.commit = check_commit;
+	sim_attach( &eeprom.dev );
+	sim_set_tick( I2C_TickISR );
+	I2C_Init();
+
+	limit();
+	if ( EEPROM_Archive_Mount() || !query( 0, 0xFFFFFFFFUL, NULL ) || got_count )
+		violation( 0, "빈 EEPROM인데 Sample이 있다" );
+
+	printf( "archive_check seed %lu, %u blocks x %u samples, %lu appends\r\n", (unsigned long)seed,
+			(unsigned)EEPROM_ARCHIVE_BLOCKS, (unsigned)EEPROM_ARCHIVE_SAMPLES, (unsigned long)APPENDS );
+	run();
+	bus_errors();
+
+	printf( "%s : %lu violation(s), %lu queries, %lu page writes, %.1f s simulated\r\n",
+			violations ? "FAIL" : "PASS", (unsigned long)violations, (unsigned long)queries,
+			(unsigned long)eeprom.page_writes, (double)sim_now / SIM_US(1000000UL) );
+	return violations ? 1 : 0;
+}
@@ -0,0 +1,155 @@
+#define F_CPU 5000000UL
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include "i2c.h"
+#include "pcf8563.h"
+#include "twi_sim.h"
+
+/*
+ * #Epoch #gmtime
+ *
+ * pcf8563.c의 PCF8563_EpochToClock() / PCF8563_ClockToEpoch() / PCF8563_isValidClock()을
+ * PC의 gmtime()/timegm()과 비교한다. (2000-01-01 ~ 2099-12-31)
+ *
+ *   - 36525일 모두 : 하루의 처음/끝, 시/분 경계, 무작위 초 몇 개
+ *   - 매년 하루(윤년은 2월 29일, 아니면 무작위 날)와 처음/마지막 날 : 86400초 모두
+ *   - 위의 모든 epoch가 ClockToEpoch()로 되돌아오는지 (Round-trip), 요일까지 gmtime과 같은지
+ *   - 모든 년/월(0 ~ 13)/일(0 ~ 32) 조합의 isValidClock() 결과가 timegm()으로 정규화해 본 결과와 같은지
+ *
+ * full을 주면 2000 ~ 2099년의 모든 초(3155760000개)를 본다. (수 분)
+ *
+ * 사용법 : epoch_check [seed] [full]
+ */
+
+#define EPOCH_DAYS			36525UL			// 2000-01-01 ~ 2099-12-31
+#define EPOCH_END			( EPOCH_DAYS * PCF8563_SECONDS_PER_DAY )
+
+static uint32_t violations;
+static uint64_t checked;
+
+static void violation( uint32_t epoch, const char *what, const CLOCK_t *c )
+{
+	violations++;
+	if ( violations <= 20 )
+		printf( "  !! epoch %lu : %s (20%02u-%02u-%02u %02u:%02u:%02u wd %u)\r\n", (unsigned long)epoch, what,
+				c->years, c->months, c->days, c->hours, c->minutes, c->seconds, c->weekdays );
+}
+
+static void check_epoch( uint32_t epoch )
+{
+	time_t unix_time = (time_t)epoch + PCF8563_EPOCH_UNIX_OFFSET;
+	struct tm tm;
+	CLOCK_t c;
+
+	PCF8563_EpochToClock( epoch, &c );
+	gmtime_r( &unix_time, &tm );
+	checked++;
+
+	if ( c.years != tm.tm_year - 100 || c.months != tm.tm_mon + 1 || c.days != tm.tm_mday
+	  || c.hours != tm.tm_hour || c.minutes != tm.tm_min || c.seconds != tm.tm_sec || c.weekdays != tm.tm_wday )
+		violation( epoch, "gmtime과 다르다", &c );
+	else if ( !PCF8563_isValidClock( &c ) )
+		violation( epoch, "isValidClock이 거부했다", &c );
+	else if ( PCF8563_ClockToEpoch( &c ) != epoch )
+		violation( epoch, "Round-trip이 다르다", &c );
+}
+
+static void check_day( uint32_t day )
+{
+	uint32_t s;
+
+	for ( s = 0; s < PCF8563_SECONDS_PER_DAY; s++ )
+		check_epoch( day * PCF8563_SECONDS_PER_DAY + s );
+}
+
+static void check_valid( void )
+{
+	struct tm tm;
+	CLOCK_t c;
+	bool expect;
+	uint32_t leap_days = 0;
+	uint8_t y, m, d;
+
+	memset( &c, 0, sizeof(c) );
+	for ( y = 0; y <= 99; y++ )
+		for ( m = 0; m <= 13; m++ )
+			for ( d = 0; d <= 32; d++ )
+			{
+				// timegm()은 넘치는 날짜를 다음 달로 넘기므로 그대로 돌아오면 있는 날짜이다.
+				memset( &tm, 0, sizeof(tm) );
+				tm.tm_year = 100 + y;
+				tm.tm_mon = m - 1;
+				tm.tm_mday = d;
+				timegm( &tm );
+				expect = m >= 1 && m <= 12 && d >= 1 && tm.tm_year == 100 + y && tm.tm_mon == m - 1 && tm.tm_mday == d;
+
+				c.years = y;
+				c.months = m;
+				c.days = d;
+				if ( PCF8563_isValidClock( &c ) != expect )
+					violation( 0, expect ? "있는 날짜를 거부했다" : "없는 날짜를 받았다", &c );
+				if ( expect && m == 2 && d == 29 )
+					leap_days++;
+			}
+
+	if ( leap_days != 25 )
+		violation( 0, "2월 29일이 25번이 아니다", &c );
+
+	// 시각 범위
+	c.years = 24; c.months = 2; c.days = 29;
+	c.hours = 24;
+	if ( PCF8563_isValidClock( &c ) ) violation( 0, "24시를 받았다", &c );
+	c.hours = 23; c.minutes = 60;
+	if ( PCF8563_isValidClock( &c ) ) violation( 0, "60분을 받았다", &c );
+	c.minutes = 59; c.seconds = 60;
+	if ( PCF8563_isValidClock( &c ) ) violation( 0, "60초를 받았다", &c );
+	c.seconds = 59; c.years = 100;
+	if ( PCF8563_isValidClock( &c ) ) violation( 0, "2100년을 받았다", &c );
+}
+
+int main( int argc, char **argv )
+{
+	static const uint32_t edges[] = { 0, 1, 59, 60, 3599, 3600, 43199, 43200, 86340, 86399 };
+	uint32_t seed = ( argc > 1 ) ? (uint32_t)strtoul( argv[1], NULL, 0 ) : 1;
+	bool full = ( argc > 2 ) && strcmp( argv[2], "full" ) == 0;
+	uint32_t day, epoch, year, first;
+	uint8_t i;
+
+	setenv( "TZ", "UTC", 1 );
+	sim_seed( seed );
+	printf( "epoch_check seed %lu%s\r\n", (unsigned long)seed, full ? ", every second" : "" );
+
+	if ( full )
+	{
+		for ( epoch = 0; epoch < EPOCH_END; epoch++ )
+			check_epoch( epoch );
+	}
+	else
+	{
+		for ( day = 0; day < EPOCH_DAYS; day++ )
+		{
+			for ( i = 0; i < sizeof(edges) / sizeof(edges[0]); i++ )
+				check_epoch( day * PCF8563_SECONDS_PER_DAY + edges[i] );
+			for ( i = 0; i < 4; i++ )
+				check_epoch( day * PCF8563_SECONDS_PER_DAY + sim_random() % PCF8563_SECONDS_PER_DAY );
+		}
+
+		check_day( 0 );
+		check_day( EPOCH_DAYS - 1 );
+		for ( year = 0, first = 0; year < 100; first += ( year % 4 == 0 ) ? 366 : 365, year++ )
+			check_day( first + ( ( year % 4 == 0 ) ? 59 : sim_random() % 365 ) );
+	}
+
+	if ( PCF8563_ClockToEpoch( &(CLOCK_t){ 59, 59, 23, 31, 4, 12, 99 } ) != EPOCH_END - 1 )
+		violation( EPOCH_END - 1, "2099-12-31 23:59:59가 마지막 초가 아니다", &(CLOCK_t){ 59, 59, 23, 31, 4, 12, 99 } );
+	check_valid();
+
+	printf( "%s : %lu violation(s), %llu epoch(s)\r\n", violations ? "FAIL" : "PASS",
+			(unsigned long)violations, (unsigned long long)checked );
+	return violations ? 1 : 0;
+}
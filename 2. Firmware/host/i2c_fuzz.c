@@ -0,0 +1,554 @@
+#define F_CPU 5000000UL
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "i2c.h"
+#include "twi_sim.h"
+#include "sim_devices.h"
+
+/*
+ * #FuzzHarness
+ *
+ * i2c.c를 twi_sim 위에서 돌리며 세 단계를 거친다.
+ *   1) clean     : Fault 없음. Busy Polling 외의 모든 트랜잭션이 성공해야 한다.
+ *   2) fault     : byte마다 Fault 주입, 중간에 400kHz로 바꿔 본다.
+ *                  (트랜잭션이 큐에 있는 채로 cli() 상태에서 I2C_SetBusSpeed()를 불러 Polling으로 비우는지 본다)
+ *   3) recovered : 다시 Fault 없음. 2)에서 Bus/Driver 상태가 망가지지 않았음을 보인다.
+ *
+ * 한 Batch는 Device마다 최대 1개의 트랜잭션을 I2C_Submit()으로 한꺼번에 넣고(인터럽트 모드)
+ * 끝날 때까지 I2C_Task()와 시간을 돌린다. 4번에 1번은 cli() 상태에서 I2C_Transfer()로 하나만 한다. (Polling 모드)
+ * Write 뒤에는 그 Device를 Address-only Write로 ACK가 올 때까지 Polling한다.
+ *
+ * 확인하는 것
+ *   - I2C_NOERROR로 끝났으면 마지막 시도에서 Master가 NACK/Fault를 보지 않았다.
+ *   - I2C_NOERROR Read는 모델 값과 같고, I2C_NOERROR Write는 모델에 반영되었다.
+ *   - 어떤 Batch도 정해진 시간 안에 끝난다. (Hang 없음, sim_set_deadline())
+ *   - Driver 통계(시도, NACK, ARBLOST, BUSERR, TIMEOUT, Recovery)가 Simulator가 센 값과 같다.
+ *
+ * 사용법 : i2c_fuzz [seed] [batches]
+ */
+
+#define BATCH_LIMIT_US		500000UL
+#define FAULT_RATE			30			// byte 1000개당
+#define FAULT_ALL			( ( 1 << SIM_FAULT_NACK ) | ( 1 << SIM_FAULT_ARBLOST ) | ( 1 << SIM_FAULT_BUSERR ) \
+							| ( 1 << SIM_FAULT_DROP ) | ( 1 << SIM_FAULT_STUCK ) )
+#define REPORT_MAX			20
+
+typedef enum
+{
+	OP_PROBE,
+	OP_EE_WRITE,
+	OP_EE_READ,
+	OP_DS_TEMP,
+	OP_DS_TH,
+	OP_DS_CONFIG,
+	OP_DS_CONVERT,
+	OP_RTC_WRITE,
+	OP_RTC_READ,
+	OP_RTC_MIXED,				// W reg → R n → Sr W reg2 + data (Read → Write Repeated START)
+	OP_COUNT
+}op_kind_t;
+
+static const char *op_name[OP_COUNT] = {
+	"probe", "ee-write", "ee-read", "ds-temp", "ds-th", "ds-config", "ds-convert",
+	"rtc-write", "rtc-read", "rtc-mixed"
+};
+
+typedef struct
+{
+	i2c_xfer_t xfer;
+	i2c_segment_t seg[4];
+	uint8_t hdr[2];
+	uint8_t hdr2;
+	uint8_t buf[SIM_24FC512_PAGE];
+	uint8_t wbuf[8];
+	uint8_t expect[SIM_24FC512_PAGE];	// Read 기대값 (Submit 시점의 모델)
+	op_kind_t kind;
+	uint16_t addr, len;
+	uint8_t addr2, wlen;
+	bool done;
+}fuzz_op_t;
+
+typedef struct
+{
+	sim_device_t *dev;
+	bool poll;					// Write Cycle이 끝났는지 Polling해야 한다.
+	fuzz_op_t op;
+}slot_t;
+
+typedef struct
+{
+	uint32_t ops[OP_COUNT];
+	uint32_t fail[OP_COUNT];
+}phase_count_t;
+
+static sim_24fc512_t eeprom;
+static sim_ds1621_t ds1621;
+static sim_pcf8563_t rtc;
+static slot_t slots[3];
+
+static phase_count_t count;
+static uint32_t violations;
+
+static void violation( const fuzz_op_t *op, const char *what )
+{
+	if ( violations++ < REPORT_MAX )
+		printf( "  !! %s : %s (0x%02X addr 0x%04X len %u, status %d, attempts %u)\r\n",
+				op ? op_name[op->kind] : "-", what, op ? op->xfer.address : 0,
+				op ? op->addr : 0, op ? op->len : 0, op ? (int)op->xfer.status : 0, op ? op->xfer.attempts : 0 );
+}
+
+static uint16_t rnd( uint16_t n )
+{
+	return (uint16_t)( sim_random() % n );
+}
+
+static void fill_random( uint8_t *p, uint16_t n )
+{
+	while ( n-- )
+		*p++ = (uint8_t)sim_random();
+}
+
+//////////////////////////////////////////////////////////////////////////
+// 트랜잭션 만들기
+
+static void on_done( i2c_xfer_t *xfer )
+{
+	fuzz_op_t *op = (fuzz_op_t *)xfer->context;
+
+	op->done = true;
+	if ( xfer->status != I2C_NOERROR )
+		return;
+
+	// 완료 callback 시점의 Simulator 상태 = 이 트랜잭션의 마지막 시도
+	if ( sim_attempt_faulted() )
+		violation( op, "NACK/Fault를 본 시도가 NOERROR로 끝났다" );
+
+	switch ( op->kind )
+	{
+		case OP_EE_READ :
+		case OP_DS_TEMP :
+		case OP_DS_CONFIG :
+		case OP_RTC_READ :
+			if ( memcmp( op->buf, op->expect, op->len ) )
+				violation( op, "Read 값이 모델과 다르다" );
+			break;
+		case OP_RTC_MIXED :
+			// 앞 시도의 Write가 이미 반영되었을 수 있으므로 첫 시도만 비교
+			if ( xfer->attempts == 0 && memcmp( op->buf, op->expect, op->len ) )
+				violation( op, "Read 값이 모델과 다르다" );
+			break;
+		default :
+			break;
+	}
+}
+
+static void split_segment( fuzz_op_t *op, uint8_t first, uint8_t *buf, uint16_t len, uint8_t flags )
+{
+	uint16_t k = rnd( (uint16_t)( len + 1 ) );	// 0이면 길이 0 Segment (건너뛰어야 한다)
+
+	op->seg[first].buffer = buf;
+	op->seg[first].length = k;
+	op->seg[first].flags = flags;
+	op->seg[first + 1].buffer = buf + k;
+	op->seg[first + 1].length = (uint16_t)( len - k );
+	op->seg[first + 1].flags = flags;
+}
+
+static void make_op( slot_t *s )
+{
+	fuzz_op_t *op = &s->op;
+	uint16_t room, i;
+
+	memset( op, 0, sizeof(*op) );
+
+	if ( s->poll )
+		op->kind = OP_PROBE;
+	else if ( s->dev == &eeprom.dev )
+		op->kind = rnd( 2 ) ? OP_EE_WRITE : OP_EE_READ;
+	else if ( s->dev == &ds1621.dev )
+		op->kind = (op_kind_t)( OP_DS_TEMP + rnd( 4 ) );
+	else
+		op->kind = (op_kind_t)( OP_RTC_WRITE + rnd( 3 ) );
+
+	switch ( op->kind )
+	{
+		case OP_PROBE :
+			I2C_Xfer_Segments( &op->xfer, s->dev->address, NULL, 0 );
+			op->xfer.flags = I2C_XFER_NORETRY;
+			break;
+
+		case OP_EE_WRITE :
+			op->addr = (uint16_t)sim_random();
+			room = SIM_24FC512_PAGE - ( op->addr & ( SIM_24FC512_PAGE - 1 ) );
+			op->len = 1 + rnd( room < 64 ? room : 64 );
+			fill_random( op->buf, op->len );
+			op->hdr[0] = (uint8_t)( op->addr >> 8 );
+			op->hdr[1] = (uint8_t)op->addr;
+			op->seg[0] = (i2c_segment_t){ op->hdr, 2, I2C_SEG_WRITE };
+			split_segment( op, 1, op->buf, op->len, I2C_SEG_WRITE );
+			I2C_Xfer_Segments( &op->xfer, s->dev->address, op->seg, 3 );
+			break;
+
+		case OP_EE_READ :
+			op->addr = (uint16_t)sim_random();
+			op->len = 1 + rnd( SIM_24FC512_PAGE );
+			for ( i = 0; i < op->len; i++ )
+				op->expect[i] = eeprom.mem[(uint16_t)( op->addr + i )];
+			op->hdr[0] = (uint8_t)( op->addr >> 8 );
+			op->hdr[1] = (uint8_t)op->addr;
+			op->seg[0] = (i2c_segment_t){ op->hdr, 2, I2C_SEG_WRITE };
+			split_segment( op, 1, op->buf, op->len, I2C_SEG_READ );
+			I2C_Xfer_Segments( &op->xfer, s->dev->address, op->seg, 3 );
+			break;
+
+		case OP_DS_TEMP :
+			op->len = 2;
+			op->expect[0] = (uint8_t)( ds1621.temp >> 8 );
+			op->expect[1] = (uint8_t)ds1621.temp;
+			I2C_Xfer_Prepare( &op->xfer, s->dev->address, 0xAA, 1, op->buf, 2, I2C_XFER_READ );
+			break;
+
+		case OP_DS_TH :
+			op->len = 2;
+			op->buf[0] = (uint8_t)sim_random();
+			op->buf[1] = (uint8_t)( sim_random() & 0x80 );
+			I2C_Xfer_Prepare( &op->xfer, s->dev->address, 0xA1, 1, op->buf, 2, I2C_XFER_WRITE );
+			break;
+
+		case OP_DS_CONFIG :
+			op->len = 1;
+			op->expect[0] = ds1621.config;
+			I2C_Xfer_Prepare( &op->xfer, s->dev->address, 0xAC, 1, op->buf, 1, I2C_XFER_READ );
+			break;
+
+		case OP_DS_CONVERT :
+			I2C_Xfer_Prepare( &op->xfer, s->dev->address, 0xEE, 1, NULL, 0, I2C_XFER_WRITE );
+			break;
+
+		case OP_RTC_WRITE :
+			op->addr = rnd( 16 );
+			op->len = 1 + rnd( 8 );
+			fill_random( op->buf, op->len );
+			I2C_Xfer_Prepare( &op->xfer, s->dev->address, op->addr, 1, op->buf, op->len, I2C_XFER_WRITE );
+			break;
+
+		case OP_RTC_READ :
+			op->addr = rnd( 16 );
+			op->len = 1 + rnd( 16 );
+			for ( i = 0; i < op->len; i++ )
+				op->expect[i] = rtc.reg[( op->addr + i ) & 0x0F];
+			I2C_Xfer_Prepare( &op->xfer, s->dev->address, op->addr, 1, op->buf, op->len, I2C_XFER_READ );
+			break;
+
+		case OP_RTC_MIXED :
+			op->addr = rnd( 16 );
+			op->len = 1 + rnd( 8 );
+			for ( i = 0; i < op->len; i++ )
+				op->expect[i] = rtc.reg[( op->addr + i ) & 0x0F];
+			op->addr2 = (uint8_t)rnd( 16 );
+			op->wlen = (uint8_t)( 1 + rnd( 8 ) );
+			fill_random( op->wbuf, op->wlen );
+			op->hdr[0] = (uint8_t)op->addr;
+			op->hdr2 = op->addr2;
+			op->seg[0] = (i2c_segment_t){ op->hdr, 1, I2C_SEG_WRITE };
+			op->seg[1] = (i2c_segment_t){ op->buf, op->len, I2C_SEG_READ };
+			op->seg[2] = (i2c_segment_t){ &op->hdr2, 1, I2C_SEG_WRITE };
+			op->seg[3] = (i2c_segment_t){ op->wbuf, op->wlen, I2C_SEG_WRITE };
+			I2C_Xfer_Segments( &op->xfer, s->dev->address, op->seg, 4 );
+			break;
+
+		default :
+			break;
+	}
+
+	if ( rnd( 3 ) == 0 )
+		op->xfer.priority = (uint8_t)rnd( 3 );
+	op->xfer.callback = on_done;
+	op->xfer.context = op;
+}
+
+// 끝난 트랜잭션의 Write 결과 확인, 다음 Batch 준비
+static void finish_op( slot_t *s, bool clean )
+{
+	fuzz_op_t *op = &s->op;
+	bool ok = op->xfer.status == I2C_NOERROR;
+	uint16_t i;
+
+	if ( !op->done )
+		violation( op, "완료 callback이 오지 않았다" );
+
+	count.ops[op->kind]++;
+	if ( !ok )
+	{
+		count.fail[op->kind]++;
+		if ( clean && op->kind != OP_PROBE )
+			violation( op, "Fault가 없는데 실패했다" );
+	}
+
+	switch ( op->kind )
+	{
+		case OP_PROBE :
+			if ( ok )
+				s->poll = false;
+			break;
+
+		case OP_EE_WRITE :
+			for ( i = 0; ok && i < op->len; i++ )
+				if ( eeprom.mem[op->addr + i] != op->buf[i] )
+				{
+					violation( op, "Write가 EEPROM에 반영되지 않았다" );
+					break;
+				}
+			s->poll = true;		// 실패했어도 일부가 기록되어 Write Cycle 중일 수 있다.
+			break;
+
+		case OP_DS_TH :
+			if ( ok && ds1621.th != (int16_t)( op->buf[0] << 8 | op->buf[1] ) )
+				violation( op, "TH가 반영되지 않았다" );
+			s->poll = true;
+			break;
+
+		case OP_DS_CONVERT :
+			if ( ok && !ds1621.converting )
+				violation( op, "변환이 시작되지 않았다" );
+			ds1621.converting = false;
+			break;
+
+		case OP_RTC_WRITE :
+			for ( i = 0; ok && i < op->len; i++ )
+				if ( rtc.reg[( op->addr + i ) & 0x0F] != op->buf[i] )
+				{
+					violation( op, "레지스터에 반영되지 않았다" );
+					break;
+				}
+			break;
+
+		case OP_RTC_MIXED :
+			for ( i = 0; ok && i < op->wlen; i++ )
+				if ( rtc.reg[( op->addr2 + i ) & 0x0F] != op->wbuf[i] )
+				{
+					violation( op, "레지스터에 반영되지 않았다" );
+					break;
+				}
+			break;
+
+		default :
+			break;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Batch
+
+static void batch_interrupt( bool clean, uint32_t speed )
+{
+	bool used[3] = { false, false, false };
+	bool pending;
+	uint8_t i, n;
+
+	sim_set_deadline( sim_now + SIM_US( BATCH_LIMIT_US ) );
+
+	// Device 순서를 섞어 Priority 큐 삽입 순서가 매번 달라지게 한다.
+	for ( n = 0; n < 3; n++ )
+	{
+		i = (uint8_t)rnd( 3 );
+		if ( used[i] || rnd( 4 ) == 0 )
+			continue;
+		used[i] = true;
+		make_op( &slots[i] );
+		I2C_Submit( &slots[i].op.xfer );
+	}
+
+	// speed가 있으면 큐가 찬 채로 인터럽트를 끄고 속도를 바꾼다. (큐를 Polling으로 비워야 한다)
+	if ( speed )
+	{
+		cli();
+		I2C_SetBusSpeed( speed, 0 );
+		sei();
+		if ( !I2C_IsIdle() )
+			violation( NULL, "cli() 상태의 I2C_SetBusSpeed()가 큐를 비우지 않았다" );
+	}
+
+	do
+	{
+		I2C_Task();
+		sim_advance( (uint32_t)SIM_US(20) );
+
+		pending = false;
+		for ( i = 0; i < 3; i++ )
+			if ( used[i] && !slots[i].op.done )
+				pending = true;
+	} while ( pending );
+
+	sim_advance( (uint32_t)SIM_US(20) );	// 마지막 STOP까지 Bus에 반영
+
+	if ( !I2C_IsIdle() )
+		violation( NULL, "모든 트랜잭션이 끝났는데 큐가 비지 않았다" );
+
+	for ( i = 0; i < 3; i++ )
+		if ( used[i] )
+			finish_op( &slots[i], clean );
+}
+
+static void batch_polling( bool clean )
+{
+	slot_t *s = &slots[rnd( 3 )];
+
+	sim_set_deadline( sim_now + SIM_US( BATCH_LIMIT_US ) );
+
+	make_op( s );
+	cli();
+	I2C_Transfer( &s->op.xfer );
+	sei();
+	sim_advance( (uint32_t)SIM_US(20) );
+
+	finish_op( s, clean );
+}
+
+//////////////////////////////////////////////////////////////////////////
+// 보고
+
+static void check_stats( const sim_device_t *dev )
+{
+	const i2c_dev_stats_t *st = I2C_GetDeviceStats( dev->address );
+	const sim_addr_stats_t *ss = sim_addr_stats( dev->address );
+	uint32_t timeouts = ss->injected[SIM_FAULT_DROP] + ss->injected[SIM_FAULT_STUCK];
+	i2c_dev_stats_t none;
+
+	if ( st == NULL )
+	{
+		memset( &none, 0, sizeof(none) );
+		st = &none;
+	}
+
+	if ( st->transfers != (uint16_t)ss->attempts || st->nack != (uint16_t)ss->nack
+		 || st->arblost != (uint16_t)ss->injected[SIM_FAULT_ARBLOST]
+		 || st->buserr != (uint16_t)ss->injected[SIM_FAULT_BUSERR]
+		 || st->timeout != (uint16_t)timeouts
+		 || st->recoveries != (uint16_t)( st->buserr + st->timeout ) )
+	{
+		violation( NULL, "Driver 통계가 Bus에서 일어난 일과 다르다" );
+		printf( "     %s driver xfer %u nack %u arb %u berr %u tout %u rcvr %u / sim xfer %lu nack %lu arb %lu berr %lu tout %lu\r\n",
+				dev->name, st->transfers, st->nack, st->arblost, st->buserr, st->timeout, st->recoveries,
+				(unsigned long)ss->attempts, (unsigned long)ss->nack,
+				(unsigned long)ss->injected[SIM_FAULT_ARBLOST], (unsigned long)ss->injected[SIM_FAULT_BUSERR],
+				(unsigned long)timeouts );
+	}
+}
+
+/*
+ * #TransactionCost
+ * transitions : stateHandlerTable 호출 수 (Driver 통계, 재시도 포함)
+ * isr         : TWI0_TWIM_vect 진입 수 (Polling 모드 트랜잭션은 0이므로 평균이 조금 낮아진다)
+ * reg         : TWI0 레지스터 접근 수
+ * scl         : SCL clock 수, bus_us는 Bus를 잡고 있던 시간
+ * AVR cycle은 여기서 잴 수 없다. 보드에서 I2C_DumpStats()의 ISR cycles/xfer를 본다.
+ */
+static void report( const char *phase )
+{
+	uint8_t i;
+	uint32_t ops = 0, fail = 0;
+
+	for ( i = 0; i < OP_COUNT; i++ )
+	{
+		ops += count.ops[i];
+		fail += count.fail[i];
+	}
+	printf( "[%s] %lu transactions, %lu failed (", phase, (unsigned long)ops, (unsigned long)fail );
+	for ( i = 0; i < OP_COUNT; i++ )
+		if ( count.ops[i] )
+			printf( " %s %lu/%lu", op_name[i], (unsigned long)( count.ops[i] - count.fail[i] ), (unsigned long)count.ops[i] );
+	printf( " )\r\n" );
+
+	printf( "  DEVICE   XFER  DONE  FAIL  NACK  ARB BERR TOUT | transitions   isr   reg   scl  bus_us  (per transaction)\r\n" );
+	for ( i = 0; i < 3; i++ )
+	{
+		const sim_device_t *dev = slots[i].dev;
+		const i2c_dev_stats_t *st = I2C_GetDeviceStats( dev->address );
+		const sim_addr_stats_t *ss = sim_addr_stats( dev->address );
+		double n;
+
+		check_stats( dev );
+		if ( st == NULL || st->transactions == 0 )
+			continue;
+
+		n = st->transactions;
+		printf( "  %-7s %5u %5u %5u %5u %4u %4u %4u | %11.2f %5.2f %5.1f %5.1f %7.1f\r\n",
+				dev->name, st->transfers, st->transactions, st->failures, st->nack,
+				st->arblost, st->buserr, st->timeout,
+				st->transitions / n, ss->isr / n, ss->reg_access / n, ss->scl / n,
+				(double)ss->bus_cycles / SIM_US(1) / n );
+	}
+}
+
+static void phase( const char *name, uint16_t rate, uint32_t batches )
+{
+	bool clean = ( rate == 0 );
+	uint32_t b;
+
+	memset( &count, 0, sizeof(count) );
+	I2C_ClearDeviceStats();
+	sim_clear_stats();
+	sim_set_fault_rate( rate, FAULT_ALL );
+
+	for ( b = 0; b < batches; b++ )
+	{
+		// Fault 단계 가운데에서 Fast-mode로 바꾼다.
+		if ( !clean && b == batches / 2 )
+			batch_interrupt( clean, I2C_SPEED_FAST );
+		else if ( rnd( 4 ) == 0 )
+			batch_polling( clean );
+		else
+			batch_interrupt( clean, 0 );
+	}
+
+	sim_set_fault_rate( 0, 0 );
+	if ( !clean )
+		I2C_SetBusSpeed( I2C_DEFAULT_SPEED, I2C_DEFAULT_RISE_NS );
+
+	report( name );
+	if ( sim_sda_stuck() )
+		violation( NULL, "SDA가 풀리지 않았다" );
+}
+
+int main( int argc, char **argv )
+{
+	uint32_t seed = ( argc > 1 ) ? (uint32_t)strtoul( argv[1], NULL, 0 ) : 1;
+	uint32_t batches = ( argc > 2 ) ? (uint32_t)strtoul( argv[2], NULL, 0 ) : 2000;
+	uint8_t found[8], n;
+
+	sim_reset();
+	sim_seed( seed );
+
+	sim_24fc512_init( &eeprom );
+	sim_ds1621_init( &ds1621 );
+	sim_pcf8563_init( &rtc );
+	sim_attach( &eeprom.dev );
+	sim_attach( &ds1621.dev );
+	sim_attach( &rtc.dev );
+	slots[0].dev = &eeprom.dev;
+	slots[1].dev = &ds1621.dev;
+	slots[2].dev = &rtc.dev;
+
+	sim_set_tick( I2C_TickISR );
+	I2C_Init();
+
+	// 인터럽트를 켜기 전의 Blocking 호출 (Polling 경로)
+	n = I2C_ScanBus( found, sizeof(found) );
+	if ( n != 3 || found[0] != SIM_DS1621_ADDRESS || found[1] != SIM_24FC512_ADDRESS || found[2] != SIM_PCF8563_ADDRESS )
+		violation( NULL, "Bus Scan 결과가 다르다" );
+	sei();
+
+	printf( "i2c_fuzz seed %lu, %lu batches per phase\r\n", (unsigned long)seed, (unsigned long)batches );
+	phase( "clean", 0, batches );
+	phase( "fault", FAULT_RATE, batches );
+	phase( "recovered", 0, batches );
+
+	printf( "%s : %lu violation(s), %.1f ms simulated\r\n", violations ? "FAIL" : "PASS",
+			(unsigned long)violations, (double)sim_now / SIM_US(1000) );
+	return violations ? 1 : 0;
+}
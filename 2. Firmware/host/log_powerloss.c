@@ -0,0 +1,327 @@
+#define F_CPU 5000000UL
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "i2c.h"
+#include "d24fc512.h"
+#include "d24fc512_log.h"
+#include "twi_sim.h"
+#include "sim_devices.h"
+
+/*
+ * #PowerLoss #TornWrite
+ *
+ * d24fc512_log.c를 RAM 24FC512 모델(sim_24fc512_t) 위에서 돌리며 Page Write 하나하나에서 전원을 끊어 본다.
+ *
+ *   - Append 하나가 만든 Page Write(Copy-forward + 새 Record)를 commit() Hook으로 순서대로 남긴다.
+ *   - j번째 Page Write에서 전원이 꺼진 이미지 = Append 전 이미지 + 0 ~ j-1번째 + 찢어진 j번째
+ *     (찢어진 Page : 기록하려던 byte마다 새 값 / 옛 값 / 쓰레기 중 하나)
+ *   - 그 이미지로 다시 Mount하여 type마다 최신 값이 "Append 전 값" 또는 "이번에 쓰던 값"인지 확인한다.
+ *   - 4번에 1번은 찢어진 이미지를 그대로 두고 이어서 Append한다. (전원이 실제로 꺼졌다 켜진 경우)
+ *
+ * 처음 40번, Slot 0 부근(lap이 바뀌는 곳), Copy-forward가 있었던 Append, 그 밖의 1/64는 모든 Page Write를 본다.
+ * Log를 3바퀴 돌린 뒤 Bus 에러 경로를 본다.
+ *   - Read 주소만 NACK : Append는 false이고 아무것도 쓰지 않는다. (밀려날 Record를 모른 채 쓰지 않는다)
+ *   - 칩 전원 꺼짐     : Append는 false이고 head가 그대로다. Mount도 false이고 이후 Append/ReadLatest가 거부된다.
+ *
+ * 인터럽트는 켜지 않는다. (모든 호출이 I2C_Transfer()의 Polling 경로로 돈다)
+ *
+ * 사용법 : log_powerloss [seed]
+ */
+
+#define CALL_LIMIT_US		2000000UL
+#define JOURNAL_MAX			( EEPROM_LOG_TYPES + 1 )
+#define STEPS				( 3UL * EEPROM_LOG_SLOTS )
+#define TYPE_COUNT			4			// 0 : 처음 한 번, 1 : 가끔, 2 : 자주, 3 : 나머지
+
+typedef struct
+{
+	uint16_t page;
+	uint8_t latch[SIM_24FC512_PAGE];
+	bool latched[SIM_24FC512_PAGE];
+}commit_t;
+
+typedef struct
+{
+	bool present;
+	uint8_t length;
+	uint8_t data[EEPROM_LOG_PAYLOAD_MAX];
+}value_t;
+
+static sim_24fc512_t eeprom;
+static uint8_t before[SIM_24FC512_SIZE], after[SIM_24FC512_SIZE];
+static commit_t journal[JOURNAL_MAX];
+static uint8_t journal_count;
+static bool journal_overflow;
+
+static value_t expect[TYPE_COUNT];
+static uint32_t violations;
+static uint32_t checks, kept;
+
+static void violation( uint32_t step, const char *what )
+{
+	violations++;
+	if ( violations <= 20 )
+		printf( "  !! step %lu : %s (head %lu)\r\n", (unsigned long)step, what, (unsigned long)EEPROM_Log_HeadSeq() );
+}
+
+static void record_commit( sim_24fc512_t *m, uint16_t page )
+{
+	commit_t *c;
+
+	if ( journal_count >= JOURNAL_MAX )
+	{
+		journal_overflow = true;
+		return;
+	}
+	c = &journal[journal_count++];
+	c->page = page;
+	memcpy( c->latch, m->latch, sizeof(c->latch) );
+	memcpy( c->latched, m->latched, sizeof(c->latched) );
+}
+
+static void apply( const commit_t *c, bool torn )
+{
+	uint8_t i;
+
+	for ( i = 0; i < SIM_24FC512_PAGE; i++ )
+	{
+		if ( !c->latched[i] )
+			continue;
+		if ( !torn )
+			eeprom.mem[c->page + i] = c->latch[i];
+		else switch ( sim_random() % 3 )
+		{
+			case 0 : eeprom.mem[c->page + i] = c->latch[i];				break;
+			case 1 :													break;		// 아직 지워지지 않았다.
+			default : eeprom.mem[c->page + i] = (uint8_t)sim_random();	break;
+		}
+	}
+}
+
+// Firmware 호출마다 Hang을 감시한다.
+static void limit( void )
+{
+	sim_set_deadline( sim_now + SIM_US( CALL_LIMIT_US ) );
+}
+
+static bool mount( void )
+{
+	limit();
+	return EEPROM_Log_Mount();
+}
+
+static bool append( uint8_t type, const value_t *v )
+{
+	limit();
+	return EEPROM_Log_Append( type, v->data, v->length );
+}
+
+static bool read_latest( uint8_t type, value_t *v )
+{
+	limit();
+	v->present = EEPROM_Log_ReadLatest( type, v->data, &v->length );
+	return v->present;
+}
+
+static bool same( const value_t *a, const value_t *b )
+{
+	if ( a->present != b->present )
+		return false;
+	return !a->present || ( a->length == b->length && memcmp( a->data, b->data, a->length ) == 0 );
+}
+
+static uint8_t pick_type( uint32_t step )
+{
+	if ( step == 0 )		return 0;
+	if ( step % 97 == 0 )	return 1;
+	if ( step % 13 == 0 )	return 2;
+	return 3;
+}
+
+static void make_value( value_t *v, uint32_t step )
+{
+	uint8_t i;
+
+	v->present = true;
+	v->length = (uint8_t)( 4 + sim_random() % ( EEPROM_LOG_PAYLOAD_MAX - 3 ) );
+	memcpy( v->data, &step, 4 );
+	for ( i = 4; i < v->length; i++ )
+		v->data[i] = (uint8_t)sim_random();
+}
+
+/*
+ * j번째 Page Write에서 전원이 꺼진 이미지로 Mount해 본다.
+ * keep이면 그 이미지에서 계속하고, 아니면 Append가 끝난 이미지로 되돌린다.
+ */
+static void power_loss( uint32_t step, uint8_t j, uint8_t type, const value_t *v, uint32_t head, bool keep )
+{
+	value_t got;
+	uint8_t i, t;
+
+	memcpy( eeprom.mem, before, sizeof(before) );
+	for ( i = 0; i < j; i++ )
+		apply( &journal[i], false );
+	apply( &journal[j], true );
+	checks++;
+
+	if ( !mount() && head )
+		violation( step, "전원 차단 뒤 Mount 실패" );
+	if ( EEPROM_Log_HeadSeq() < head )
+		violation( step, "전원 차단 뒤 head가 뒤로 갔다" );
+
+	for ( t = 0; t < TYPE_COUNT; t++ )
+	{
+		read_latest( t, &got );
+		if ( same( &got, &expect[t] ) )
+			continue;
+		if ( t == type && same( &got, v ) )
+			continue;
+		violation( step, "전원 차단 뒤 최신 값이 사라졌다" );
+	}
+
+	if ( keep )
+	{
+		read_latest( type, &expect[type] );
+		kept++;
+		return;
+	}
+
+	memcpy( eeprom.mem, after, sizeof(after) );
+	if ( !mount() )
+		violation( step, "Mount 실패" );
+}
+
+static void run( void )
+{
+	value_t v, got;
+	uint32_t step, head;
+	uint16_t slot;
+	uint8_t type, j;
+	bool check;
+
+	for ( step = 0; step < STEPS; step++ )
+	{
+		type = pick_type( step );
+		make_value( &v, step );
+		head = EEPROM_Log_HeadSeq();
+
+		memcpy( before, eeprom.mem, sizeof(before) );
+		journal_count = 0;
+		journal_overflow = false;
+		if ( !append( type, &v ) )
+		{
+			violation( step, "Append 실패" );
+			continue;
+		}
+		if ( journal_overflow || journal_count == 0 )
+			violation( step, "Append 하나의 Page Write 수가 이상하다" );
+		memcpy( after, eeprom.mem, sizeof(after) );
+
+		read_latest( type, &got );
+		if ( !same( &got, &v ) )
+			violation( step, "방금 쓴 값을 읽지 못했다" );
+
+		slot = (uint16_t)( EEPROM_Log_HeadSeq() % EEPROM_LOG_SLOTS );
+		check = step < 40 || slot < 3 || slot >= EEPROM_LOG_SLOTS - 3 || journal_count > 1 || sim_random() % 64 == 0;
+		if ( check )
+		{
+			for ( j = 0; j < journal_count; j++ )
+				power_loss( step, j, type, &v, head, false );
+			if ( step > 0 && sim_random() % 4 == 0 )		// type 0은 처음 한 번만 쓰므로 남긴다.
+			{
+				power_loss( step, (uint8_t)( sim_random() % journal_count ), type, &v, head, true );
+				continue;
+			}
+		}
+		expect[type] = v;
+	}
+}
+
+static void bus_errors( void )
+{
+	value_t v, got;
+	uint32_t head, writes;
+	uint8_t t;
+
+	if ( EEPROM_Log_HeadSeq() + 1 < (uint32_t)EEPROM_LOG_WINDOW + EEPROM_LOG_SLOTS )
+		violation( STEPS, "Log가 한 바퀴를 돌지 않았다" );
+	if ( !expect[0].present )
+		violation( STEPS, "type 0이 Copy-forward로 살아남지 못했다" );
+
+	// Read만 실패 : Copy-forward 여부를 모르므로 아무것도 쓰지 않는다.
+	make_value( &v, STEPS );
+	head = EEPROM_Log_HeadSeq();
+	writes = eeprom.page_writes;
+	eeprom.nack_read = true;
+	if ( append( 3, &v ) )
+		violation( STEPS, "Read 실패인데 Append가 성공했다" );
+	if ( eeprom.page_writes != writes || EEPROM_Log_HeadSeq() != head )
+		violation( STEPS, "Read 실패인데 Record를 썼다" );
+
+	// Read 실패를 "없음"으로 기억하지 않는다.
+	eeprom.nack_read = false;
+	mount();
+	eeprom.nack_read = true;
+	if ( read_latest( 0, &got ) )
+		violation( STEPS, "Read 실패인데 ReadLatest가 성공했다" );
+	eeprom.nack_read = false;
+	if ( !read_latest( 0, &got ) || !same( &got, &expect[0] ) )
+		violation( STEPS, "Read 실패 뒤 값을 찾지 못한다" );
+
+	if ( !append( 3, &v ) )
+		violation( STEPS, "Bus가 돌아온 뒤 Append 실패" );
+	expect[3] = v;
+
+	// 칩 전원 꺼짐 : Write도 실패하고 head는 그대로다.
+	make_value( &v, STEPS + 1 );
+	head = EEPROM_Log_HeadSeq();
+	eeprom.off = true;
+	if ( append( 2, &v ) || EEPROM_Log_HeadSeq() != head )
+		violation( STEPS + 1, "칩이 꺼졌는데 Append가 성공했다" );
+	if ( mount() )
+		violation( STEPS + 1, "칩이 꺼졌는데 Mount가 성공했다" );
+	eeprom.off = false;
+	if ( append( 2, &v ) || read_latest( 2, &got ) )
+		violation( STEPS + 1, "Mount 실패 뒤 Append/ReadLatest를 받았다" );
+
+	if ( !mount() || EEPROM_Log_HeadSeq() != head )
+		violation( STEPS + 1, "칩이 돌아온 뒤 Mount 결과가 다르다" );
+	if ( !append( 2, &v ) )
+		violation( STEPS + 1, "칩이 돌아온 뒤 Append 실패" );
+	expect[2] = v;
+
+	for ( t = 0; t < TYPE_COUNT; t++ )
+		if ( !read_latest( t, &got ) || !same( &got, &expect[t] ) )
+			violation( STEPS + 1, "Bus 에러 뒤 최신 값이 다르다" );
+}
+
+int main( int argc, char **argv )
+{
+	uint32_t seed = ( argc > 1 ) ? (uint32_t)strtoul( argv[1], NULL, 0 ) : 1;
+	value_t got;
+
+	sim_reset();
+	sim_seed( seed );
+	sim_24fc512_init( &eeprom );
+	eeprom.commit = record_commit;
+	sim_attach( &eeprom.dev );
+	sim_set_tick( I2C_TickISR );
+	I2C_Init();
+
+	if ( mount() || EEPROM_Log_HeadSeq() != 0 || read_latest( 0, &got ) )
+		violation( 0, "빈 EEPROM인데 Record가 있다" );
+
+	printf( "log_powerloss seed %lu, %u slots, %lu appends\r\n", (unsigned long)seed,
+			(unsigned)EEPROM_LOG_SLOTS, (unsigned long)STEPS );
+	run();
+	bus_errors();
+
+	printf( "%s : %lu violation(s), %lu power loss image(s) (%lu kept), %lu page writes, %.1f s simulated\r\n",
+			violations ? "FAIL" : "PASS", (unsigned long)violations, (unsigned long)checks, (unsigned long)kept,
+			(unsigned long)eeprom.page_writes, (double)sim_now / SIM_US(1000000UL) );
+	return violations ? 1 : 0;
+}
@@ -0,0 +1,17 @@
+#ifndef MOCK_AVR_INTERRUPT_H_
+#define MOCK_AVR_INTERRUPT_H_
+
+/*
+ * ISR은 보통 함수가 되고, Simulator가 조건(I bit, Interrupt Enable, Flag)을 보고 직접 호출한다.
+ * sei()는 그 자리에서 대기 중인 인터럽트를 처리한다. (SREG = sreg 로 되살린 경우는 다음 Hook에서)
+ */
+
+#include <avr/io.h>
+
+void sim_sei( void );
+
+#define ISR(vector)					void vector( void ); void vector( void )
+#define cli()						( sim_sreg &= (uint8_t)~CPU_I_bm )
+#define sei()						sim_sei()
+
+#endif /* MOCK_AVR_INTERRUPT_H_ */
@@ -0,0 +1,146 @@
+#ifndef MOCK_AVR_IO_H_
+#define MOCK_AVR_IO_H_
+
+/*
+ * #HostMock
+ *
+ * PC에서 Firmware 소스(i2c.c 등)를 그대로 컴파일하기 위한 <avr/io.h> 대역.
+ * TWI0/TCB1/PORTA는 접근할 때마다 twi_sim.c의 함수를 거치므로
+ * Simulator가 앞선 Write를 레지스터 동작(Command, Write-1-to-Clear 등)으로 바꿔 처리한다.
+ *
+ * Write 감지를 위해 일부 레지스터는 16bit로 두고, Simulator가 채워 두는 값에
+ * 0x100(Sentinel)을 붙인다. 8bit 값을 대입하면 Sentinel이 지워지므로 같은 값을 다시 써도 알 수 있다.
+ * (|= 로 아무 bit도 더하지 않는 Write만 구분되지 않는데, 그 경우는 레지스터 동작도 없다)
+ */
+
+#include <stdint.h>
+
+typedef volatile uint8_t  register8_t;
+typedef volatile uint16_t register16_t;
+
+typedef struct
+{
+	register8_t  CTRLA;
+	register8_t  DUALCTRL;
+	register8_t  DBGCTRL;
+	register16_t MCTRLA;
+	register16_t MCTRLB;
+	register16_t MSTATUS;
+	register8_t  MBAUD;
+	register16_t MADDR;
+	register16_t MDATA;
+}TWI_t;
+
+typedef struct
+{
+	register8_t  CTRLA;
+	register8_t  CTRLB;
+	register8_t  EVCTRL;
+	register8_t  INTCTRL;
+	register8_t  INTFLAGS;
+	register8_t  STATUS;
+	register8_t  DBGCTRL;
+	register8_t  TEMP;
+	register16_t CNT;
+	register16_t CCMP;
+}TCB_t;
+
+typedef struct
+{
+	register8_t DIR;
+	register8_t DIRSET;
+	register8_t DIRCLR;
+	register8_t DIRTGL;
+	register8_t OUT;
+	register8_t OUTSET;
+	register8_t OUTCLR;
+	register8_t OUTTGL;
+	register8_t IN;
+	register8_t INTFLAGS;
+	register8_t PORTCTRL;
+	register8_t PIN0CTRL;
+	register8_t PIN1CTRL;
+	register8_t PIN2CTRL;
+	register8_t PIN3CTRL;
+	register8_t PIN4CTRL;
+	register8_t PIN5CTRL;
+	register8_t PIN6CTRL;
+	register8_t PIN7CTRL;
+}PORT_t;
+
+TWI_t  *sim_twi0( void );
+TCB_t  *sim_tcb1( void );
+PORT_t *sim_porta( void );
+extern PORT_t sim_portd;
+
+#define TWI0						(*sim_twi0())
+#define TCB1						(*sim_tcb1())
+#define PORTA						(*sim_porta())
+#define PORTD						sim_portd		// Bus와 관계없는 핀 (PCF8563 CLKOUT 등), 보통 메모리
+
+extern volatile uint8_t sim_sreg;
+#define SREG						sim_sreg
+#define CPU_I_bm					0x80
+
+#define PIN0_bm						0x01
+#define PIN1_bm						0x02
+#define PIN2_bm						0x04
+#define PIN3_bm						0x08
+#define PIN4_bm						0x10
+#define PIN5_bm						0x20
+#define PIN6_bm						0x40
+#define PIN7_bm						0x80
+
+#define PORT_PULLUPEN_bm			0x08
+#define PORT_ISC_gm					0x07
+#define PORT_ISC_INTDISABLE_gc		0x00
+#define PORT_ISC_FALLING_gc			0x03
+
+#define TWI_FMPEN_bm				0x02
+#define TWI_SDAHOLD_gm				0x0C
+#define TWI_SDAHOLD_OFF_gc			0x00
+#define TWI_SDAHOLD_50NS_gc			0x04
+#define TWI_SDAHOLD_300NS_gc		0x08
+#define TWI_SDAHOLD_500NS_gc		0x0C
+#define TWI_SDASETUP_bm				0x10
+#define TWI_SDASETUP_4CYC_gc		0x00
+#define TWI_SDASETUP_8CYC_gc		0x10
+
+#define TWI_ENABLE_bm				0x01
+#define TWI_SMEN_bm					0x02
+#define TWI_TIMEOUT_gm				0x0C
+#define TWI_TIMEOUT_DISABLED_gc		0x00
+#define TWI_TIMEOUT_50US_gc			0x04
+#define TWI_TIMEOUT_100US_gc		0x08
+#define TWI_TIMEOUT_200US_gc		0x0C
+#define TWI_QCEN_bm					0x10
+#define TWI_WIEN_bm					0x40
+#define TWI_RIEN_bm					0x80
+
+#define TWI_MCMD_gm					0x03
+#define TWI_MCMD_NOACT_gc			0x00
+#define TWI_MCMD_REPSTART_gc		0x01
+#define TWI_MCMD_RECVTRANS_gc		0x02
+#define TWI_MCMD_STOP_gc			0x03
+#define TWI_ACKACT_bm				0x04
+#define TWI_FLUSH_bm				0x08
+
+#define TWI_BUSSTATE_gm				0x03
+#define TWI_BUSSTATE_UNKNOWN_gc		0x00
+#define TWI_BUSSTATE_IDLE_gc		0x01
+#define TWI_BUSSTATE_OWNER_gc		0x02
+#define TWI_BUSSTATE_BUSY_gc		0x03
+#define TWI_BUSERR_bm				0x04
+#define TWI_ARBLOST_bm				0x08
+#define TWI_RXACK_bm				0x10
+#define TWI_CLKHOLD_bm				0x20
+#define TWI_WIF_bm					0x40
+#define TWI_RIF_bm					0x80
+
+#define TCB_ENABLE_bm				0x01
+#define TCB_CLKSEL_gm				0x06
+#define TCB_CLKSEL_CLKDIV1_gc		0x00
+#define TCB_CLKSEL_CLKDIV2_gc		0x02
+#define TCB_CAPT_bm					0x01
+
+#endif /* MOCK_AVR_IO_H_ */
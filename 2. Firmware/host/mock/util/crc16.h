@@ -0,0 +1,17 @@
+#ifndef MOCK_UTIL_CRC16_H_
+#define MOCK_UTIL_CRC16_H_
+
+#include <stdint.h>
+
+// avr-libc와 같은 결과를 내는 C 구현 (XMODEM : Poly 0x1021, MSB first)
+static inline uint16_t _crc_xmodem_update( uint16_t crc, uint8_t data )
+{
+	uint8_t i;
+
+	crc ^= (uint16_t)data << 8;
+	for ( i = 0; i < 8; i++ )
+		crc = ( crc & 0x8000 ) ? (uint16_t)( ( crc << 1 ) ^ 0x1021 ) : (uint16_t)( crc << 1 );
+	return crc;
+}
+
+#endif /* MOCK_UTIL_CRC16_H_ */
@@ -0,0 +1,15 @@
+#ifndef MOCK_UTIL_DELAY_H_
+#define MOCK_UTIL_DELAY_H_
+
+/*
+ * Busy-wait 대신 Simulator 시간을 그만큼 진행시킨다. (그동안 Bus 이벤트와 인터럽트도 처리된다)
+ */
+
+#include <stdint.h>
+
+void sim_delay_us( uint32_t us );
+
+#define _delay_us(us)				sim_delay_us( (uint32_t)(us) )
+#define _delay_ms(ms)				sim_delay_us( (uint32_t)(ms) * 1000UL )
+
+#endif /* MOCK_UTIL_DELAY_H_ */
@@ -0,0 +1,268 @@
+#include <string.h>
+#include "sim_devices.h"
+
+#define DS1621_START_CONVERT_T		0xEE
+#define DS1621_STOP_CONVERT_T		0x22
+#define DS1621_READ_TEMPERATURE		0xAA
+#define DS1621_READ_COUNTER			0xA8
+#define DS1621_READ_SLOPE			0xA9
+#define DS1621_ACCESS_TH			0xA1
+#define DS1621_ACCESS_TL			0xA2
+#define DS1621_ACCESS_CONFIG		0xAC
+#define DS1621_CFG_DONE				0x80
+#define DS1621_CFG_WRITABLE			0x63		// THF, TLF, POL, 1SHOT
+
+//////////////////////////////////////////////////////////////////////////
+// 24FC512
+
+static bool eeprom_start( sim_device_t *dev, bool read )
+{
+	sim_24fc512_t *m = (sim_24fc512_t *)dev;
+
+	if ( m->off || ( read && m->nack_read ) || sim_24fc512_busy( m ) )
+		return false;
+
+	m->writing = !read;
+	m->addr_bytes = 0;
+	m->latch_count = 0;
+	memset( m->latched, 0, sizeof(m->latched) );
+	return true;
+}
+
+static bool eeprom_write( sim_device_t *dev, uint8_t data )
+{
+	sim_24fc512_t *m = (sim_24fc512_t *)dev;
+	uint16_t page = m->pointer & (uint16_t)~( SIM_24FC512_PAGE - 1 );
+
+	if ( m->addr_bytes < 2 )
+	{
+		m->pointer = (uint16_t)( m->pointer << 8 | data );
+		m->addr_bytes++;
+		return true;
+	}
+
+	// Page Buffer 안에서만 증가한다. (Page 끝을 넘으면 Page 처음을 덮어쓴다)
+	m->latch[m->pointer & ( SIM_24FC512_PAGE - 1 )] = data;
+	m->latched[m->pointer & ( SIM_24FC512_PAGE - 1 )] = true;
+	m->latch_count++;
+	m->pointer = page | ( ( m->pointer + 1 ) & ( SIM_24FC512_PAGE - 1 ) );
+	return true;
+}
+
+static uint8_t eeprom_read( sim_device_t *dev )
+{
+	sim_24fc512_t *m = (sim_24fc512_t *)dev;
+
+	return m->mem[m->pointer++];
+}
+
+static void eeprom_stop( sim_device_t *dev, bool repeated )
+{
+	sim_24fc512_t *m = (sim_24fc512_t *)dev;
+	uint16_t page = m->pointer & (uint16_t)~( SIM_24FC512_PAGE - 1 );
+	uint8_t i;
+
+	if ( repeated || !m->writing || m->latch_count == 0 )
+		return;
+
+	if ( m->commit )
+		m->commit( m, page );
+	for ( i = 0; i < SIM_24FC512_PAGE; i++ )
+		if ( m->latched[i] )
+			m->mem[page + i] = m->latch[i];
+	m->page_writes++;
+	m->busy_until = sim_now + SIM_US( SIM_24FC512_WRITE_US );
+	m->latch_count = 0;
+}
+
+static void eeprom_abort( sim_device_t *dev )
+{
+	sim_24fc512_t *m = (sim_24fc512_t *)dev;
+
+	m->latch_count = 0;
+}
+
+void sim_24fc512_init( sim_24fc512_t *m )
+{
+	memset( m, 0, sizeof(*m) );
+	memset( m->mem, 0xFF, sizeof(m->mem) );
+
+	m->dev.address = SIM_24FC512_ADDRESS;
+	m->dev.name = "24FC512";
+	m->dev.start = eeprom_start;
+	m->dev.write = eeprom_write;
+	m->dev.read = eeprom_read;
+	m->dev.stop = eeprom_stop;
+	m->dev.abort = eeprom_abort;
+}
+
+bool sim_24fc512_busy( const sim_24fc512_t *m )
+{
+	return sim_now < m->busy_until;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// DS1621
+
+static bool ds1621_start( sim_device_t *dev, bool read )
+{
+	sim_ds1621_t *m = (sim_ds1621_t *)dev;
+
+	if ( sim_ds1621_busy( m ) )
+		return false;
+
+	if ( !read )
+	{
+		m->cmd = 0;
+		m->count = 0;
+	}
+	m->index = 0;
+	return true;
+}
+
+static bool ds1621_write( sim_device_t *dev, uint8_t data )
+{
+	sim_ds1621_t *m = (sim_ds1621_t *)dev;
+
+	if ( m->cmd == 0 )
+	{
+		m->cmd = data;
+		if ( data == DS1621_START_CONVERT_T )
+		{
+			m->converting = true;
+			m->config |= DS1621_CFG_DONE;		// 변환 시간은 흉내내지 않는다.
+		}
+		else if ( data == DS1621_STOP_CONVERT_T )
+			m->converting = false;
+		return true;
+	}
+
+	if ( m->count < sizeof(m->data) )
+		m->data[m->count++] = data;
+	return true;
+}
+
+static uint8_t ds1621_read( sim_device_t *dev )
+{
+	sim_ds1621_t *m = (sim_ds1621_t *)dev;
+	uint8_t n = m->index++;
+
+	switch ( m->cmd )
+	{
+		case DS1621_READ_TEMPERATURE :	return n == 0 ? (uint8_t)( m->temp >> 8 ) : n == 1 ? (uint8_t)m->temp : 0xFF;
+		case DS1621_ACCESS_TH :			return n == 0 ? (uint8_t)( m->th >> 8 ) : n == 1 ? (uint8_t)m->th : 0xFF;
+		case DS1621_ACCESS_TL :			return n == 0 ? (uint8_t)( m->tl >> 8 ) : n == 1 ? (uint8_t)m->tl : 0xFF;
+		case DS1621_ACCESS_CONFIG :		return n == 0 ? m->config : 0xFF;
+		case DS1621_READ_COUNTER :		return n == 0 ? m->counter : 0xFF;
+		case DS1621_READ_SLOPE :		return n == 0 ? m->slope : 0xFF;
+		default :						return 0xFF;
+	}
+}
+
+static void ds1621_stop( sim_device_t *dev, bool repeated )
+{
+	sim_ds1621_t *m = (sim_ds1621_t *)dev;
+	bool nv = false;
+
+	if ( repeated )
+		return;					// Read로 이어진다. (Command는 유지)
+
+	if ( ( m->cmd == DS1621_ACCESS_TH || m->cmd == DS1621_ACCESS_TL ) && m->count == 2 )
+	{
+		int16_t v = (int16_t)( m->data[0] << 8 | m->data[1] );
+
+		if ( m->cmd == DS1621_ACCESS_TH ) m->th = v;
+		else							  m->tl = v;
+		nv = true;
+	}
+	else if ( m->cmd == DS1621_ACCESS_CONFIG && m->count == 1 )
+	{
+		m->config = (uint8_t)( ( m->config & ~DS1621_CFG_WRITABLE ) | ( m->data[0] & DS1621_CFG_WRITABLE ) );
+		nv = true;
+	}
+
+	if ( nv )
+	{
+		m->nv_writes++;
+		m->busy_until = sim_now + SIM_US( SIM_DS1621_NV_US );
+	}
+}
+
+static void ds1621_abort( sim_device_t *dev )
+{
+	sim_ds1621_t *m = (sim_ds1621_t *)dev;
+
+	m->cmd = 0;
+	m->count = 0;
+	m->index = 0;
+}
+
+void sim_ds1621_init( sim_ds1621_t *m )
+{
+	memset( m, 0, sizeof(*m) );
+
+	m->temp = 0x1980;		// 25.5°C
+	m->th = 0x5000;			// 80°C
+	m->tl = 0x0A00;			// 10°C
+	m->counter = 0x0C;
+	m->slope = 0x10;
+
+	m->dev.address = SIM_DS1621_ADDRESS;
+	m->dev.name = "DS1621";
+	m->dev.start = ds1621_start;
+	m->dev.write = ds1621_write;
+	m->dev.read = ds1621_read;
+	m->dev.stop = ds1621_stop;
+	m->dev.abort = ds1621_abort;
+}
+
+bool sim_ds1621_busy( const sim_ds1621_t *m )
+{
+	return sim_now < m->busy_until;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// PCF8563
+
+static bool pcf8563_start( sim_device_t *dev, bool read )
+{
+	sim_pcf8563_t *m = (sim_pcf8563_t *)dev;
+
+	m->first = !read;
+	return true;
+}
+
+static bool pcf8563_write( sim_device_t *dev, uint8_t data )
+{
+	sim_pcf8563_t *m = (sim_pcf8563_t *)dev;
+
+	if ( m->first )
+	{
+		m->pointer = data & 0x0F;
+		m->first = false;
+		return true;
+	}
+	m->reg[m->pointer] = data;
+	m->pointer = ( m->pointer + 1 ) & 0x0F;
+	return true;
+}
+
+static uint8_t pcf8563_read( sim_device_t *dev )
+{
+	sim_pcf8563_t *m = (sim_pcf8563_t *)dev;
+	uint8_t data = m->reg[m->pointer];
+
+	m->pointer = ( m->pointer + 1 ) & 0x0F;
+	return data;
+}
+
+void sim_pcf8563_init( sim_pcf8563_t *m )
+{
+	memset( m, 0, sizeof(*m) );
+
+	m->dev.address = SIM_PCF8563_ADDRESS;
+	m->dev.name = "PCF8563";
+	m->dev.start = pcf8563_start;
+	m->dev.write = pcf8563_write;
+	m->dev.read = pcf8563_read;
+}
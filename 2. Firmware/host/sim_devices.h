@@ -0,0 +1,88 @@
+#ifndef SIM_DEVICES_H_
+#define SIM_DEVICES_H_
+
+/*
+ * #DeviceModel
+ *
+ * 보드의 I2C Slave를 twi_sim에 붙이는 모델. 메모리/레지스터는 그대로 들여다볼 수 있다. (Backdoor)
+ *
+ * 24FC512 (0x50) : 64KB, 2byte Word Address, 128byte Page Buffer(Page 안에서 Wrap)
+ *                  STOP에서 Page를 기록하고 5ms 동안 자기 주소에 NACK (#AckPolling)
+ *                  Sequential Read는 0xFFFF 다음 0x0000으로 돈다. Repeated START나 비정상 종료면 기록하지 않는다.
+ *                  off = true면 전원이 꺼진 칩처럼 모든 주소에 NACK, nack_read = true면 Read 주소에만 NACK
+ *                  commit()은 Page를 기록하기 직전에 불린다. (전원 차단 시험에서 기록 순서를 남긴다)
+ * DS1621  (0x48) : Command byte + Data. TH/TL/CONFIG를 쓰면 10ms 동안 NACK
+ *                  (실제 칩은 NVB bit로 알려주지만 Driver의 재시도/Polling 경로를 보려고 EEPROM처럼 NACK한다)
+ * PCF8563 (0x51) : 16개 레지스터, Register Pointer 자동 증가(0x0F 다음 0x00). 시계는 흐르지 않는다.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "twi_sim.h"
+
+#define SIM_24FC512_ADDRESS			0x50
+#define SIM_24FC512_SIZE			0x10000UL
+#define SIM_24FC512_PAGE			128
+#define SIM_24FC512_WRITE_US		5000
+
+typedef struct sim_24fc512 sim_24fc512_t;
+
+struct sim_24fc512
+{
+	sim_device_t dev;
+	uint8_t mem[SIM_24FC512_SIZE];
+
+	uint16_t pointer;
+	uint8_t addr_bytes;				// 받은 Word Address byte 수
+	bool writing;
+	uint8_t latch[SIM_24FC512_PAGE];
+	bool latched[SIM_24FC512_PAGE];
+	uint16_t latch_count;
+
+	uint64_t busy_until;
+	uint32_t page_writes;
+
+	bool off;
+	bool nack_read;
+	void (*commit)( sim_24fc512_t *m, uint16_t page );		// latch/latched가 곧 mem[page ~]에 들어간다.
+};
+
+#define SIM_DS1621_ADDRESS			0x48
+#define SIM_DS1621_NV_US			10000
+
+typedef struct
+{
+	sim_device_t dev;
+	int16_t temp;					// READ_TEMPERATURE 값 (MSB = 정수, LSB bit7 = 0.5)
+	int16_t th, tl;
+	uint8_t config;
+	uint8_t counter, slope;
+	bool converting;
+
+	uint8_t cmd;					// 이번 트랜잭션의 Command (0 = 아직 없음)
+	uint8_t data[2];
+	uint8_t count;					// Command 뒤에 받은 Data byte 수
+	uint8_t index;					// Read에서 보낸 byte 수
+
+	uint64_t busy_until;
+	uint32_t nv_writes;
+}sim_ds1621_t;
+
+#define SIM_PCF8563_ADDRESS			0x51
+
+typedef struct
+{
+	sim_device_t dev;
+	uint8_t reg[16];
+	uint8_t pointer;
+	bool first;						// 다음 Write byte가 Register Pointer
+}sim_pcf8563_t;
+
+void sim_24fc512_init( sim_24fc512_t *m );
+void sim_ds1621_init( sim_ds1621_t *m );
+void sim_pcf8563_init( sim_pcf8563_t *m );
+
+bool sim_24fc512_busy( const sim_24fc512_t *m );
+bool sim_ds1621_busy( const sim_ds1621_t *m );
+
+#endif /* SIM_DEVICES_H_ */
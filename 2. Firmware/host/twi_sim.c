@@ -0,0 +1,673 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/delay.h>
+#include "twi_sim.h"
+
+#define SENTINEL					0x100
+#define TWI_FLAGS_W1C				( TWI_RIF_bm | TWI_WIF_bm | TWI_ARBLOST_bm | TWI_BUSERR_bm )
+#define TCB_WRAP_CYCLES				( 2ULL * 0x10000ULL )		// CLK_PER/2, CCMP = 0xFFFF
+#define TICK_CYCLES					SIM_US(1000)
+#define ISR_STORM					1000						// Flag를 지우지 않는 ISR 감지
+
+void TWI0_TWIM_vect( void );
+void TCB1_INT_vect( void );
+
+uint64_t sim_now;
+volatile uint8_t sim_sreg;
+
+static TWI_t  twi;
+static TCB_t  tcb;
+static PORT_t port;
+PORT_t sim_portd;
+
+// Simulator가 마지막으로 채운 값 (다르면 그 사이에 Write가 있었다)
+static uint16_t pub_mctrla, pub_mctrlb, pub_mstatus;
+
+// TWI Master 내부 상태
+static uint8_t mctrla;
+static uint8_t ackact;
+static uint8_t flags;						// RIF/WIF/RXACK/ARBLOST/BUSERR
+static uint8_t bus = TWI_BUSSTATE_UNKNOWN_gc;
+static uint8_t rxdata;
+
+typedef enum { EV_NONE, EV_ADDR, EV_TX, EV_RX } sim_event_t;
+static sim_event_t ev;
+static uint64_t ev_time;
+static bool hold;							// WIF/RIF 후 다음 명령 대기 (Clock Hold)
+static bool reading;
+static bool wait_start;						// Bus가 풀리면 START
+static uint8_t addr_byte, tx_byte;
+static sim_device_t *dev;					// 주소를 ACK한 Slave
+static uint8_t cur_addr;
+static bool in_bus;
+static uint64_t t_bus_start;
+static uint64_t t_unknown;					// UNKNOWN이 된 시각 (Inactive Bus Timeout)
+static uint64_t t_other_done;				// Arbitration에서 이긴 Master가 끝나는 시각
+static bool attempt_faulted;
+
+// SDA Stuck, Bit-bang Recovery
+static bool sda_stuck;
+static uint8_t stuck_clocks;
+static bool scl_low_prev;
+
+static sim_device_t *devices;
+static void (*tick_isr)( void );
+static uint64_t next_tick, next_wrap;
+static bool tick_pending;
+static uint8_t in_isr, adv_depth;
+static uint64_t deadline;
+
+static uint16_t fault_rate;
+static uint8_t fault_mask;
+static uint32_t rng = 1;
+
+static sim_addr_stats_t addr_stats[128];
+
+static void twi_sync( void );
+static void port_sync( void );
+
+//////////////////////////////////////////////////////////////////////////
+
+void sim_seed( uint32_t seed )
+{
+	rng = seed ? seed : 1;
+}
+
+uint32_t sim_random( void )
+{
+	rng ^= rng << 13;
+	rng ^= rng >> 17;
+	rng ^= rng << 5;
+	return rng;
+}
+
+static uint32_t scl_cycles( void )
+{
+	return 10UL + 2UL * twi.MBAUD;
+}
+
+static sim_addr_stats_t* cur_stats( void )
+{
+	return &addr_stats[cur_addr & 0x7F];
+}
+
+static bool twi_enabled( void )
+{
+	return ( mctrla & TWI_ENABLE_bm ) != 0;
+}
+
+static void set_bus( uint8_t state )
+{
+	if ( state == TWI_BUSSTATE_UNKNOWN_gc && bus != TWI_BUSSTATE_UNKNOWN_gc )
+		t_unknown = sim_now;
+	bus = state;
+}
+
+static void bus_end( void )
+{
+	if ( in_bus )
+		cur_stats()->bus_cycles += sim_now - t_bus_start;
+	in_bus = false;
+}
+
+static sim_device_t* find_device( uint8_t address )
+{
+	sim_device_t *d;
+
+	for ( d = devices; d; d = d->next )
+		if ( d->address == address )
+			return d;
+	return NULL;
+}
+
+// 선택된 Slave의 트랜잭션이 비정상으로 끝났다.
+static void dev_abort( void )
+{
+	if ( dev && dev->abort )
+		dev->abort( dev );
+	dev = NULL;
+}
+
+static sim_fault_t roll_fault( bool nack_ok )
+{
+	uint32_t pick;
+	sim_fault_t f;
+
+	if ( fault_rate == 0 || sim_random() % 1000 >= fault_rate )
+		return SIM_FAULT_NONE;
+
+	pick = sim_random() % ( SIM_FAULT_COUNT - 1 );
+	f = (sim_fault_t)( SIM_FAULT_NACK + pick );
+	if ( !( fault_mask & ( 1 << f ) ) || ( f == SIM_FAULT_NACK && !nack_ok ) )
+		return SIM_FAULT_NONE;
+
+	cur_stats()->injected[f]++;
+	attempt_faulted = true;
+	return f;
+}
+
+/*
+ * NACK이외의 Fault. true면 이번 byte는 여기서 끝났다.
+ */
+static bool inject( sim_fault_t f )
+{
+	switch ( f )
+	{
+		case SIM_FAULT_ARBLOST :
+			flags |= TWI_ARBLOST_bm | TWI_WIF_bm;
+			t_other_done = sim_now + SIM_US( 50 + sim_random() % 150 );
+			set_bus( TWI_BUSSTATE_BUSY_gc );
+			break;
+		case SIM_FAULT_BUSERR :
+			flags |= TWI_BUSERR_bm | ( reading ? TWI_RIF_bm : TWI_WIF_bm );
+			set_bus( TWI_BUSSTATE_UNKNOWN_gc );
+			break;
+		case SIM_FAULT_DROP :
+			break;
+		case SIM_FAULT_STUCK :
+			sda_stuck = true;
+			stuck_clocks = (uint8_t)( 1 + sim_random() % 9 );
+			break;
+		default :
+			return false;
+	}
+	dev_abort();
+	bus_end();
+	hold = false;
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Master
+
+static void schedule( sim_event_t e, uint32_t clocks )
+{
+	ev = e;
+	ev_time = sim_now + (uint64_t)clocks * scl_cycles();
+	cur_stats()->scl += clocks;
+}
+
+static void begin_start( void )
+{
+	wait_start = false;
+	if ( sda_stuck )
+		return;					// START를 만들 수 없다. (Watchdog이 끝낸다)
+
+	set_bus( TWI_BUSSTATE_OWNER_gc );
+	in_bus = true;
+	t_bus_start = sim_now;
+	schedule( EV_ADDR, 10 );	// START + 주소 8bit + ACK
+}
+
+static void master_reset( void )
+{
+	ev = EV_NONE;
+	wait_start = false;
+	hold = false;
+	flags &= (uint8_t)~( TWI_RIF_bm | TWI_WIF_bm | TWI_RXACK_bm );
+	dev_abort();
+	bus_end();
+	set_bus( TWI_BUSSTATE_UNKNOWN_gc );
+}
+
+static void maddr_write( uint8_t value )
+{
+	flags &= (uint8_t)~( TWI_RIF_bm | TWI_WIF_bm );
+	if ( !twi_enabled() )
+		return;
+
+	addr_byte = value;
+	reading = ( value & 1 ) != 0;
+
+	if ( bus == TWI_BUSSTATE_OWNER_gc && ev == EV_NONE )
+	{
+		// Repeated START
+		if ( dev && dev->stop )
+			dev->stop( dev, true );
+		dev = NULL;
+		hold = false;
+		cur_addr = value >> 1;
+		schedule( EV_ADDR, 10 );
+		return;
+	}
+
+	cur_addr = value >> 1;
+	cur_stats()->attempts++;
+	if ( bus == TWI_BUSSTATE_IDLE_gc )
+		begin_start();
+	else
+		wait_start = true;
+}
+
+static void mdata_write( uint8_t value )
+{
+	flags &= (uint8_t)~( TWI_RIF_bm | TWI_WIF_bm );
+	if ( bus != TWI_BUSSTATE_OWNER_gc || !hold || reading )
+		return;
+
+	hold = false;
+	tx_byte = value;
+	schedule( EV_TX, 9 );
+}
+
+static void do_stop( void )
+{
+	if ( dev && dev->stop )
+		dev->stop( dev, false );
+	dev = NULL;
+	hold = false;
+	bus_end();
+	set_bus( TWI_BUSSTATE_IDLE_gc );
+}
+
+static void mcmd_write( uint8_t cmd )
+{
+	flags &= (uint8_t)~( TWI_RIF_bm | TWI_WIF_bm );
+	if ( bus != TWI_BUSSTATE_OWNER_gc || !hold )
+		return;
+
+	switch ( cmd )
+	{
+		case TWI_MCMD_RECVTRANS_gc :
+			if ( reading && !ackact )
+			{
+				hold = false;
+				schedule( EV_RX, 9 );
+			}
+			break;
+		case TWI_MCMD_STOP_gc :
+			do_stop();
+			break;
+		case TWI_MCMD_REPSTART_gc :
+			hold = false;		// ACKACT 전송, 다음 MADDR Write에서 Repeated START
+			break;
+		default :
+			break;
+	}
+}
+
+static void event_addr( void )
+{
+	sim_fault_t f = roll_fault( true );
+	bool ack;
+
+	if ( inject( f ) )
+		return;
+
+	dev = find_device( cur_addr );
+	ack = dev && dev->start && dev->start( dev, reading );
+	if ( ack && f == SIM_FAULT_NACK )
+		dev_abort();
+	if ( !ack || f == SIM_FAULT_NACK )
+	{
+		dev = NULL;
+		cur_stats()->nack++;
+		attempt_faulted = true;
+		flags |= TWI_WIF_bm | TWI_RXACK_bm;
+		hold = true;
+		return;
+	}
+
+	flags &= (uint8_t)~TWI_RXACK_bm;
+	if ( reading )
+		schedule( EV_RX, 9 );	// Read 주소가 ACK되면 첫 byte까지 받는다.
+	else
+	{
+		flags |= TWI_WIF_bm;
+		hold = true;
+	}
+}
+
+static void event_tx( void )
+{
+	sim_fault_t f = roll_fault( true );
+	bool ack;
+
+	if ( inject( f ) )
+		return;
+
+	ack = dev && dev->write && dev->write( dev, tx_byte );
+	if ( !ack || f == SIM_FAULT_NACK )
+	{
+		if ( f != SIM_FAULT_NACK )
+			attempt_faulted = true;
+		cur_stats()->nack++;
+		flags |= TWI_WIF_bm | TWI_RXACK_bm;
+	}
+	else
+	{
+		flags &= (uint8_t)~TWI_RXACK_bm;
+		flags |= TWI_WIF_bm;
+	}
+	hold = true;
+}
+
+static void event_rx( void )
+{
+	sim_fault_t f = roll_fault( false );
+
+	if ( inject( f ) )
+		return;
+
+	rxdata = ( dev && dev->read ) ? dev->read( dev ) : 0xFF;
+	flags |= TWI_RIF_bm;
+	hold = true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// 레지스터 Hook
+
+static void twi_publish( void )
+{
+	uint8_t status = flags | bus;
+
+	if ( hold )
+		status |= TWI_CLKHOLD_bm;
+
+	twi.MCTRLA = pub_mctrla = SENTINEL | mctrla;
+	twi.MCTRLB = pub_mctrlb = SENTINEL | ackact;
+	twi.MSTATUS = pub_mstatus = SENTINEL | status;
+	twi.MADDR = SENTINEL;
+	twi.MDATA = SENTINEL | rxdata;
+}
+
+static void twi_sync( void )
+{
+	uint16_t v;
+
+	if ( ( v = twi.MCTRLA ) != pub_mctrla )
+	{
+		uint8_t old = mctrla;
+
+		mctrla = (uint8_t)v;
+		if ( ( old ^ mctrla ) & TWI_ENABLE_bm )
+			master_reset();		// 켜거나 끄면 Bus 상태를 모른다.
+	}
+	if ( ( v = twi.MSTATUS ) != pub_mstatus )
+	{
+		flags &= (uint8_t)~( v & TWI_FLAGS_W1C );
+		if ( ( v & TWI_BUSSTATE_gm ) == TWI_BUSSTATE_IDLE_gc && twi_enabled() )
+			set_bus( TWI_BUSSTATE_IDLE_gc );
+	}
+	if ( ( v = twi.MCTRLB ) != pub_mctrlb )
+	{
+		ackact = v & TWI_ACKACT_bm;
+		if ( v & TWI_FLUSH_bm )
+		{
+			master_reset();
+			attempt_faulted = false;	// Driver는 시도마다 FLUSH한다.
+		}
+		if ( v & TWI_MCMD_gm )
+			mcmd_write( v & TWI_MCMD_gm );
+	}
+	if ( ( v = twi.MADDR ) != SENTINEL )
+		maddr_write( (uint8_t)v );
+	if ( !( ( v = twi.MDATA ) & SENTINEL ) )
+		mdata_write( (uint8_t)v );
+
+	twi_publish();
+}
+
+static void port_sync( void )
+{
+	bool scl_low, sda_low;
+
+	if ( port.DIRSET ) { port.DIR |= port.DIRSET;				port.DIRSET = 0; }
+	if ( port.DIRCLR ) { port.DIR &= (uint8_t)~port.DIRCLR;	port.DIRCLR = 0; }
+	if ( port.OUTSET ) { port.OUT |= port.OUTSET;				port.OUTSET = 0; }
+	if ( port.OUTCLR ) { port.OUT &= (uint8_t)~port.OUTCLR;	port.OUTCLR = 0; }
+
+	// TWI가 꺼져 있을 때만 PORT가 핀을 움직인다. (OUT = 0 + DIR로 Open-Drain)
+	scl_low = !twi_enabled() && ( port.DIR & PIN3_bm ) && !( port.OUT & PIN3_bm );
+	if ( scl_low_prev && !scl_low && sda_stuck && --stuck_clocks == 0 )
+		sda_stuck = false;
+	scl_low_prev = scl_low;
+
+	sda_low = sda_stuck || ( !twi_enabled() && ( port.DIR & PIN2_bm ) && !( port.OUT & PIN2_bm ) );
+	port.IN = ( sda_low ? 0 : PIN2_bm ) | ( scl_low ? 0 : PIN3_bm );
+}
+
+static void tcb_publish( void )
+{
+	tcb.CNT = (uint16_t)( sim_now / 2 );
+}
+
+TWI_t *sim_twi0( void )
+{
+	twi_sync();
+	cur_stats()->reg_access++;
+	return &twi;
+}
+
+TCB_t *sim_tcb1( void )
+{
+	// Polling Loop(ISR 밖)가 Timer를 볼 때마다 1us가 흐른다.
+	if ( !in_isr )
+		sim_advance( (uint32_t)SIM_US(1) );
+	tcb_publish();
+	return &tcb;
+}
+
+PORT_t *sim_porta( void )
+{
+	twi_sync();				// TWI Enable이 바뀌었으면 핀 주인이 바뀐다.
+	port_sync();
+	return &port;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// 시간, 인터럽트
+
+static void call_isr( void (*isr)( void ) )
+{
+	uint8_t sreg = sim_sreg;
+
+	in_isr++;
+	sim_sreg &= (uint8_t)~CPU_I_bm;
+	isr();
+	twi_sync();
+	sim_sreg = sreg;
+	in_isr--;
+}
+
+static bool twi_irq( void )
+{
+	return ( ( flags & TWI_WIF_bm ) && ( mctrla & TWI_WIEN_bm ) )
+		|| ( ( flags & TWI_RIF_bm ) && ( mctrla & TWI_RIEN_bm ) );
+}
+
+static void deliver_irqs( void )
+{
+	uint16_t n;
+
+	for ( n = 0; n < ISR_STORM; n++ )
+	{
+		twi_sync();
+		if ( !( sim_sreg & CPU_I_bm ) || in_isr )
+			return;
+
+		if ( twi_irq() )
+		{
+			cur_stats()->isr++;
+			call_isr( TWI0_TWIM_vect );
+		}
+		else if ( ( tcb.INTFLAGS & TCB_CAPT_bm ) && ( tcb.INTCTRL & TCB_CAPT_bm ) )
+		{
+			call_isr( TCB1_INT_vect );
+			tcb.INTFLAGS &= (uint8_t)~TCB_CAPT_bm;
+		}
+		else if ( tick_pending )
+		{
+			tick_pending = false;
+			if ( tick_isr )
+				call_isr( tick_isr );
+		}
+		else
+			return;
+	}
+	fprintf( stderr, "sim: ISR이 Flag를 지우지 않는다. (MSTATUS 0x%02X)\n", flags | bus );
+	exit( 2 );
+}
+
+// 지금 시각까지 일어날 일을 처리한다.
+static void run_due( void )
+{
+	if ( ev != EV_NONE && ev_time <= sim_now )
+	{
+		sim_event_t e = ev;
+
+		ev = EV_NONE;
+		if ( e == EV_ADDR )		event_addr();
+		else if ( e == EV_TX )	event_tx();
+		else					event_rx();
+	}
+	if ( bus == TWI_BUSSTATE_BUSY_gc && t_other_done <= sim_now )
+		set_bus( TWI_BUSSTATE_IDLE_gc );
+	if ( bus == TWI_BUSSTATE_UNKNOWN_gc && twi_enabled() && ( mctrla & TWI_TIMEOUT_gm ) && !sda_stuck
+		 && sim_now - t_unknown >= SIM_US(200) )
+		set_bus( TWI_BUSSTATE_IDLE_gc );
+	if ( wait_start && bus == TWI_BUSSTATE_IDLE_gc )
+		begin_start();
+
+	while ( next_tick <= sim_now )
+	{
+		next_tick += TICK_CYCLES;
+		tick_pending = true;
+	}
+	while ( next_wrap <= sim_now )
+	{
+		next_wrap += TCB_WRAP_CYCLES;
+		tcb.INTFLAGS |= TCB_CAPT_bm;
+	}
+}
+
+static uint64_t next_due( void )
+{
+	uint64_t t = next_tick < next_wrap ? next_tick : next_wrap;
+
+	if ( ev != EV_NONE && ev_time < t )
+		t = ev_time;
+	if ( bus == TWI_BUSSTATE_BUSY_gc && t_other_done < t )
+		t = t_other_done;
+	if ( bus == TWI_BUSSTATE_UNKNOWN_gc && twi_enabled() && ( mctrla & TWI_TIMEOUT_gm ) && !sda_stuck
+		 && t_unknown + SIM_US(200) < t )
+		t = t_unknown + SIM_US(200);
+	return t > sim_now ? t : sim_now + 1;
+}
+
+void sim_advance( uint32_t cycles )
+{
+	uint64_t end = sim_now + cycles;
+
+	adv_depth++;
+	twi_sync();
+	port_sync();
+	for ( ;; )
+	{
+		run_due();
+		deliver_irqs();
+
+		uint64_t t = next_due();
+		if ( t > end )
+			break;
+		sim_now = t;
+	}
+	sim_now = end;
+	run_due();
+	deliver_irqs();
+	adv_depth--;
+
+	if ( deadline && sim_now > deadline )
+	{
+		fprintf( stderr, "sim: %llu us 안에 끝나지 않았다. (Hang)\n", (unsigned long long)( sim_now / SIM_US(1) ) );
+		exit( 2 );
+	}
+}
+
+void sim_delay_us( uint32_t us )
+{
+	sim_advance( (uint32_t)SIM_US(us) );
+}
+
+void sim_sei( void )
+{
+	sim_sreg |= CPU_I_bm;
+	deliver_irqs();
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void sim_reset( void )
+{
+	memset( &twi, 0, sizeof(twi) );
+	memset( &tcb, 0, sizeof(tcb) );
+	memset( &port, 0, sizeof(port) );
+	memset( addr_stats, 0, sizeof(addr_stats) );
+
+	sim_now = 0;
+	sim_sreg = 0;
+	mctrla = ackact = flags = rxdata = 0;
+	bus = TWI_BUSSTATE_UNKNOWN_gc;
+	ev = EV_NONE;
+	hold = reading = wait_start = in_bus = attempt_faulted = false;
+	dev = NULL;
+	sda_stuck = scl_low_prev = false;
+	devices = NULL;
+	tick_isr = NULL;
+	tick_pending = false;
+	next_tick = TICK_CYCLES;
+	next_wrap = TCB_WRAP_CYCLES;
+	in_isr = adv_depth = 0;
+	deadline = 0;
+	fault_rate = 0;
+	fault_mask = 0;
+
+	twi_publish();
+	port_sync();
+	tcb_publish();
+}
+
+void sim_attach( sim_device_t *device )
+{
+	device->next = devices;
+	devices = device;
+}
+
+void sim_set_tick( void (*tick)( void ) )
+{
+	tick_isr = tick;
+}
+
+void sim_set_deadline( uint64_t time )
+{
+	deadline = time;
+}
+
+void sim_set_fault_rate( uint16_t per_mille, uint8_t mask )
+{
+	fault_rate = per_mille;
+	fault_mask = mask;
+}
+
+bool sim_attempt_faulted( void )
+{
+	return attempt_faulted;
+}
+
+bool sim_sda_stuck( void )
+{
+	return sda_stuck;
+}
+
+const sim_addr_stats_t* sim_addr_stats( uint8_t address )
+{
+	return &addr_stats[address & 0x7F];
+}
+
+void sim_clear_stats( void )
+{
+	memset( addr_stats, 0, sizeof(addr_stats) );
+}
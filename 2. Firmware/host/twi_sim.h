@@ -0,0 +1,124 @@
+#ifndef TWI_SIM_H_
+#define TWI_SIM_H_
+
+/*
+ * #HostSimulator
+ *
+ * TWI0 Master를 바이트 단위로 흉내내는 Host용 Simulator.
+ * Firmware의 i2c.c를 수정 없이 PC에서 돌려 stateHandlerTable의 모든 경로(NACK, Arbitration Lost,
+ * Bus Error, Timeout, Stuck SDA)를 Fault 주입으로 확인하기 위해 만들었다. (AVR에는 올라가지 않는다)
+ *
+ * 시간
+ *   sim_now는 CPU cycle (F_CPU 5MHz → 0.2us) 단위이다.
+ *   sim_advance(), _delay_us(), TCB1.CNT 읽기(ISR 밖, Polling Loop)에서만 시간이 흐른다.
+ *   SCL 한 주기는 I2C_SetBusSpeed()와 같은 공식(10 + 2 * MBAUD cycle)으로 계산한다.
+ *
+ * 인터럽트
+ *   SREG의 I bit가 켜져 있고 ISR 안이 아닐 때, 시간이 흐르는 지점에서
+ *   TWI0_TWIM_vect(WIF/RIF + WIEN/RIEN), TCB1_INT_vect(Overflow), 1ms Tick(sim_set_tick()) 순으로 호출한다.
+ *
+ * Bus 동작 (데이터시트의 Master 동작을 byte 단위로 단순화)
+ *   MADDR Write     : START(Bus가 IDLE) 또는 Repeated START(OWNER) 후 주소 전송 → WIF
+ *                     Read 주소가 ACK되면 첫 byte까지 받은 뒤 RIF
+ *   MDATA Write     : 1byte 전송 → WIF, RXACK
+ *   MCMD RECVTRANS  : ACKACT 전송 후 다음 byte 수신 → RIF
+ *   MCMD STOP       : (Read 중이면 ACKACT 후) STOP, Bus IDLE
+ *   MCMD REPSTART   : ACKACT 전송, 다음 MADDR Write가 Repeated START
+ *   FLUSH, Enable 끔 : Master 상태 초기화, Bus UNKNOWN
+ *   MSTATUS Write   : RIF/WIF/ARBLOST/BUSERR는 1을 쓰면 지워지고, BUSSTATE에 1을 쓰면 IDLE
+ *   RIF/WIF는 MADDR/MDATA/MCMD Write로도 지워진다.
+ *
+ * Bus가 UNKNOWN/BUSY일 때의 START는 Bus가 풀릴 때까지(UNKNOWN은 Inactive Bus Timeout 뒤) 미뤄지고,
+ * SDA가 Low로 잡혀 있으면 아예 시작되지 않는다. (Driver의 Watchdog과 Bus Recovery가 풀어야 한다)
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SIM_F_CPU					5000000UL
+#define SIM_US(us)					( (uint64_t)(us) * ( SIM_F_CPU / 1000000UL ) )
+
+extern uint64_t sim_now;
+
+/*
+ * #DeviceModel
+ * Slave 하나. 주소가 맞으면 start()가 불리고, 이후 byte마다 write()/read(),
+ * 끝날 때 stop()(STOP, repeated = false) 또는 stop(repeated = true), 비정상 종료면 abort()가 불린다.
+ * start()/write()가 false를 돌려주면 NACK.
+ */
+typedef struct sim_device sim_device_t;
+
+struct sim_device
+{
+	uint8_t address;
+	const char *name;
+
+	bool (*start)( sim_device_t *dev, bool read );
+	bool (*write)( sim_device_t *dev, uint8_t data );
+	uint8_t (*read)( sim_device_t *dev );
+	void (*stop)( sim_device_t *dev, bool repeated );
+	void (*abort)( sim_device_t *dev );
+
+	sim_device_t *next;
+};
+
+/*
+ * #FaultInjection
+ * 주소/데이터 byte가 끝날 때마다 rate/1000 확률로 아래 중 하나를 일으킨다.
+ *   NACK    : Master에게 NACK으로 보인다. (데이터 byte는 Slave가 받았고, 이후 STOP이면 반영된다)
+ *   ARBLOST : 다른 Master에게 Arbitration을 진다. 그 Master가 끝날 때까지 Bus BUSY
+ *   BUSERR  : 잘못된 START/STOP 감지, Bus UNKNOWN
+ *   DROP    : 이벤트가 오지 않는다. (Clock Stretching이 끝나지 않는 Slave 등)
+ *   STUCK   : Slave가 SDA를 Low로 잡고 놓지 않는다. SCL을 1 ~ 9번 주어야 풀린다.
+ * DROP/STUCK은 Driver Watchdog(Timeout)과 Bus Recovery로만 빠져나올 수 있다.
+ */
+typedef enum
+{
+	SIM_FAULT_NONE,
+	SIM_FAULT_NACK,
+	SIM_FAULT_ARBLOST,
+	SIM_FAULT_BUSERR,
+	SIM_FAULT_DROP,
+	SIM_FAULT_STUCK,
+	SIM_FAULT_COUNT
+}sim_fault_t;
+
+/*
+ * 주소별 계수. Master가 본 결과만 센다. (Busy NACK도 nack에 들어간다)
+ * isr/reg_access는 그 주소의 트랜잭션이 진행 중일 때의 TWI0_TWIM_vect 호출과 TWI0 레지스터 접근 수,
+ * scl은 그 주소로 나간 SCL clock 수, bus_cycles는 START부터 STOP(또는 중단)까지의 시간[CPU cycle]이다.
+ */
+typedef struct
+{
+	uint32_t attempts;
+	uint32_t nack;
+	uint32_t injected[SIM_FAULT_COUNT];
+	uint32_t isr;
+	uint32_t reg_access;
+	uint32_t scl;
+	uint64_t bus_cycles;
+}sim_addr_stats_t;
+
+void sim_reset( void );
+void sim_attach( sim_device_t *dev );
+void sim_set_tick( void (*tick)( void ) );		// 1ms Timer ISR (NULL이면 없음)
+
+void sim_advance( uint32_t cycles );			// cycles만큼 시간을 진행시킨다.
+void sim_set_deadline( uint64_t time );			// sim_now가 넘으면 Hang으로 보고 종료 (0이면 없음)
+
+void sim_set_fault_rate( uint16_t per_mille, uint8_t mask );	// mask : (1 << SIM_FAULT_xxx)의 OR
+void sim_seed( uint32_t seed );
+uint32_t sim_random( void );
+
+/*
+ * 마지막 시도(FLUSH 이후)에서 Master가 NACK, Arbitration Lost, Bus Error를 보았거나
+ * 전송이 중단(DROP/STUCK, Recovery)되었으면 true.
+ * 완료 callback에서 부르면 그 트랜잭션의 마지막 시도에 대한 값이다.
+ */
+bool sim_attempt_faulted( void );
+
+bool sim_sda_stuck( void );
+const sim_addr_stats_t* sim_addr_stats( uint8_t address );
+void sim_clear_stats( void );
+
+#endif /* TWI_SIM_H_ */